@@ -23,10 +23,10 @@
 #include "libseeq.h"
 #include "seeqcore.h"
 
-int seeqerr = 0;
+__thread int seeqerr = 0;
 
 static const char *
-seeq_strerror[12] =
+seeq_strerror[17] =
    {"Check errno",
     "Illegal matching distance value",
     "Incorrect pattern (double opening brackets)",
@@ -38,7 +38,12 @@ seeq_strerror[12] =
     "Illegal path value passed to 'trie_insert'",
     "Pattern length must be larger than matching distance",
     "Passed seeq_t struct does not contain a valid file pointer",
-    "End of line reached."};
+    "End of line reached.",
+    "Unrecognized DFA file format or version",
+    "DFA file is truncated or corrupted",
+    "The DFAs are not shared (see SQ_SHARED)",
+    "Not supported for pattern sets (see 'seeqNewMulti' and SQ_BOTHSTRANDS)",
+    "Sequence too long (see 'seeqMatchN' and 'seeqPackedMatch')"};
 
 seeq_t *
 seeqNew
@@ -63,6 +68,81 @@ seeqNew
 //
 // SIDE EFFECTS:
 //   The returned seeq_t structure must be freed using 'seeqFree'.
+{
+   return seeqNewOpt(pattern, mismatches, maxmemory, SQ_LAZY);
+}
+
+
+seeq_t *
+seeqNewOpt
+(
+ const char * pattern,
+ int          mismatches,
+ size_t       maxmemory,
+ int          options
+)
+// SYNOPSIS:                                                              
+//   Same as 'seeqNew', with compile options.
+//                                                                        
+// PARAMETERS:                                                            
+//   pattern    : matching pattern (accepted characters 'A','C','G','T','U','N','[',']').
+//   mismatches : matching distance (see METRIC OPTIONS).
+//   maxmemory  : DFA memory limit, in bytes. When the limit is reached, the states
+//                that the text no longer uses are evicted (except with SQ_SHARED).
+//   options    : compile options. Set to 0 for default (SQ_LAZY).
+//
+//                COMPILE OPTIONS:
+//                * SQ_LAZY: the DFA states are computed on demand while matching. [DEFAULT]
+//                * SQ_PRECOMPILE: all the reachable states of both DFAs are computed here,
+//                  within the 'maxmemory' limit. If the limit is reached the remaining
+//                  states are computed on demand.
+//
+//                SHARING OPTIONS:
+//                * SQ_PRIVATE: the DFAs are used by a single thread. [DEFAULT]
+//                * SQ_SHARED: the DFAs can be shared by many threads, each matching
+//                  with its own handle (see 'seeqClone') or context (see 'seeqCtxNew').
+//                  New states are computed only once for all the threads.
+//
+//                PAGE OPTIONS:
+//                * SQ_SMALLPAGES: the DFAs are stored in regular pages. [DEFAULT]
+//                * SQ_HUGEPAGES: the DFAs are stored in transparent huge pages, if the
+//                  system supports them.
+//
+//                METRIC OPTIONS:
+//                * SQ_LEVENSHTEIN: substitutions, insertions and deletions. [DEFAULT]
+//                * SQ_HAMMING: substitutions only. The matches span exactly the length
+//                  of the pattern, so their start is known without the reverse DFA.
+//
+//                STRAND OPTIONS:
+//                * SQ_FORWARD: matches the pattern as given. [DEFAULT]
+//                * SQ_BOTHSTRANDS: matches the pattern and its reverse complement in
+//                  one pass (see 'seeqNewMulti'). The matches of the reverse complement
+//                  have the 'strand' flag set. They are shared with contexts only.
+//
+//                STRIDE OPTIONS:
+//                * SQ_STRIDE1: the text is read one base per transition. [DEFAULT]
+//                * SQ_STRIDE2: the text is read two bases per transition when both are
+//                  DNA, which halves the chain of dependent loads on long texts. The
+//                  2-base transitions are composed from the single-base ones as the
+//                  text uses them and take up to 200 bytes per state on top of
+//                  'maxmemory' (see 'dfa_stride').
+//
+//                START OPTIONS (Levenshtein distance):
+//                * SQ_REVSTART: the start of each match is found by reading the text
+//                  backwards from its end with a reverse DFA. [DEFAULT]
+//                * SQ_FWDSTART: the DFA states also track the length of the shortest
+//                  alignment of each distance (see 'start_row'), so the start of the
+//                  matches is known in the same pass and there is no reverse DFA. The
+//                  DFA has more states. The start is the one of the shortest alignment
+//                  that ends at the end of the match, while the reverse DFA may find a
+//                  later start of an alignment that ends before it.
+//
+// RETURN:                                                                
+//   Returns a pointer to a seeq_t structure or NULL in case of error, and seeqerr is
+//   set appropriately.
+//
+// SIDE EFFECTS:
+//   The returned seeq_t structure must be freed using 'seeqFree'.
 {
 
    // Check parameters.
@@ -95,23 +175,84 @@ seeqNew
       return NULL;
    }
 
-   // Allocate DFAs.
-   dfa_t * dfa = dfa_new(wlen, mismatches, INITIAL_DFA_SIZE, INITIAL_TRIE_SIZE, maxmemory);
+   // Both strands are a set of two patterns. The keys of the reverse
+   // complement are the reversed keys with the bits of A-T and C-G swapped.
+   if ((options & MASK_STRAND) == SQ_BOTHSTRANDS) {
+      char * both = malloc(2*(size_t)wlen);
+      if (both == NULL) {
+         free(keys); free(rkeys);
+         return NULL;
+      }
+      memcpy(both, keys, (size_t)wlen);
+      for (int i = 0; i < wlen; i++) {
+         char k = rkeys[i];
+         both[wlen+i] = (char)((k & 0x10) | ((k & 0x01) << 3) | ((k & 0x08) >> 3) |
+                               ((k & 0x02) << 1) | ((k & 0x04) >> 1));
+      }
+      free(keys); free(rkeys);
+      segment_t seg[2] = {{wlen, mismatches}, {wlen, mismatches}};
+      seeq_t * sq = patset_new(both, seg, 2, maxmemory, options);
+      if (sq != NULL) ((patset_t *) sq->pats)->strands = 1;
+      return sq;
+   }
+
+   // Allocate DFAs. Only the Levenshtein matches need the reverse DFA to
+   // find their start.
+   segment_t seg = {wlen, mismatches};
+   int metric = (options & MASK_METRIC) == SQ_HAMMING ? DFA_HAMMING :
+                (options & MASK_START) == SQ_FWDSTART ? DFA_STARTS : DFA_LEVENSHTEIN;
+   dfa_t * dfa = dfa_newmulti(&seg, 1, metric, INITIAL_DFA_SIZE, INITIAL_TRIE_SIZE, maxmemory);
    if (dfa == NULL) {
       free(keys); free(rkeys);
       return NULL;
    }
 
-   dfa_t * rdfa = dfa_new(wlen, mismatches, INITIAL_DFA_SIZE, INITIAL_TRIE_SIZE, maxmemory);
-   if (rdfa == NULL) {
-      free(keys); free(rkeys); free(dfa);
+   dfa_t * rdfa = NULL;
+   if (metric == DFA_LEVENSHTEIN &&
+       (rdfa = dfa_newmulti(&seg, 1, metric, INITIAL_DFA_SIZE, INITIAL_TRIE_SIZE, maxmemory)) == NULL) {
+      free(keys); free(rkeys); dfa_free(dfa);
+      return NULL;
+   }
+
+   // Advise before the pages are used.
+   if ((options & MASK_PAGES) == SQ_HUGEPAGES) {
+      dfa_hugepages(dfa);
+      if (rdfa != NULL) dfa_hugepages(rdfa);
+   }
+
+   // Precompile DFAs.
+   if ((options & MASK_COMPILE) == SQ_PRECOMPILE) {
+      if (dfa_precompile(&dfa, wlen, mismatches, keys) == -1 ||
+          (rdfa != NULL && dfa_precompile(&rdfa, wlen, mismatches, rkeys) == -1)) {
+         free(keys); free(rkeys);
+         dfa_free(dfa);
+         dfa_free(rdfa);
+         return NULL;
+      }
+   }
+
+   // Share DFAs (complete DFAs are read-only). Private DFAs
+   // evict states when the memory limit is reached.
+   if ((options & MASK_SHARE) == SQ_SHARED) {
+      if ((!dfa->complete && dfa_share(dfa)) || (rdfa != NULL && !rdfa->complete && dfa_share(rdfa))) {
+         free(keys); free(rkeys); dfa_free(dfa); dfa_free(rdfa);
+         return NULL;
+      }
+   } else if (dfa_evictable(dfa) || (rdfa != NULL && dfa_evictable(rdfa))) {
+      free(keys); free(rkeys); dfa_free(dfa); dfa_free(rdfa);
+      return NULL;
+   }
+
+   // Text bases are read by pairs in the forward DFA.
+   if ((options & MASK_STRIDE) == SQ_STRIDE2 && dfa_stride(dfa)) {
+      free(keys); free(rkeys); dfa_free(dfa); dfa_free(rdfa);
       return NULL;
    }
 
    // Create seeq object.
    seeq_t * sq = malloc(sizeof(seeq_t));
    if (sq == NULL) {
-      free(keys); free(rkeys); free(dfa); free(rdfa);
+      free(keys); free(rkeys); dfa_free(dfa); dfa_free(rdfa);
       return NULL;
    }
 
@@ -122,846 +263,4461 @@ seeqNew
    sq->rkeys  = rkeys;
    sq->dfa    = (void *) dfa;
    sq->rdfa   = (void *) rdfa;
+   sq->ctx    = (seeq_ctx_t) {0};
+   sq->pats   = NULL;
    sq->bufsz  = 0;
    sq->string = NULL;
+   sq->seeds  = NULL;
 
    // Initialize match_t stack.
-   sq->hits = 0;
-   sq->stacksize = INITIAL_MATCH_STACK_SIZE;
-   sq->match  = malloc(sq->stacksize * sizeof(match_t));
-   if (sq->match == NULL) {
-      free(keys); free(rkeys); free(dfa); free(rdfa); free(sq);
+   sq->ctx.stacksize = INITIAL_MATCH_STACK_SIZE;
+   sq->ctx.match = malloc(sq->ctx.stacksize * sizeof(match_t));
+   if (sq->ctx.match == NULL) {
+      free(keys); free(rkeys); dfa_free(dfa); dfa_free(rdfa); free(sq);
       return NULL;
    }
 
+   // The prefilter is optional, the text is matched whole without it.
+   sq->seeds = seed_new(keys, &seg, 1);
+
    return sq;
 }
 
-void
-seeqFree
+seeq_t *
+seeqNewMulti
 (
- seeq_t * sq
+ const char ** patterns,
+ const int   * mismatches,
+ int           npat,
+ size_t        maxmemory
 )
 // SYNOPSIS:                                                              
-//   Safely frees a seeq_t structure created with 'seeqNew'. This function must be used
-//   instead of 'free()', otherwise the references to the internal structures will be lost.
+//   Creates a new seeq_t structure to match a set of patterns in one pass. The
+//   states of the DFA track the distances of all the patterns at the same time,
+//   so the text is scanned once regardless of the size of the set. The matches
+//   are tagged with the index of the pattern (see 'match_t').
+//
+//   The distances of the patterns are compared relative to their threshold. At
+//   each matching position, the patterns with the lowest relative distance are
+//   reported (SQ_BEST keeps the first one). Pattern sets cannot be cloned
+//   ('seeqClone') nor saved ('seeqSave'). Same as 'seeqNewMultiOpt' with the
+//   default options.
 //                                                                        
 // PARAMETERS:                                                            
-//   sq       : pointer to the seeq_t structure.
+//   patterns   : matching patterns (accepted characters 'A','C','G','T','U','N','[',']').
+//   mismatches : matching distance (Levenshtein distance) of each pattern.
+//   npat       : number of patterns.
+//   maxmemory  : DFA memory limit, in bytes. When the limit is reached, the states
+//                that the text no longer uses are evicted.
 //
 // RETURN:                                                                
-//   void.
+//   Returns a pointer to a seeq_t structure or NULL in case of error, and seeqerr is
+//   set appropriately.
 //
 // SIDE EFFECTS:
-//   The memory pointed by sq will be freed.
+//   The returned seeq_t structure must be freed using 'seeqFree'.
 {
-   // Free string if allocated.
-   if (sq->string != NULL) free(sq->string);
-   // Free keys and match stack.
-   free(sq->match);
-   free(sq->keys);
-   free(sq->rkeys);
-   // Free DFAs.
-   dfa_free(sq->dfa);
-   dfa_free(sq->rdfa);
-   free(sq);
+   return seeqNewMultiOpt(patterns, mismatches, npat, maxmemory, SQ_LAZY);
 }
 
 
-long
-seeqStringMatch
+seeq_t *
+seeqNewMultiOpt
 (
- const char * data,
- seeq_t     * sq,
- int          options
+ const char ** patterns,
+ const int   * mismatches,
+ int           npat,
+ size_t        maxmemory,
+ int           options
 )
 // SYNOPSIS:                                                              
-//   Finds a pattern in the string 'data'. The matching pattern and distance are the ones
-//   specified in the call to seeqNew().
+//   Same as 'seeqNewMulti', with compile options (see 'seeqNewOpt'). The
+//   pattern sets created with SQ_SHARED are matched by many threads with
+//   their own context (see 'seeqCtxNew').
 //                                                                        
 // PARAMETERS:                                                            
-//   data    : string to match.
-//   sq      : pointer to a seeq_t structure. (see 'seeqNew')
-//   options : matching options. Set to 0 for default (SQ_FIRST|SQ_FAIL|SQ_LINES).
-//             Bitwise-OR the following macros to set different options.
-//             Macros from the same group are mutually exclusive. If two options from
-//             the same group are set, undefined behavior occurs.
-//
-//             MATCH OPTIONS:
-//             * SQ_FIRST: searches the line until the first match is found. [DEFAULT]
-//             * SQ_BEST: searches the whole line to find the best match, i.e. the one with
-//               minimum matching distance. In case of many best matches, the first is stored
-//               in 'sq'.
-//             * SQ_ALL: finds and stores in 'sq' all the matching positions of the line.
-//
-//             NON-DNA TEXT OPTIONS:
-//             * SQ_FAIL: stops searching the current line if an illegal character is
-//               found (allowed characters are 'a','A','c','C','g','G','t','T','u','U','n','N',
-//               '\0','\n'). [DEFAULT]
-//             * SQ_IGNORE: illegal characters will be ignored.
-//             * SQ_CONVERT: illegal characters will be substituted by mismatches ('N').
+//   patterns   : matching patterns (accepted characters 'A','C','G','T','U','N','[',']').
+//   mismatches : matching distance of each pattern (see METRIC OPTIONS).
+//   npat       : number of patterns.
+//   maxmemory  : DFA memory limit, in bytes.
+//   options    : compile options (see 'seeqNewOpt'), except SQ_BOTHSTRANDS.
 //
-//             INPUT OPTIONS:
-//             * SQ_LINES: Search until '\n' or '\0' is found. [DEFAULT]
-//             * SQ_STREAM: Search until '\0' is found, newline characters will be ignored.
-//             
 // RETURN:                                                                
-//   Returns the number of matches stored in 'sq', 0 if none was found or -1 in case of error and
-//   seeqerr is set appropriately. 
+//   Returns a pointer to a seeq_t structure or NULL in case of error, and seeqerr is
+//   set appropriately.
 //
 // SIDE EFFECTS:
-//   The match stack and the cached string of 'sq' are modified.
+//   The returned seeq_t structure must be freed using 'seeqFree'.
 {
    // Set error to 0.
    seeqerr = 0;
 
-   // Count replaces all other options.
-   int match_opt = options & MASK_MATCH;
-   int opt_best  = match_opt == SQ_BEST;
-   int all_match = match_opt == SQ_ALL || opt_best;
+   if (npat < 1 || (options & MASK_STRAND) == SQ_BOTHSTRANDS) {
+      seeqerr = 1;
+      return NULL;
+   }
 
-   int nondna_opt = options & MASK_NONDNA;
-   int opt_ignore = nondna_opt == SQ_IGNORE;
-   const int * translate = translate_ignore;
-   if (nondna_opt == SQ_CONVERT) translate = translate_convert;
+   segment_t * seg  = malloc((size_t)npat * sizeof(segment_t));
+   char      * keys = NULL;
+   size_t      klen = 0;
+   for (int k = 0; k < npat; k++) klen += strlen(patterns[k]);
+   if (seg == NULL || (keys = malloc(klen)) == NULL) {
+      free(seg);
+      return NULL;
+   }
 
-   int stream_opt = options & MASK_INPUT;
+   // Parse patterns. The keys of the patterns are concatenated.
+   int wlen = 0;
+   for (int k = 0; k < npat; k++) {
+      if (mismatches[k] < 0) seeqerr = 1;
+      else if ((seg[k].wlen = parse(patterns[k], keys + wlen)) != -1 &&
+               mismatches[k] >= seg[k].wlen) seeqerr = 9;
+      if (seeqerr) {
+         free(seg); free(keys);
+         return NULL;
+      }
+      seg[k].tau = mismatches[k];
+      wlen += seg[k].wlen;
+   }
 
-   // Allocate match stacks.
-   //   mstack_t ** mstack = malloc((size_t)(sq->tau+1)*sizeof(mstack_t*));
-   //   if (mstack == NULL) return -1;
-   //   for (int i = 0; i <= sq->tau; i++)
-   //      if((mstack[i] = stackNew(INITIAL_MATCH_STACK_SIZE)) == NULL) return -1;
+   seeq_t * sq = patset_new(keys, seg, npat, maxmemory, options);
+   free(seg);
+   return sq;
+}
 
-   // Set structure to non-matched.
-   sq->hits = 0;
 
-   // Reset search variables
-   int best_d = sq->tau + 1;
-   // Search variables
-   int streak_dist = sq->tau + 1;
-   int match = 0;
-   uint32_t current_node = DFA_ROOT_STATE;
-   int slen = strlen(data);
-   size_t state_size = ((dfa_t *) sq->dfa)->state_size;
-   int end = 0;
-   
-   // DFA state.
-   for (int i = 0; i <= slen; i++) {
-      // Update DFA.
-      int cin = (int)translate[(int)data[i]];
-      int current_dist = sq->tau + 1;
-      int min_to_match = 0;
-      if (cin < NBASES) {
-         vertex_t * vertex = (vertex_t *) (((dfa_t *)sq->dfa)->states + current_node * state_size);
-         uint32_t next = vertex->next[cin];
-         if (next == DFA_COMPUTE)
-            if (dfa_step(current_node, cin, sq->wlen, sq->tau, (dfa_t **) &(sq->dfa), sq->keys, &next)) return -1;
-         current_node = next;
-         vertex = (vertex_t *) (((dfa_t *)sq->dfa)->states + current_node * state_size);
-         current_dist = get_match(vertex->match);
-         min_to_match = (size_t) get_mintomatch(vertex->match);
-      }
-      else if (cin == 6 && stream_opt) continue;
-      else if (cin == 7 && opt_ignore) continue;
-      else if (cin >= 5) {
-         current_dist = sq->tau + 1;
-         end = 1;
-      }
+seeq_t *
+patset_new
+(
+ char            * keys,
+ const segment_t * seg,
+ int               npat,
+ size_t            maxmemory,
+ int               options
+)
+// SYNOPSIS:                                                              
+//   Creates the seeq_t structure of a pattern set (see 'seeqNewMulti').
+//                                                                        
+// PARAMETERS:                                                            
+//   keys      : concatenated keys of the patterns, as returned by parse. The
+//               seeq_t structure takes ownership (freed in case of error).
+//   seg       : length and mismatch threshold of each pattern.
+//   npat      : number of patterns.
+//   maxmemory : DFA memory limit, in bytes.
+//   options   : compile options (see 'seeqNewOpt').
+//
+// RETURN:                                                                
+//   Returns a pointer to a seeq_t structure or NULL in case of error, and seeqerr is
+//   set appropriately.
+//
+// SIDE EFFECTS:
+//   The returned seeq_t structure must be freed using 'seeqFree'.
+{
+   patset_t * pats = calloc(1, sizeof(patset_t) + (size_t)npat * sizeof(pattern_t));
+   if (pats == NULL) {
+      free(keys);
+      return NULL;
+   }
+   pats->npat = npat;
 
-      if (slen - i - 1 < min_to_match) {
-         current_dist = sq->tau + 1;
-         end = 1;
+   // Hamming and DFA_STARTS matches do not need the reverse DFAs.
+   int metric = (options & MASK_METRIC) == SQ_HAMMING ? DFA_HAMMING :
+                (options & MASK_START) == SQ_FWDSTART ? DFA_STARTS : DFA_LEVENSHTEIN;
+   int precompile = (options & MASK_COMPILE) == SQ_PRECOMPILE;
+   int hugepages  = (options & MASK_PAGES) == SQ_HUGEPAGES;
+   int shared     = (options & MASK_SHARE) == SQ_SHARED;
+   int wlen = 0, tau = 0, k;
+   for (k = 0; k < npat; k++) {
+      pattern_t * p = pats->pat + k;
+      p->wlen  = seg[k].wlen;
+      p->tau   = seg[k].tau;
+      if (metric == DFA_LEVENSHTEIN) {
+         p->rkeys = malloc((size_t)p->wlen);
+         if (p->rkeys == NULL) break;
+         for (int i = 0; i < p->wlen; i++) p->rkeys[i] = keys[wlen+p->wlen-i-1];
+         p->rdfa = dfa_new(p->wlen, p->tau, INITIAL_DFA_SIZE, INITIAL_TRIE_SIZE, maxmemory);
+         if (p->rdfa == NULL) break;
+         if (hugepages) dfa_hugepages(p->rdfa);
+         if (precompile && dfa_precompile(&(p->rdfa), p->wlen, p->tau, p->rkeys) == -1) break;
+         // Shared DFAs do not evict states (see 'seeqNewOpt').
+         if (shared ? !p->rdfa->complete && dfa_share(p->rdfa) : dfa_evictable(p->rdfa)) break;
       }
+      wlen  += p->wlen;
+      tau    = p->tau > tau ? p->tau : tau;
+   }
 
-      // Accept matches again.
-      if (streak_dist >= current_dist) match = 0;
+   // Allocate DFA.
+   dfa_t * dfa = k < npat ? NULL :
+      dfa_newmulti(seg, (size_t)npat, metric, INITIAL_DFA_SIZE, INITIAL_TRIE_SIZE, maxmemory);
+   if (dfa != NULL && hugepages) dfa_hugepages(dfa);
+   if (dfa == NULL || (precompile && dfa_precompile(&dfa, wlen, tau, keys) == -1) ||
+       (shared ? !dfa->complete && dfa_share(dfa) : dfa_evictable(dfa)) ||
+       ((options & MASK_STRIDE) == SQ_STRIDE2 && dfa_stride(dfa))) {
+      free(keys); patset_free(pats);
+      if (dfa != NULL) dfa_free(dfa);
+      return NULL;
+   }
 
-      // Match accept condition:
-      // If there is overlap with the previous, accept only if new_dist < last_dist.
-      // 
-      // Note:
-      // set streak_dist <= current_dist to find all non-overlapping matches.
-      // (this may add extra mismatches to a perfect match though)
-      int perfect = streak_dist == 0;
-      int stop = streak_dist <= sq->tau && streak_dist < current_dist;
-      if ((perfect || stop) && !match && (!opt_best || streak_dist < best_d)) {
-         match = 1;
-         int j = 0;
-         uint32_t rnode = DFA_ROOT_STATE;
-         int d = sq->tau + 1;
-	      int last_d, ignores = 0;
-         // Find match start with RDFA.
-         do {
-//            int c = (int)translate[(int)data[i-++j]];
-            int c = (int)translate[(int)data[i - ++j]];
-	         last_d = d;
-            if (c < NBASES) {
-	            ignores = 0;
-               vertex_t * vertex = (vertex_t *) (((dfa_t *)sq->rdfa)->states + rnode * state_size);
-               uint32_t next = vertex->next[c];
-               if (next == DFA_COMPUTE)
-                  if (dfa_step(rnode, c, sq->wlen, sq->tau, (dfa_t **) &(sq->rdfa), sq->rkeys, &next)) return -1;
-               rnode = next;
-               vertex = (vertex_t *) (((dfa_t *)sq->rdfa)->states + rnode * state_size);
-               d = get_match(vertex->match);
-            } else {
-	            ignores++;
-	            continue;
-	         }
-           // Stop when hitting the low point.
-         } while (d > streak_dist && j < i);
-//         } while (d <= last_d && j <= i);
-	      j = (last_d < d ? j-1 : j) - ignores;
-         size_t match_start = i - j;
-         size_t match_end   = i;
-         int match_dist  = streak_dist;
-         match_t hit = (match_t) {match_start, match_end, (size_t) match_dist};
-         // Save non-overlapping matches.
-         if (opt_best) {
-            // Save match.
-            sq->hits = 1;
-            sq->match[0] = hit;
-            best_d = match_dist;
-         } else {
-            if (seeqAddMatch(sq,hit)) return -1;
-         }
-         // Break if done.
-         if (!all_match) end = 1;
-      }
+   // Create seeq object.
+   seeq_t * sq = malloc(sizeof(seeq_t));
+   if (sq == NULL) {
+      free(keys); patset_free(pats); dfa_free(dfa);
+      return NULL;
+   }
 
-      // Check end value.
-      if (end) break;
+   // Set seeq_t struct.
+   sq->tau    = tau;
+   sq->wlen   = wlen;
+   sq->keys   = keys;
+   sq->rkeys  = NULL;
+   sq->dfa    = (void *) dfa;
+   sq->rdfa   = NULL;
+   sq->ctx    = (seeq_ctx_t) {0};
+   sq->pats   = (void *) pats;
+   sq->bufsz  = 0;
+   sq->string = NULL;
+   sq->seeds  = NULL;
 
-      // Track distance and position of earliest min.
-      streak_dist = current_dist;
-   }
-   // Merge matches.
-   //if(recursive_merge(0, slen, 0, sq, mstack)) return -1;
-   // Free mstack.
-   //   for (int i = 0; i <= sq->tau; i++) free(mstack[i]);
-   //   free(mstack);
-   // Swap matches (to compensate for recursive_merge).
-   for (unsigned long j = 0; j < sq->hits/2; j++) {
-      match_t tmp = sq->match[j];
-      sq->match[j] = sq->match[sq->hits-j-1];
-      sq->match[sq->hits-j-1] = tmp;
+   // Initialize match_t stack.
+   sq->ctx.stacksize = INITIAL_MATCH_STACK_SIZE;
+   sq->ctx.match = malloc(sq->ctx.stacksize * sizeof(match_t));
+   if (sq->ctx.match == NULL) {
+      free(keys); patset_free(pats); dfa_free(dfa); free(sq);
+      return NULL;
    }
-   // Return.
-   return (long)sq->hits;
+
+   // The prefilter is optional, the text is matched whole without it.
+   sq->seeds = seed_new(keys, seg, npat);
+
+   return sq;
 }
 
 
-int
-recursive_merge
+seed_t *
+seed_new
 (
- size_t      start,
- size_t      end,
- int         tau,
- seeq_t    * sq,
- mstack_t ** stackp
+ const char      * keys,
+ const segment_t * seg,
+ int               npat
 )
+// SYNOPSIS:                                                              
+//   Creates the exact-seed prefilter of a set of patterns. Each pattern is
+//   split in tau+1 pieces, so that its matches contain one of them without
+//   errors (a substitution, insertion or deletion breaks one piece at most).
+//   The pieces of all the patterns are searched at once with a Shift-And
+//   automaton, each bit of the word is a position of a piece.
+//                                                                        
+// PARAMETERS:                                                            
+//   keys : concatenated keys of the patterns, as returned by parse.
+//   seg  : length and mismatch threshold of each pattern.
+//   npat : number of patterns.
+//
+// RETURN:                                                                
+//   Returns a pointer to a seed_t structure, or NULL if the pieces do not fit
+//   in the word with SEED_MIN_LEN bases (shorter pieces occur too often in
+//   the text) or in case of error.
+//
+// SIDE EFFECTS:
+//   The returned seed_t structure must be freed using 'free'.
 {
-   if (tau > sq->tau) return 0;
-   mstack_t   * stack = stackp[tau];
-   size_t next_start;
-   size_t next_end   = end;
-   
-   if (stack->pos > 0) {
-      // Remove upper overlaps.
-      match_t match = stack->match[stack->pos-1];
-      while (match.end > end && stack->pos > 0) match = stack->match[--stack->pos-1];
+   int npieces = 0;
+   for (int k = 0; k < npat; k++) npieces += seg[k].tau + 1;
+   if (npieces * SEED_MIN_LEN > 64) return NULL;
 
-      while (stack->pos > 0) {
-         match = stack->match[stack->pos-1];
-         if (start > match.start) break;
-         // Move match limits.
-         next_start =  match.end;
-         if (recursive_merge(next_start, next_end, tau+1, sq, stackp)) return -1;
-         next_end = match.start;
-         // We can safely insert without overlap.
-         stack->pos--;
-         if (seeqAddMatch(sq, match)) return -1;
+   seed_t * seeds = calloc(1, sizeof(seed_t));
+   if (seeds == NULL) return NULL;
+
+   int bit = 0;
+   for (int k = 0; k < npat; k++) {
+      // Pieces are evenly spaced, and shortened to share the word.
+      int step = seg[k].wlen / (seg[k].tau + 1);
+      int len  = step < 64 / npieces ? step : 64 / npieces;
+      if (len < SEED_MIN_LEN) {
+         free(seeds);
+         return NULL;
       }
+      for (int p = 0; p <= seg[k].tau; p++) {
+         const char * piece = keys + p * step;
+         seeds->first |= (uint64_t) 1 << bit;
+         for (int j = 0; j < len; j++, bit++) {
+            for (int c = 0; c < NBASES; c++)
+               if (piece[j] & (1 << c)) seeds->mask[c] |= (uint64_t) 1 << bit;
+         }
+         seeds->last |= (uint64_t) 1 << (bit - 1);
+      }
+      size_t span = (size_t) (seg[k].wlen + seg[k].tau);
+      if (span > seeds->span) seeds->span = span;
+      keys += seg[k].wlen;
    }
-   next_start = start;
-   if (recursive_merge(next_start, next_end, tau+1, sq, stackp)) return -1;
-   return 0;
+
+   return seeds;
 }
 
-mstack_t *
-stackNew
+comp_t *
+comp_new
 (
- size_t size
- )
-{
-   if (size < 1) size = 1;
-   mstack_t * stack = malloc(sizeof(mstack_t) + size * sizeof(match_t));
-   if (stack == NULL) return NULL;
-   stack->size = size;
-   stack->pos = 0;
-   return stack;
-}
-
-int
-stackAddMatch
-(
- mstack_t ** stackp,
- match_t    match
+ const seeq_t * sq
 )
+// SYNOPSIS:                                                              
+//   Creates the composition filter of the patterns of 'sq' (see SQ_COMPOSITION).
+//   A match at distance tau has at most tau bases less of each kind than its
+//   pattern in total (only substitutions and deletions remove bases), and it
+//   fits in a window of the length of the pattern plus tau. So a match can
+//   only end where the bases of the window that ends there lack tau bases of
+//   the pattern at most. Only the positions of the patterns with one base
+//   are counted.
+//                                                                        
+// PARAMETERS:                                                            
+//   sq : pointer to a seeq_t structure. (see 'seeqNew')
+//
+// RETURN:                                                                
+//   Returns a pointer to a comp_t structure, or NULL in case of error.
+//
+// SIDE EFFECTS:
+//   The returned comp_t structure must be freed using 'free'.
 {
-   mstack_t * stack = *stackp;
-   // Realloc stack
-   if (stack->pos >= stack->size) {
-      size_t newsize = stack->size * 2;
-      *stackp = stack = realloc(stack, sizeof(mstack_t) + newsize * sizeof(match_t));
-      if (stack == NULL) return -1;
-      stack->size = newsize;
+   patset_t * pats = (patset_t *) sq->pats;
+   int npat = pats == NULL ? 1 : pats->npat;
+   comp_t * comp = calloc(1, sizeof(comp_t) + (size_t)npat * sizeof(comppat_t));
+   if (comp == NULL) return NULL;
+   comp->npat = npat;
+
+   const char * keys = sq->keys;
+   for (int k = 0; k < npat; k++) {
+      int wlen = pats == NULL ? sq->wlen : pats->pat[k].wlen;
+      int tau  = pats == NULL ? sq->tau  : pats->pat[k].tau;
+      comp->pat[k].tau = tau;
+      for (int j = 0; j < wlen; j++) {
+         if      (keys[j] == 0x01) comp->pat[k].need[0]++;
+         else if (keys[j] == 0x02) comp->pat[k].need[1]++;
+         else if (keys[j] == 0x04) comp->pat[k].need[2]++;
+         else if (keys[j] == 0x08) comp->pat[k].need[3]++;
+      }
+      if ((size_t) (wlen + tau) > comp->span) comp->span = (size_t) (wlen + tau);
+      keys += wlen;
+   }
+   // The counts of the window have 16 bits, longer patterns are not filtered.
+   if (comp->span > 0xFFFF) {
+      for (int k = 0; k < npat; k++) memset(comp->pat[k].need, 0, sizeof(comp->pat[k].need));
    }
 
-   stack->match[stack->pos++] = match;
-   return 0;
+   return comp;
 }
 
-
-int
-seeqAddMatch
+void
+seeqFree
 (
- seeq_t  * sq,
- match_t   match
+ seeq_t * sq
 )
+// SYNOPSIS:                                                              
+//   Safely frees a seeq_t structure created with 'seeqNew'. This function must be used
+//   instead of 'free()', otherwise the references to the internal structures will be lost.
+//   Shared DFAs are freed with their last handle (see 'seeqClone').
+//                                                                        
+// PARAMETERS:                                                            
+//   sq       : pointer to the seeq_t structure.
+//
+// RETURN:                                                                
+//   void.
+//
+// SIDE EFFECTS:
+//   The memory pointed by sq will be freed.
 {
-   if (sq->hits >= sq->stacksize) {
-      size_t newsize = sq->stacksize > 0 ? sq->stacksize * 2 : 1;
-      sq->match = realloc(sq->match, newsize * sizeof(match_t));
-      if (sq->match == NULL) return -1;
-      sq->stacksize = newsize;
-   }
-
-   sq->match[sq->hits++] = match;
-   return 0;
+   // Free string if allocated.
+   if (sq->string != NULL) free(sq->string);
+   free(sq->ctx.codes);
+   free(sq->seeds);
+   free(sq->ctx.comp);
+   free(sq->ctx.row);
+   // Free keys and match stack.
+   free(sq->ctx.match);
+   free(sq->keys);
+   free(sq->rkeys);
+   // Free scratch and DFAs.
+   if (sq->ctx.cache != NULL)  scratch_free(sq->ctx.cache);
+   if (sq->ctx.rcache != NULL) scratch_free(sq->ctx.rcache);
+   dfa_release(sq->dfa);
+   // Pattern sets have a reverse DFA per pattern.
+   if (sq->pats != NULL) patset_free(sq->pats);
+   else if (sq->rdfa != NULL) dfa_release(sq->rdfa);
+   free(sq);
 }
 
 
-match_t *
-seeqMatchIter
+seeq_t *
+seeqClone
 (
  seeq_t * sq
 )
 // SYNOPSIS:                                                              
-//   Iteratively returns the matches found in the last search.
+//   Creates a new handle to match with the DFAs of 'sq'. Different handles
+//   of the same DFAs can be used concurrently from different threads. The
+//   states computed by any of them are available to all the others. The
+//   DFAs must have been created with the SQ_SHARED option, or be complete
+//   (see 'seeqNewOpt').
 //                                                                        
 // PARAMETERS:                                                            
-//   sq: a seeq_t struct created with 'seeqNew()'.
+//   sq       : pointer to a seeq_t structure. (see 'seeqNew')
 //
 // RETURN:                                                                
-//   A pointer to the match_t structure or NULL when sq is empty.
+//   Returns a pointer to a seeq_t structure or NULL in case of error, and seeqerr is
+//   set appropriately.
 //
 // SIDE EFFECTS:
-//   Decrements `sq->hits` on every call.
+//   The returned seeq_t structure must be freed using 'seeqFree'.
 {
-   if (sq->hits == 0) return NULL;
-   return sq->match + --sq->hits;
+   // Set error to 0.
+   seeqerr = 0;
+
+   if (sq->pats != NULL) {
+      seeqerr = 15;
+      return NULL;
+   }
+
+   // Hamming and DFA_STARTS DFAs have no reverse DFA.
+   dfa_t * dfa  = (dfa_t *) sq->dfa;
+   dfa_t * rdfa = (dfa_t *) sq->rdfa;
+   if (!(dfa->shared || dfa->complete) || (rdfa != NULL && !(rdfa->shared || rdfa->complete))) {
+      seeqerr = 14;
+      return NULL;
+   }
+
+   seeq_t * clone = calloc(1, sizeof(seeq_t));
+   if (clone == NULL) return NULL;
+
+   clone->tau   = sq->tau;
+   clone->wlen  = sq->wlen;
+   clone->keys  = malloc((size_t) sq->wlen);
+   clone->rkeys = malloc((size_t) sq->wlen);
+   clone->ctx.stacksize = INITIAL_MATCH_STACK_SIZE;
+   clone->ctx.match = malloc(clone->ctx.stacksize * sizeof(match_t));
+   // Complete DFAs never use the scratch.
+   if (!dfa->complete)  clone->ctx.cache  = scratch_new((int) dfa->trie->height);
+   if (rdfa != NULL && !rdfa->complete) clone->ctx.rcache = scratch_new((int) rdfa->trie->height);
+   if (clone->keys == NULL || clone->rkeys == NULL || clone->ctx.match == NULL ||
+       (!dfa->complete && clone->ctx.cache == NULL) || (rdfa != NULL && !rdfa->complete && clone->ctx.rcache == NULL)) {
+      free(clone->keys); free(clone->rkeys); free(clone->ctx.match);
+      if (clone->ctx.cache != NULL)  scratch_free(clone->ctx.cache);
+      if (clone->ctx.rcache != NULL) scratch_free(clone->ctx.rcache);
+      free(clone);
+      return NULL;
+   }
+   memcpy(clone->keys, sq->keys, (size_t) sq->wlen);
+   memcpy(clone->rkeys, sq->rkeys, (size_t) sq->wlen);
+   segment_t seg = {sq->wlen, sq->tau};
+   clone->seeds = seed_new(clone->keys, &seg, 1);
+
+   // Share DFAs.
+   __atomic_add_fetch(&dfa->refs, 1, __ATOMIC_RELAXED);
+   if (rdfa != NULL) __atomic_add_fetch(&rdfa->refs, 1, __ATOMIC_RELAXED);
+   clone->dfa  = dfa;
+   clone->rdfa = rdfa;
+
+   return clone;
 }
 
-char *
-seeqGetString
+
+seeq_ctx_t *
+seeqCtxNew
 (
- seeq_t * sq
+ const seeq_t * sq
 )
 // SYNOPSIS:                                                              
-//   Returns a pointer to the last matched line.
+//   Creates a matching context for 'sq' (see 'seeqCtxMatchN'). The context
+//   holds the matches, the translated text, the rows of pattern sets and the
+//   construction scratch of the calls, so that many threads can match with
+//   the same seeq_t without copying it (see 'seeqClone'), each with its own
+//   context. The DFAs must have been created with the SQ_SHARED option, or
+//   be complete (see 'seeqNewOpt' and 'seeqNewMultiOpt').
 //                                                                        
 // PARAMETERS:                                                            
-//   sq: a seeq_t struct created with 'seeqNew()'.
+//   sq       : pointer to a seeq_t structure. (see 'seeqNew')
 //
 // RETURN:                                                                
-//   Returns a pointer to the last matched line. The contents of the pointer will be
-//   modified if the passed structure is used to match again.
+//   Returns a pointer to a seeq_ctx_t structure or NULL in case of error, and
+//   seeqerr is set appropriately.
 //
 // SIDE EFFECTS:
-//   None.
+//   The returned seeq_ctx_t structure must be freed using 'seeqCtxFree',
+//   before 'sq' is freed.
 {
-   return sq->string;
+   // Set error to 0.
+   seeqerr = 0;
+
+   dfa_t * dfa  = (dfa_t *) sq->dfa;
+   dfa_t * rdfa = (dfa_t *) sq->rdfa;
+   if (!(dfa->shared || dfa->complete) || (rdfa != NULL && !(rdfa->shared || rdfa->complete))) {
+      seeqerr = 14;
+      return NULL;
+   }
+
+   // The patterns of a pattern set have their own reverse DFA. They are
+   // used one at a time, with the scratch of the longest one.
+   patset_t * pats = (patset_t *) sq->pats;
+   int rlen = 0;
+   for (int k = 0; pats != NULL && k < pats->npat; k++) {
+      dfa_t * p = pats->pat[k].rdfa;
+      if (p == NULL || p->complete) continue;
+      if (!p->shared) {
+         seeqerr = 14;
+         return NULL;
+      }
+      if ((int) p->trie->height > rlen) rlen = (int) p->trie->height;
+   }
+   if (rdfa != NULL && !rdfa->complete) rlen = (int) rdfa->trie->height;
+
+   seeq_ctx_t * ctx = calloc(1, sizeof(seeq_ctx_t));
+   if (ctx == NULL) return NULL;
+
+   ctx->stacksize = INITIAL_MATCH_STACK_SIZE;
+   ctx->match = malloc(ctx->stacksize * sizeof(match_t));
+   // Complete DFAs never use the scratch.
+   if (!dfa->complete) ctx->cache  = scratch_new((int) dfa->trie->height);
+   if (rlen > 0)       ctx->rcache = scratch_new(rlen);
+   if (ctx->match == NULL || (!dfa->complete && ctx->cache == NULL) || (rlen > 0 && ctx->rcache == NULL)) {
+      seeqCtxFree(ctx);
+      return NULL;
+   }
+
+   return ctx;
 }
 
-const char *
-seeqPrintError
+
+void
+seeqCtxFree
 (
- void
+ seeq_ctx_t * ctx
 )
 // SYNOPSIS:                                                              
-//   Returns a description of the error produced in the last call to a libseeq function.
+//   Frees a matching context created with 'seeqCtxNew'.
 //                                                                        
 // PARAMETERS:                                                            
-//   None.
+//   ctx      : pointer to the seeq_ctx_t structure, or NULL.
 //
 // RETURN:                                                                
-//   A string with the error description.
+//   void.
 //
 // SIDE EFFECTS:
-//   None.
+//   The memory pointed by ctx will be freed.
 {
-   if (seeqerr == 0) return strerror(errno);
-   else return seeq_strerror[seeqerr];
+   if (ctx == NULL) return;
+   free(ctx->match);
+   free(ctx->codes);
+   free(ctx->comp);
+   free(ctx->row);
+   if (ctx->cache != NULL)  scratch_free(ctx->cache);
+   if (ctx->rcache != NULL) scratch_free(ctx->rcache);
+   free(ctx);
 }
 
- 
-
 int
-parse
+seeqSave
 (
- const char * expr,
-       char * keys
+ seeq_t     * sq,
+ const char * filename
 )
 // SYNOPSIS:                                                              
-//   Parses a pattern expression converting them into bytes, one for each
-//   matching position. The key byte is defined as follows:
-//
-//      bit0 (LSB): match 'A' or 'a'.
-//      bit1      : match 'C' or 'c'.
-//      bit2      : match 'G' or 'g'.
-//      bit3      : match 'T', 't', 'U' or 'u'.
-//      bit4      : match 'N' or 'n'.
-//      bit5..7   : not used.
-//
-//   Each key may have one or more bits set if different bases are allowed
-//   to match a single position. The expected input expression is a string
-//   containing nucleotides 'A','C','G','T','U' and 'N'. If one matching
-//   position allows more than one base, the matching bases must be enclosed
-//   in square brackets '[' ']'. For instance,
-//
-//      AC[AT]
-//
-//   would match a sequence containing A in the 1st position, C in the 2nd
-//   position and either A or T in the 3rd position. The associated keys
-//   would be
-//
-//      keys("AC[AT]") = {0x01, 0x02, 0x09}
-//
-//   If the expression contains 'N', that position will match any nucleotide,
-//   including 'N'.
+//   Saves the pattern and the DFAs of 'sq' to a file, so that they can be
+//   loaded with 'seeqLoad' without recomputing the DFA states. The file is
+//   first written to a temporary file and then renamed, so other processes
+//   never read a partially written file.
 //                                                                        
 // PARAMETERS:                                                            
-//   expr: A null-terminated string containing the matching expression.
-//   keys: pointer to a previously allocated vector of chars. The size of the
-//         allocated region should be equal to strlen(expr).
-//                                                                        
+//   sq       : pointer to a seeq_t structure. (see 'seeqNew')
+//   filename : path of the DFA file.
+//
 // RETURN:                                                                
-//   On success, parse returns the number of matching positions (keys) for the
-//   given expression, or -1 if an error occurred.
+//   Returns 0 on success or -1 in case of error, and seeqerr is set
+//   appropriately.
 //
 // SIDE EFFECTS:
-//   The contents of the pointer 'keys' are overwritten.
+//   The file 'filename' is created or replaced.
 {
    // Set error to 0.
    seeqerr = 0;
-   // Initialize keys to 0.
-   const int lmax = strlen(expr);
-   for (int l = 0; l < lmax; l++) keys[l] = 0;
 
-   int i = 0;
-   int l = 0;
-   int add = 0;
-   char c, lc = 0;
-   while((c = expr[i]) != 0 && l < lmax) {
-      if      (c == 'A' || c == 'a') keys[l] |= 0x01;
-      else if (c == 'C' || c == 'c') keys[l] |= 0x02;
-      else if (c == 'G' || c == 'g') keys[l] |= 0x04;
-      else if (c == 'T' || c == 't' || c == 'U' || c == 'u') keys[l] |= 0x08;
-      else if (c == 'N' || c == 'n') keys[l] |= 0x1F;
-      else if (c == '[') {
-         if (add) {
-            seeqerr = 2;
-            return -1;
-         }
-         add = 1;
+   if (sq->pats != NULL) {
+      seeqerr = 15;
+      return -1;
+   }
+
+   // Only the Levenshtein DFAs have a reverse DFA.
+   dfa_t * dfas[2] = {(dfa_t *) sq->dfa, (dfa_t *) sq->rdfa};
+   const uint32_t direction[2] = {DFA_FORWARD, DFA_REVERSE};
+   const int ndfa = sq->rdfa != NULL ? 2 : 1;
+
+   // Compute file layout.
+   dfahdr_t hdr;
+   dfasec_t sec[2];
+   memset(&hdr, 0, sizeof(dfahdr_t));
+   memset(sec, 0, 2*sizeof(dfasec_t));
+   memcpy(hdr.magic, DFA_FILE_MAGIC, sizeof(DFA_FILE_MAGIC));
+   hdr.version   = DFA_FILE_VERSION;
+   hdr.byteorder = DFA_FILE_BYTEORDER;
+   hdr.wlen      = (uint32_t) sq->wlen;
+   hdr.tau       = (uint32_t) sq->tau;
+   hdr.ndfa      = (uint32_t) ndfa;
+   hdr.metric    = (uint32_t) ((dfa_t *) sq->dfa)->metric;
+
+#define file_align(a) (((a) + DFA_FILE_ALIGN - 1) / DFA_FILE_ALIGN * DFA_FILE_ALIGN)
+   uint64_t offset = file_align(sizeof(dfahdr_t) + (size_t) ndfa * sizeof(dfasec_t));
+   hdr.keys = offset;
+   offset = file_align(offset + (uint64_t) sq->wlen);
+   for (int d = 0; d < ndfa; d++) {
+      sec[d].direction  = direction[d];
+      sec[d].complete   = (uint32_t) dfas[d]->complete;
+      sec[d].state_size = dfas[d]->state_size;
+      sec[d].code_size  = dfas[d]->code_size;
+      sec[d].nstates    = dfas[d]->pos;
+      sec[d].states     = offset;
+      offset = file_align(offset + dfas[d]->pos * dfas[d]->state_size);
+      sec[d].codes      = offset;
+      offset = file_align(offset + dfas[d]->pos * dfas[d]->code_size);
+      sec[d].nnodes     = dfas[d]->trie->pos;
+      sec[d].height     = dfas[d]->trie->height;
+      sec[d].nodes      = offset;
+      offset = file_align(offset + dfas[d]->trie->pos * sizeof(node_t));
+   }
+   hdr.size = offset;
+   hdr.checksum = dfa_checksum(&hdr, sec);
+#undef file_align
+
+   // Write to temporary file.
+   char * tmpname = malloc(strlen(filename) + 32);
+   if (tmpname == NULL) return -1;
+   sprintf(tmpname, "%s.%ld.tmp", filename, (long) getpid());
+
+   FILE * f = fopen(tmpname, "wb");
+   if (f == NULL) {
+      free(tmpname);
+      return -1;
+   }
+
+   int err = fwrite(&hdr, sizeof(dfahdr_t), 1, f) != 1 ||
+             fwrite(sec, sizeof(dfasec_t), (size_t) ndfa, f) != (size_t) ndfa ||
+             fseek(f, (long) hdr.keys, SEEK_SET) ||
+             fwrite(sq->keys, 1, (size_t) sq->wlen, f) != (size_t) sq->wlen;
+   // The states and the nodes are written by slabs (see 'dfa_grow').
+   for (int d = 0; d < ndfa && !err; d++) {
+      dfa_t * dfa = dfas[d];
+      err = fseek(f, (long) sec[d].states, SEEK_SET);
+      for (size_t i = 0; i < dfa->pos && !err; i += DFA_SLAB_STATES) {
+         size_t n = min(dfa->pos - i, DFA_SLAB_STATES);
+         err = fwrite(state_vertex(dfa, i), dfa->state_size, n, f) != n;
       }
-      else if (c == ']') {
-         if (!add) {
-            seeqerr = 3;
-            return -1;
-         }
-         if (lc == '[') l--;
-         add = 0;
+      err = err || fseek(f, (long) sec[d].codes, SEEK_SET);
+      for (size_t i = 0; i < dfa->pos && !err; i += DFA_SLAB_STATES) {
+         size_t n = min(dfa->pos - i, DFA_SLAB_STATES);
+         err = fwrite(state_code(dfa, i), dfa->code_size, n, f) != n;
       }
-      else {
-         seeqerr = 4;
-         return -1;
+      err = err || fseek(f, (long) sec[d].nodes, SEEK_SET);
+      for (size_t i = 0; i < dfa->trie->pos && !err; i += TRIE_SLAB_NODES) {
+         size_t n = min(dfa->trie->pos - i, TRIE_SLAB_NODES);
+         err = fwrite(trie_node(dfa->trie, i), sizeof(node_t), n, f) != n;
       }
-
-      if (!add) l++;
-      i++;
-      lc = c;
    }
-   
-   if (add == 1) {
-      seeqerr = 5;
+   // Pad the last section.
+   if (!err) err = fflush(f) || ftruncate(fileno(f), (off_t) hdr.size);
+   if (fclose(f)) err = 1;
+
+   // Replace the DFA file.
+   if (err || rename(tmpname, filename)) {
+      unlink(tmpname);
+      free(tmpname);
       return -1;
    }
-   else return l;
+
+   free(tmpname);
+   return 0;
 }
 
 
-dfa_t *
-dfa_new
+seeq_t *
+seeqLoad
 (
- int wlen,
- int tau,
- size_t vertices,
- size_t trienodes,
- size_t maxmemory
+ const char * filename,
+ size_t       maxmemory
 )
 // SYNOPSIS:                                                              
-//   Creates and initializes a new dfa graph with a cache and a root vertices and the
-//   specified number of preallocated (empty) vertices. Initializes a trie of height wlen
-//   to store the alignment rows. The DFA network is initialized with the first
-//   NW-alignment row: [0 1 2 ... tau tau+1 tau+1 ... tau+1]. States 0 and 1 are the
-//   cache and root states, respectively.
+//   Creates a new seeq_t structure from a DFA file written by 'seeqSave'.
+//   The file is mapped in memory (read-only), so loading is fast and the
+//   pages are shared among all the processes that load the same file.
+//   Complete DFAs (see 'seeqNewOpt') are used directly from the file mapping.
+//   Otherwise the DFA states are copied to memory, where they keep growing.
 //                                                                        
 // PARAMETERS:                                                            
-//   wlen: length of the pattern as regurned by 'parse'.
-//   tau: mismatch threshold.
-//   vertices: the number of preallocated vertices.
-//   trienodes: initial size of the trie.
-//   maxmemory: DFA memory limit, in bytes.
+//   filename  : path of the DFA file.
+//   maxmemory : DFA memory limit, in bytes.
+//
+// RETURN:                                                                
+//   Returns a pointer to a seeq_t structure or NULL in case of error, and seeqerr is
+//   set appropriately.
+//
+// SIDE EFFECTS:
+//   The returned seeq_t structure must be freed using 'seeqFree'.
+{
+   return seeqLoadOpt(filename, maxmemory, SQ_PRIVATE);
+}
+
+
+seeq_t *
+seeqLoadOpt
+(
+ const char * filename,
+ size_t       maxmemory,
+ int          options
+)
+// SYNOPSIS:                                                              
+//   Same as 'seeqLoad', with the sharing and stride options of 'seeqNewOpt'.
+//   The other options are the ones of the saved DFAs. The header, the
+//   section bounds and the checksum are always checked, and the sections
+//   of incomplete DFAs when they are copied. The sections of complete DFAs
+//   are only read as they are used, unless SQ_VERIFY is set: they are then
+//   checked on load, which reads the whole mapping (see 'dfa_check').
 //                                                                        
+// PARAMETERS:                                                            
+//   filename  : path of the DFA file.
+//   maxmemory : DFA memory limit, in bytes.
+//   options   : SQ_PRIVATE or SQ_SHARED, SQ_STRIDE1 or SQ_STRIDE2, and
+//               SQ_NOVERIFY or SQ_VERIFY.
+//
 // RETURN:                                                                
-//   On success, the function returns a pointer to the new dfa_t structure.
-//   A NULL pointer is returned in case of error.
+//   Returns a pointer to a seeq_t structure or NULL in case of error, and seeqerr is
+//   set appropriately.
 //
 // SIDE EFFECTS:
-//   The returned dfa_t struct is allocated using malloc and must be manually freed.
+//   The returned seeq_t structure must be freed using 'seeqFree'.
 {
    // Set error to 0.
    seeqerr = 0;
 
-   if (vertices < 2) vertices = 2;
-   if (wlen < 1 || tau < 0) return NULL;
-
-   size_t align_size = (size_t)wlen/5 + (wlen%5 > 0);
-   size_t state_size = align_size + sizeof(vertex_t);
+   int fd = open(filename, O_RDONLY);
+   if (fd < 0) return NULL;
 
-   // Allocate DFA.
-   dfa_t * dfa = malloc(sizeof(dfa_t) + vertices * state_size);
-   if (dfa == NULL) {
+   struct stat st;
+   if (fstat(fd, &st)) {
+      close(fd);
       return NULL;
    }
+   size_t fsize = (size_t) st.st_size;
 
-   // Fill struct.
-   dfa->size = vertices;
-   dfa->pos  = 2;
-   dfa->maxmemory = maxmemory;
-   dfa->state_size = state_size;
-   dfa->align_cache = calloc((size_t)(wlen + 1),sizeof(int));
-   dfa->trie = trie_new(trienodes, (size_t)wlen);
+   // Read and check header.
+   dfahdr_t hdr;
+   dfasec_t sec[2];
+   if (pread(fd, &hdr, sizeof(dfahdr_t), 0) != sizeof(dfahdr_t) ||
+       memcmp(hdr.magic, DFA_FILE_MAGIC, sizeof(DFA_FILE_MAGIC)) ||
+       hdr.version != DFA_FILE_VERSION ||
+       hdr.byteorder != DFA_FILE_BYTEORDER ||
+       hdr.ndfa != (hdr.metric == DFA_LEVENSHTEIN ? 2u : 1u)) {
+      seeqerr = 12;
+      close(fd);
+      return NULL;
+   }
 
-   if (dfa->trie == NULL) {
-      free(dfa);
+   int wlen = (int) hdr.wlen;
+   int ndfa = (int) hdr.ndfa;
+   uint64_t height = hdr.wlen;
+   if (hdr.metric == DFA_HAMMING && hdr.tau < hdr.wlen) height *= (uint64_t) ham_width((int) hdr.tau);
+   if (hdr.metric == DFA_STARTS && hdr.tau < hdr.wlen) height *= (uint64_t) start_width((int) hdr.tau);
+   if (hdr.size != fsize || wlen < 1 || hdr.tau >= hdr.wlen || hdr.metric > DFA_STARTS ||
+       hdr.keys > fsize || fsize - hdr.keys < hdr.wlen ||
+       pread(fd, sec, (size_t) ndfa * sizeof(dfasec_t), sizeof(dfahdr_t)) != (ssize_t) ((size_t) ndfa * sizeof(dfasec_t)) ||
+       hdr.checksum != dfa_checksum(&hdr, sec) ||
+       sec[0].direction != DFA_FORWARD || sec[0].height != height ||
+       (ndfa == 2 && (sec[1].direction != DFA_REVERSE || sec[1].height != height))) {
+      seeqerr = 13;
+      close(fd);
       return NULL;
    }
 
-   // Initialize state 0 (cache) and state 1 (root).
-   vertex_t * s0 = (vertex_t *) (dfa->states);
-   vertex_t * s1 = (vertex_t *) (dfa->states + state_size);
-   s0->match = s1->match = set_mintomatch(wlen-tau) | ((uint32_t) tau+1);
-   for (int i = 0; i < NBASES; i++) {
-      s0->next[i] = DFA_COMPUTE;
-      s1->next[i] = DFA_COMPUTE;
+   // Read keys.
+   char * keys  = malloc((size_t) wlen);
+   char * rkeys = malloc((size_t) wlen);
+   if (keys == NULL || rkeys == NULL) {
+      free(keys); free(rkeys);
+      close(fd);
+      return NULL;
+   }
+   if (pread(fd, keys, (size_t) wlen, (off_t) hdr.keys) != wlen) {
+      seeqerr = 13;
+      free(keys); free(rkeys);
+      close(fd);
+      return NULL;
    }
+   for (int i = 0; i < wlen; i++) rkeys[i] = keys[wlen-i-1];
 
-   // Allocate memory for path and its encoded version.
-   uint8_t * path = malloc((size_t)wlen);
-   if (path == NULL || dfa->align_cache == NULL) {
-      free(path); free(dfa->trie); free(dfa);
+   // Map DFAs.
+   int verify = (options & MASK_VERIFY) == SQ_VERIFY;
+   dfa_t * dfa  = dfa_map(fd, fsize, sec, maxmemory, verify);
+   dfa_t * rdfa = dfa == NULL || ndfa < 2 ? NULL : dfa_map(fd, fsize, sec + 1, maxmemory, verify);
+   close(fd);
+   if (dfa == NULL || (ndfa == 2 && rdfa == NULL)) {
+      free(keys); free(rkeys);
+      dfa_free(dfa);
+      return NULL;
+   }
+   dfa->metric = (int) hdr.metric;
+   if (rdfa != NULL) rdfa->metric = (int) hdr.metric;
+   // Same as 'seeqNewOpt'.
+   if ((options & MASK_SHARE) == SQ_SHARED) {
+      if ((!dfa->complete && dfa_share(dfa)) || (rdfa != NULL && !rdfa->complete && dfa_share(rdfa))) {
+         free(keys); free(rkeys); dfa_free(dfa); dfa_free(rdfa);
+         return NULL;
+      }
+   } else if (dfa_evictable(dfa) || (rdfa != NULL && dfa_evictable(rdfa))) {
+      free(keys); free(rkeys); dfa_free(dfa); dfa_free(rdfa);
+      return NULL;
+   }
+   if ((options & MASK_STRIDE) == SQ_STRIDE2 && dfa_stride(dfa)) {
+      free(keys); free(rkeys); dfa_free(dfa); dfa_free(rdfa);
       return NULL;
    }
 
-   // Compute initial alignment.
-   for (int i = 0; i <= tau; i++) path[i] = 2;
-   for (int i = tau + 1; i < wlen; i++) path[i] = 1;
+   // Create seeq object.
+   seeq_t * sq = malloc(sizeof(seeq_t));
+   if (sq == NULL) {
+      free(keys); free(rkeys); dfa_free(dfa); dfa_free(rdfa);
+      return NULL;
+   }
 
-   // Compute differential code of the path.
-   path_encode(path,s1->code,(size_t)wlen);
+   // Set seeq_t struct.
+   sq->tau    = (int) hdr.tau;
+   sq->wlen   = wlen;
+   sq->keys   = keys;
+   sq->rkeys  = rkeys;
+   sq->dfa    = (void *) dfa;
+   sq->rdfa   = (void *) rdfa;
+   sq->ctx    = (seeq_ctx_t) {0};
+   sq->pats   = NULL;
+   sq->bufsz  = 0;
+   sq->string = NULL;
+   sq->seeds  = NULL;
 
-   // Insert initial state into trie.
-   if (trie_insert(dfa, path, 1)) {
-      free(path); free(dfa->trie); free(dfa);
+   // Initialize match_t stack.
+   sq->ctx.stacksize = INITIAL_MATCH_STACK_SIZE;
+   sq->ctx.match = malloc(sq->ctx.stacksize * sizeof(match_t));
+   if (sq->ctx.match == NULL) {
+      free(keys); free(rkeys); dfa_free(dfa); dfa_free(rdfa); free(sq);
       return NULL;
    }
-   free(path);
 
-   return dfa;
-}
+   // The prefilter is optional, the text is matched whole without it.
+   segment_t seg = {wlen, (int) hdr.tau};
+   sq->seeds = seed_new(keys, &seg, 1);
+
+   return sq;
+}
+
+
+
+__attribute__((always_inline))
+static inline size_t
+seed_next
+(
+ const seed_t * seeds,
+ const text_t * text,
+ size_t         from,
+ size_t         end,
+ uint64_t     * reg,
+ const int      packed
+)
+// SYNOPSIS:                                                              
+//   Finds the next occurrence of a piece of the exact-seed prefilter (see
+//   'seed_new'). The state of the Shift-And automaton is kept between calls,
+//   so that the text is read once.
+//                                                                        
+// PARAMETERS:                                                            
+//   seeds  : prefilter of the patterns.
+//   text   : text to match, with bases only (codes lower than 5).
+//   from   : position where the search resumes.
+//   end    : end of the search.
+//   reg    : state of the automaton.
+//   packed : 1 if the text is 2-bit packed, 0 otherwise.
+//             
+// RETURN:                                                                
+//   Returns the position of the last base of the occurrence, or 'end' if
+//   there are no more.
+//
+// SIDE EFFECTS:
+//   The state of the automaton is updated.
+{
+   uint64_t d = *reg;
+   for (size_t i = from; i < end; i++) {
+      int c = packed ? text_code(text, i) : text->codes[i];
+      d = ((d << 1) | seeds->first) & seeds->mask[c];
+      if (d & seeds->last) {
+         *reg = d;
+         return i;
+      }
+   }
+   *reg = d;
+   return end;
+}
+
+
+__attribute__((noinline))
+static size_t
+comp_next
+(
+ comp_t       * comp,
+ const text_t * text,
+ size_t         from,
+ size_t         end,
+ const int      packed
+)
+// SYNOPSIS:                                                              
+//   Finds the next position where a match can end with the composition
+//   filter (see 'comp_new'). The window is slid from the last position
+//   checked, or counted anew if it is too far behind.
+//                                                                        
+// PARAMETERS:                                                            
+//   comp   : composition filter of the patterns.
+//   text   : text to match, with bases only (codes lower than 5).
+//   from   : first position to check.
+//   end    : end of the search.
+//   packed : 1 if the text is 2-bit packed, 0 otherwise.
+//             
+// RETURN:                                                                
+//   Returns the position of the last base of the match, or 'end' if no
+//   match can end before it.
+//
+// SIDE EFFECTS:
+//   The window of the filter is updated.
+{
+   static const uint64_t one[NBASES] = {1, (uint64_t)1 << 16, (uint64_t)1 << 32, (uint64_t)1 << 48, 0};
+   const size_t span = comp->span;
+   const int    npat = comp->npat;
+   const comppat_t * pat = comp->pat;
+   uint64_t count = comp->count;
+   size_t lo = comp->lo, hi = comp->hi;
+   if (hi == 0 || hi > from + 1 || from + 1 - hi > span) {
+      count = 0;
+      lo = hi = from + 1 > span ? from + 1 - span : 0;
+   }
+   // Slide the window to the first position.
+   for (; hi < from; hi++) {
+      count += one[packed ? text_code(text, hi) : text->codes[hi]];
+      if (hi - lo == span) count -= one[packed ? text_code(text, lo++) : text->codes[lo++]];
+   }
+   size_t e;
+   for (e = from; e < end; e++, hi++) {
+      count += one[packed ? text_code(text, hi) : text->codes[hi]];
+      if (hi - lo == span) count -= one[packed ? text_code(text, lo++) : text->codes[lo++]];
+      int pass = 0, k = 0;
+      do {
+         int lack = 0;
+         for (int b = 0; b < 4; b++) {
+            int n = (int) ((count >> (16*b)) & 0xFFFF);
+            lack += pat[k].need[b] > n ? pat[k].need[b] - n : 0;
+         }
+         pass = lack <= pat[k].tau;
+      } while (!pass && ++k < npat);
+      if (pass) {
+         hi++;
+         break;
+      }
+   }
+   comp->count = count;
+   comp->lo = lo;
+   comp->hi = hi;
+   return e;
+}
+
+
+__attribute__((always_inline))
+static inline size_t
+filter_next
+(
+ filter_t     * filter,
+ const text_t * text,
+ size_t         from,
+ size_t         nbases,
+ size_t       * last,
+ const int      packed
+)
+// SYNOPSIS:                                                              
+//   Finds the next position where a match can end. The matches end at most
+//   'span' bases after an occurrence of a piece of the exact-seed prefilter
+//   (see 'seed_new'), and where the composition filter allows it (see
+//   'comp_new').
+//                                                                        
+// PARAMETERS:                                                            
+//   filter : prefilters of the patterns.
+//   text   : text to match, with bases only (codes lower than 5).
+//   from   : first position to check.
+//   nbases : end of the search.
+//   last   : the last position of the run of allowed match ends.
+//   packed : 1 if the text is 2-bit packed, 0 otherwise.
+//             
+// RETURN:                                                                
+//   Returns the position of the last base of the match, or 'nbases' if
+//   no more matches can end.
+//
+// SIDE EFFECTS:
+//   The state of the prefilters and the statistics are updated.
+{
+   while (from < nbases) {
+      size_t hi = nbases;
+      if (filter->seeds != NULL) {
+         if (from >= filter->hi) {
+            size_t hit = seed_next(filter->seeds, text, filter->pos, nbases, &filter->reg, packed);
+            if (hit == nbases) return nbases;
+            filter->pos = hit + 1;
+            filter->lo  = hit;
+            filter->hi  = hit + filter->span;
+            continue;
+         }
+         if (from < filter->lo) from = filter->lo;
+         if (filter->hi < hi) hi = filter->hi;
+      }
+      if (filter->comp == NULL) {
+         *last = hi - 1;
+         return from;
+      }
+      size_t e = comp_next(filter->comp, text, from, hi, packed);
+      filter->stats->checked  += e < hi ? e - from + 1 : hi - from;
+      filter->stats->excluded += e - from;
+      if (e < hi) {
+         *last = e;
+         return e;
+      }
+      from = hi;
+   }
+   return nbases;
+}
+
+
+__attribute__((always_inline))
+static inline int64_t
+text_scan
+(
+ const dfa_t   * dfa,
+ const text_t  * text,
+ int64_t         i,
+ int64_t         end,
+ int64_t         slen,
+ int             tau,
+ uint8_t       * used,
+ uint32_t      * state,
+ const int       narrow,
+ const int       shared,
+ const int       packed
+)
+// SYNOPSIS:                                                              
+//   Reads the text with the DFA while no match can end, for 'text_match'.
+//   The loop is inlined once per vertex width and sharing mode, so that
+//   neither is tested at each base. It stops before a character that is
+//   not a base, a transition that is not computed, a state whose distance
+//   is tau or less, or whose min-to-match is longer than the rest of the
+//   text, and the state 0 of shared DFAs (see 'seeqClone').
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa    : DFA of the patterns.
+//   text   : text to match.
+//   i      : position of the next base.
+//   end    : position where the scan stops.
+//   slen   : length of the text.
+//   tau    : distance threshold.
+//   used   : 'used' flags of the states, or NULL (see 'dfa_evict').
+//   state  : DFA state before 'i', replaced by the state where the scan
+//            stops. Its distance must be larger than tau.
+//   narrow : 1 if the DFA has narrow vertices (see 'vertex16_t').
+//   shared : 1 if the DFA is shared (see 'dfa_share').
+//   packed : 1 if the text is 2-bit packed, 0 otherwise.
+//             
+// RETURN:                                                                
+//   Returns the position of the first base that was not read.
+//
+// SIDE EFFECTS:
+//   The 'used' flags of the states are set.
+{
+   // Narrow DFAs have less states than the first slab (see 'dfa_reserve').
+   const uint8_t * states = dfa->states;
+   const size_t    nflat  = dfa->nflat;
+   uint32_t s = *state;
+   for (; i < end; i++) {
+      int c = packed ? text_code(text, (size_t)i) : text->codes[i];
+      if (c >= NBASES) break;
+      uint32_t next, match;
+      if (narrow) {
+         next = ((const vertex16_t *) (states + (size_t)s * DFA_NARROW_SIZE))->next[c];
+         if (next == DFA_NARROW_COMPUTE) break;
+         uint16_t m = ((const vertex16_t *) (states + (size_t)next * DFA_NARROW_SIZE))->match;
+         if (m == DFA_NARROW_COMPUTE) break;
+         match = set_mintomatch(m >> 8) | (m & 0xFF);
+      } else {
+         const vertex_t * v = (const vertex_t *) slab_vertex(dfa, states, nflat, DFA_STATE_SIZE, s);
+         next = shared ? __atomic_load_n(v->next + c, __ATOMIC_ACQUIRE) : v->next[c];
+         if (next == DFA_COMPUTE || (shared && next == 0)) break;
+         match = ((const vertex_t *) slab_vertex(dfa, states, nflat, DFA_STATE_SIZE, next))->match;
+      }
+      if (get_match(match) <= tau || slen - i - 1 < get_mintomatch(match)) break;
+      if (used != NULL) used[next] = 1;
+      s = next;
+   }
+   *state = s;
+   return i;
+}
+
+
+__attribute__((always_inline))
+static inline long
+text_match
+(
+ const seeq_t * sq,
+ seeq_ctx_t   * ctx,
+ const text_t * text,
+ int64_t        slen,
+ size_t         nbases,
+ int64_t        from,
+ uint32_t       state,
+ int            options,
+ const int      packed
+)
+// SYNOPSIS:                                                              
+//   Matching loop of 'seeqStringMatch' and 'seeqPackedMatch'. It is inlined
+//   in both, so that the codes of strings are read without the test for
+//   packed bases.
+//                                                                        
+// PARAMETERS:                                                            
+//   sq      : pointer to a seeq_t structure. (see 'seeqNew')
+//   ctx     : matching context, where the matches are stored (see 'seeqCtxNew').
+//   text    : text to match. Strings are translated (see 'text_translate').
+//   slen    : length of the text.
+//   nbases  : bases before the code that ends the search (the prefilter
+//             reads no further).
+//   from    : position where the search starts, 0 or the position where
+//             the interleaved scan stopped (see 'batch_scan').
+//   state   : DFA state before 'from' (DFA_ROOT_STATE at 0). Its distance
+//             must be larger than tau.
+//   options : matching options (see 'seeqStringMatch').
+//   packed  : 1 if the text is 2-bit packed, 0 otherwise.
+//             
+// RETURN:                                                                
+//   Returns the number of matches stored in 'ctx', 0 if none was found or -1 in case of error and
+//   seeqerr is set appropriately. 
+//
+// SIDE EFFECTS:
+//   The match stack and the statistics of 'ctx' are modified. New states may
+//   be added to the DFAs of 'sq'.
+{
+   // Count replaces all other options.
+   int match_opt = options & MASK_MATCH;
+   int opt_best  = match_opt == SQ_BEST;
+   int all_match = match_opt == SQ_ALL || opt_best;
+
+   int opt_ignore = (options & MASK_NONDNA) == SQ_IGNORE;
+   int stream_opt = options & MASK_INPUT;
+
+   // Allocate match stacks.
+   //   mstack_t ** mstack = malloc((size_t)(sq->tau+1)*sizeof(mstack_t*));
+   //   if (mstack == NULL) return -1;
+   //   for (int i = 0; i <= sq->tau; i++)
+   //      if((mstack[i] = stackNew(INITIAL_MATCH_STACK_SIZE)) == NULL) return -1;
+
+   // Set structure to non-matched.
+   ctx->hits = 0;
+
+   // The dfa_t structures are never reallocated, 'dfa_step' only adds states.
+   dfa_t * dfa  = (dfa_t *) sq->dfa;
+   dfa_t * rdfa = (dfa_t *) sq->rdfa;
+
+   // Reset search variables
+   int best_d = sq->tau + 1;
+   // Search variables
+   int streak_dist = sq->tau + 1;
+   int match = 0;
+   uint32_t current_node = state;
+   uint32_t last_node = state;
+   int last_row = 0; // The row of 'last_node' is in the pattern set.
+   int end = 0;
+   const uint8_t * codes = text->codes;
+   // Complete DFAs have all the transitions computed.
+   const int dfa_lazy  = !dfa->complete;
+   // Storage of the states, kept in locals so that it is not read from the
+   // DFA at each base. Only 'dfa_step' changes it (see 'dfa_widen').
+   const uint8_t * states = dfa->states;
+   size_t nflat      = dfa->nflat;
+   size_t state_size = dfa->state_size;
+   int    narrow     = dfa_narrow(dfa);
+   const int shared  = dfa->shared;
+   // The state 0 of the contexts of shared DFAs is private (see 'seeqClone').
+   const vertex_t * s0 = shared && ctx->cache != NULL ? ((scratch_t *) ctx->cache)->s0 : NULL;
+#define vertex(s) slab_vertex(dfa, states, nflat, state_size, s)
+   // States used by the text (see 'dfa_evict').
+   uint8_t * used  = dfa->used;
+   // Pattern sets (see 'seeqNewMulti').
+   patset_t * pats = (patset_t *) sq->pats;
+   // Hamming matches span the pattern length (see 'SQ_HAMMING'). The
+   // DFA_STARTS states hold the length of the matches (see 'SQ_FWDSTART'),
+   // read when the distance is below tau+1.
+   const int hamming = dfa->metric == DFA_HAMMING;
+   const int starts  = dfa->metric == DFA_STARTS;
+   int streak_len = 0;
+   // 2-base transitions (see 'dfa_stride'). 'prev' and 'prev_base' are the
+   // last single-base step, composed with the next one to fill the table.
+   // The table of a complete DFA may be filled by many threads, but all its
+   // states exist, so the entries are only ordered in shared DFAs.
+   uint64_t * pairs  = dfa->pairs;
+   size_t     npairs = dfa->npairs;
+   uint32_t prev      = 0;
+   int      prev_base = 0;
+   // Prefilters (see 'filter_next'). A match ending at a position is found
+   // by the DFA started in the root 'span' bases before it, so the DFA only
+   // runs from 'span' bases before the allowed match ends to the next base.
+   // The ignored characters may extend the matches, the lines are then
+   // matched whole.
+   int filtered = !stream_opt && !opt_ignore;
+   if (filtered && (options & MASK_FILTER) == SQ_COMPOSITION && ctx->comp == NULL &&
+       (ctx->comp = comp_new(sq)) == NULL) return -1;
+   // Row of the states of pattern sets (see 'patset_match').
+   if (pats != NULL && ctx->row == NULL && (ctx->row = malloc(dfa->trie->height)) == NULL) return -1;
+   filter_t filter = {(seed_t *) sq->seeds, (options & MASK_FILTER) == SQ_COMPOSITION ? ctx->comp : NULL,
+                      0, 0, 0, 0, 0, &ctx->stats};
+   filtered = filtered && (filter.seeds != NULL || filter.comp != NULL);
+   if (filter.comp != NULL) filter.comp->hi = 0;
+   filter.span = filter.seeds != NULL ? filter.seeds->span : filter.comp != NULL ? filter.comp->span : 0;
+   size_t next_end = 0;   // Next match end to check.
+   size_t win_end  = 0;   // End of the positions the DFA must read.
+   ctx->stats.texts++;
+   ctx->stats.bases += nbases;
+   
+   // DFA state.
+   for (int64_t i = from; i <= slen; i++) {
+      // Skip the text where no match can end.
+      if (filtered && (size_t) i >= win_end) {
+         size_t last;
+         size_t e = filter_next(&filter, text, next_end, nbases, &last, packed);
+         if (e == nbases) {
+            if (i == 0) ctx->stats.rejected++;
+            if (nbases > (size_t) i) ctx->stats.skipped += nbases - (size_t) i;
+            break;
+         }
+         next_end = last + 1;
+         win_end  = last + 2;
+         if (e > (size_t) i + filter.span) {
+            ctx->stats.skipped += e - filter.span - (size_t) i;
+            i = (int64_t) (e - filter.span);
+            current_node = last_node = DFA_ROOT_STATE;
+            streak_dist  = sq->tau + 1;
+            last_row     = 0;
+            match        = 0;
+            prev         = 0;
+         }
+      }
+
+      // Read the text by pairs of bases while no match can end, as if the
+      // positions were processed one by one.
+      while (current_node < npairs && streak_dist > sq->tau) {
+         int c1 = packed ? text_code(text, (size_t)i) : codes[i];
+         if (c1 >= NBASES) break;
+         int c2 = packed ? text_code(text, (size_t)i+1) : codes[i+1];
+         if (c2 >= NBASES) break;
+         const uint64_t * slot = pairs + ((size_t)current_node*NBASES + (size_t)c1)*NBASES + (size_t)c2;
+         uint64_t pair = shared ? __atomic_load_n(slot, __ATOMIC_ACQUIRE) : __atomic_load_n(slot, __ATOMIC_RELAXED);
+         if (pair == 0) break;
+         uint32_t mid  = (uint32_t) pair;
+         uint32_t next = (uint32_t) (pair >> 32);
+         uint32_t mid_match  = vertex_match(vertex(mid), narrow);
+         uint32_t next_match = vertex_match(vertex(next), narrow);
+         if (get_match(mid_match) <= sq->tau || get_match(next_match) <= sq->tau ||
+             slen - i - 1 < get_mintomatch(mid_match) || slen - i - 2 < get_mintomatch(next_match)) break;
+         if (used != NULL) used[mid] = used[next] = 1;
+         current_node = next;
+         streak_dist  = get_match(next_match);
+         last_node    = next;
+         last_row     = 0;
+         match        = 0;
+         prev         = 0;
+         i += 2;
+      }
+
+      // Read the bases one by one while no match can end (see 'text_scan').
+      // The last base before 'win_end' is read below, then the prefilters.
+      if (pairs == NULL && streak_dist > sq->tau) {
+         int64_t stop = filtered ? (int64_t) win_end - 1 : slen + 1;
+         int64_t j = narrow ? text_scan(dfa, text, i, stop, slen, sq->tau, used, &current_node, 1, 0, packed) :
+                     shared ? text_scan(dfa, text, i, stop, slen, sq->tau, used, &current_node, 0, 1, packed) :
+                              text_scan(dfa, text, i, stop, slen, sq->tau, used, &current_node, 0, 0, packed);
+         if (j > i) {
+            i = j;
+            last_node = current_node;
+            last_row  = 0;
+            match     = 0;
+         }
+      }
+
+      // Update DFA.
+      int cin = packed ? text_code(text, (size_t)i) : codes[i];
+      int current_dist = sq->tau + 1;
+      int current_len  = 0;
+      int min_to_match = 0;
+      if (cin < NBASES) {
+         uint32_t next = vertex_next(vertex(current_node), narrow, shared, cin);
+         if (dfa_lazy && next == DFA_COMPUTE) {
+            // Pattern sets keep the row of the current state, the step may
+            // replace the row of the state 0 or renumber the states.
+            if (pats != NULL) {
+               state_row(dfa, current_node, ctx->cache, ctx->row);
+               last_row = 1;
+            }
+            if (dfa_step(current_node, cin, sq->wlen, sq->tau, &dfa, sq->keys, ctx->cache, &next)) return -1;
+            states     = dfa->states;
+            nflat      = dfa->nflat;
+            state_size = dfa->state_size;
+            narrow     = dfa_narrow(dfa);
+            prev = 0;
+         } else if (pairs != NULL) {
+            if (prev != 0 && current_node != 0 && next != 0) {
+               uint64_t * slot = pairs + ((size_t)prev*NBASES + (size_t)prev_base)*NBASES + (size_t)cin;
+               uint64_t   pair = (uint64_t) current_node | ((uint64_t) next << 32);
+               if (shared) __atomic_store_n(slot, pair, __ATOMIC_RELEASE);
+               else __atomic_store_n(slot, pair, __ATOMIC_RELAXED);
+            }
+            prev = current_node < npairs ? current_node : 0;
+            prev_base = cin;
+         }
+         current_node = next;
+         if (used != NULL) used[current_node] = 1;
+         uint32_t vmatch = current_node == 0 && s0 != NULL ? s0->match : vertex_match(vertex(current_node), narrow);
+         current_dist = get_match(vmatch);
+         min_to_match = (size_t) get_mintomatch(vmatch);
+         if (starts && current_dist <= sq->tau)
+            current_len = state_start(dfa, current_node, ctx->cache, sq->wlen, sq->tau);
+      }
+      else if (cin == 6 && stream_opt) continue;
+      else if (cin == 7 && opt_ignore) continue;
+      else if (cin >= 5) {
+         current_dist = sq->tau + 1;
+         end = 1;
+      }
+
+      if (slen - i - 1 < min_to_match) {
+         current_dist = sq->tau + 1;
+         end = 1;
+      }
+
+      // Accept matches again.
+      if (streak_dist >= current_dist) match = 0;
+
+      // Match accept condition:
+      // If there is overlap with the previous, accept only if new_dist < last_dist.
+      // 
+      // Note:
+      // set streak_dist <= current_dist to find all non-overlapping matches.
+      // (this may add extra mismatches to a perfect match though)
+      int perfect = streak_dist == 0;
+      int stop = streak_dist <= sq->tau && streak_dist < current_dist;
+      if ((perfect || stop) && !match && (!opt_best || streak_dist < best_d)) {
+         match = 1;
+         if (pats == NULL) {
+            size_t match_start_pos = (size_t) i;
+            if (hamming) {
+               match_start_pos = ham_start(text, i, sq->wlen);
+            } else if (starts) {
+               // Only the ignored characters are not counted in the length.
+               match_start_pos = opt_ignore || stream_opt ?
+                  ham_start(text, i, streak_len) : (size_t) (i - streak_len);
+            } else {
+               // Find match start with RDFA.
+               if (match_start(text, i, streak_dist, sq->wlen, sq->tau, &rdfa,
+                               sq->rkeys, ctx->rcache, &match_start_pos)) return -1;
+            }
+            match_t hit = (match_t) {match_start_pos, (size_t) i, (size_t) streak_dist, 0, 0};
+            // Save non-overlapping matches.
+            if (opt_best) {
+               // Save match.
+               ctx->hits = 1;
+               ctx->match[0] = hit;
+            } else {
+               if (ctx_addmatch(ctx, hit)) return -1;
+            }
+         } else {
+            if (patset_match(sq, ctx, text, i, streak_dist, last_node, last_row, opt_best)) return -1;
+         }
+         if (opt_best) best_d = streak_dist;
+         // Break if done.
+         if (!all_match) end = 1;
+      }
+
+      // Check end value.
+      if (end) break;
+
+      // Track distance and position of earliest min.
+      streak_dist = current_dist;
+      streak_len  = current_len;
+      last_node   = current_node;
+      last_row    = 0;
+   }
+#undef vertex
+   // Merge matches.
+   //if(recursive_merge(0, slen, 0, sq, mstack)) return -1;
+   // Free mstack.
+   //   for (int i = 0; i <= sq->tau; i++) free(mstack[i]);
+   //   free(mstack);
+   // Swap matches (to compensate for recursive_merge).
+   for (unsigned long j = 0; j < ctx->hits/2; j++) {
+      match_t tmp = ctx->match[j];
+      ctx->match[j] = ctx->match[ctx->hits-j-1];
+      ctx->match[ctx->hits-j-1] = tmp;
+   }
+   // Return.
+   return (long)ctx->hits;
+}
+
+
+__attribute__((always_inline))
+static inline long
+string_match
+(
+ const char   * data,
+ size_t         len,
+ const seeq_t * sq,
+ seeq_ctx_t   * ctx,
+ int64_t        from,
+ uint32_t       state,
+ int            options
+)
+// SYNOPSIS:                                                              
+//   Translates a string in the buffer of 'ctx' and matches it (see
+//   'text_match'), for 'seeqCtxMatchN' and 'seeqCtxBatchMatch'.
+//                                                                        
+// PARAMETERS:                                                            
+//   data    : text to match, of length 'len'.
+//   len     : length of the text.
+//   sq      : pointer to a seeq_t structure. (see 'seeqNew')
+//   ctx     : matching context of 'sq'.
+//   from    : position where the search starts (see 'text_match').
+//   state   : DFA state before 'from'.
+//   options : matching options (see 'seeqStringMatch').
+//             
+// RETURN:                                                                
+//   Returns the number of matches stored in 'ctx', 0 if none was found or -1 in case of error and
+//   seeqerr is set appropriately. 
+//
+// SIDE EFFECTS:
+//   The match stack and the statistics of 'ctx' are modified.
+{
+   if (len >= INT64_MAX) {
+      seeqerr = 16;
+      return -1;
+   }
+   // The loop reads the translated text (see 'text_translate').
+   if (len + 1 > ctx->codesz) {
+      size_t codesz = 2 * (len + 1);
+      uint8_t * buf = realloc(ctx->codes, codesz);
+      if (buf == NULL) return -1;
+      ctx->codes  = buf;
+      ctx->codesz = codesz;
+   }
+   text_t text = {ctx->codes, NULL, NULL, NULL, len};
+   size_t ncodes = text_translate(data, ctx->codes, len, options);
+
+   return text_match(sq, ctx, &text, (int64_t) len, ncodes - 1, from, state, options, 0);
+}
+
+long
+seeqStringMatch
+(
+ const char * data,
+ seeq_t     * sq,
+ int          options
+)
+// SYNOPSIS:                                                              
+//   Finds a pattern in the string 'data'. The matching pattern and distance are the ones
+//   specified in the call to seeqNew().
+//                                                                        
+// PARAMETERS:                                                            
+//   data    : string to match.
+//   sq      : pointer to a seeq_t structure. (see 'seeqNew')
+//   options : matching options. Set to 0 for default (SQ_FIRST|SQ_FAIL|SQ_LINES).
+//             Bitwise-OR the following macros to set different options.
+//             Macros from the same group are mutually exclusive. If two options from
+//             the same group are set, undefined behavior occurs.
+//
+//             MATCH OPTIONS:
+//             * SQ_FIRST: searches the line until the first match is found. [DEFAULT]
+//             * SQ_BEST: searches the whole line to find the best match, i.e. the one with
+//               minimum matching distance. In case of many best matches, the first is stored
+//               in 'sq'.
+//             * SQ_ALL: finds and stores in 'sq' all the matching positions of the line.
+//
+//             NON-DNA TEXT OPTIONS:
+//             * SQ_FAIL: stops searching the current line if an illegal character is
+//               found (allowed characters are 'a','A','c','C','g','G','t','T','u','U','n','N',
+//               '\0','\n'). [DEFAULT]
+//             * SQ_IGNORE: illegal characters will be ignored.
+//             * SQ_CONVERT: illegal characters will be substituted by mismatches ('N').
+//
+//             INPUT OPTIONS:
+//             * SQ_LINES: Search until '\n' or '\0' is found. [DEFAULT]
+//             * SQ_STREAM: Search until '\0' is found, newline characters will be ignored.
+//             The search also ends at the end of the text (see 'seeqMatchN').
+//
+//             FILTER OPTIONS:
+//             * SQ_NOFILTER: the text is only filtered by the exact seeds of the patterns
+//               (when they are long enough, and not with SQ_IGNORE or SQ_STREAM). [DEFAULT]
+//             * SQ_COMPOSITION: the DFA also skips the positions where the bases of the
+//               text cannot make a match (see 'comp_new'). Useful for patterns of
+//               skewed composition. The selectivity is in 'sq->ctx.stats'.
+//             
+// RETURN:                                                                
+//   Returns the number of matches stored in 'sq', 0 if none was found or -1 in case of error and
+//   seeqerr and 'sq->ctx.err' are set appropriately. 
+//
+// SIDE EFFECTS:
+//   The match stack, the statistics and the cached string of 'sq' are modified.
+{
+   return seeqMatchN(data, strlen(data), sq, options);
+}
+
+
+long
+seeqMatchN
+(
+ const char * data,
+ size_t       len,
+ seeq_t     * sq,
+ int          options
+)
+// SYNOPSIS:                                                              
+//   Same as 'seeqStringMatch', for the first 'len' characters of 'data'. The
+//   text needs no terminating null, so that the lines of a larger buffer
+//   (e.g. a file mapped in memory) are matched in place. No character after
+//   'len' is read, the match positions are offsets from 'data'.
+//                                                                        
+// PARAMETERS:                                                            
+//   data    : text to match, of length 'len'.
+//   len     : length of the text, less than INT64_MAX.
+//   sq      : pointer to a seeq_t structure. (see 'seeqNew')
+//   options : matching options (see 'seeqStringMatch').
+//             
+// RETURN:                                                                
+//   Returns the number of matches stored in 'sq', 0 if none was found or -1 in case of error and
+//   seeqerr and 'sq->ctx.err' are set appropriately. 
+//
+// SIDE EFFECTS:
+//   The match stack, the statistics and the cached string of 'sq' are modified.
+{
+   return seeqCtxMatchN(data, len, sq, &sq->ctx, options);
+}
+
+
+long
+seeqCtxMatchN
+(
+ const char   * data,
+ size_t         len,
+ const seeq_t * sq,
+ seeq_ctx_t   * ctx,
+ int            options
+)
+// SYNOPSIS:                                                              
+//   Same as 'seeqMatchN', with the matching state in 'ctx' (see 'seeqCtxNew').
+//   'sq' is not modified, so many threads can call this function with the
+//   same seeq_t, each with its own context.
+//                                                                        
+// PARAMETERS:                                                            
+//   data    : text to match, of length 'len'.
+//   len     : length of the text, less than INT64_MAX.
+//   sq      : pointer to a seeq_t structure. (see 'seeqNew')
+//   ctx     : matching context of 'sq'. (see 'seeqCtxNew')
+//   options : matching options (see 'seeqStringMatch').
+//             
+// RETURN:                                                                
+//   Returns the number of matches stored in 'ctx', 0 if none was found or -1 in case of error and
+//   seeqerr and 'ctx->err' are set appropriately. 
+//
+// SIDE EFFECTS:
+//   The match stack and the statistics of 'ctx' are modified.
+{
+   // Set error to 0.
+   seeqerr = 0;
+
+   long hits = string_match(data, len, sq, ctx, 0, DFA_ROOT_STATE, options);
+   ctx->err = seeqerr;
+   return hits;
+}
+
+
+void
+batch_scan
+(
+ const dfa_t        * dfa,
+ int                  tau,
+ const char * const * data,
+ const size_t       * lens,
+ size_t               n,
+ int                  options,
+ scan_t             * scan
+)
+// SYNOPSIS:                                                              
+//   Reads a group of texts with the DFA until a match can end, for
+//   'seeqCtxBatchMatch'. A single text is a chain of dependent loads (each
+//   state is read from the previous one), so BATCH_LANES texts are stepped
+//   in turns and the vertex of the next state of each one is prefetched,
+//   to be read on its next turn. The texts are translated on the fly. A
+//   text stops at its end, at a transition that is not computed, or when
+//   the distance drops to tau (the distance is only read on the next turn),
+//   then the next text of the group takes its place. The min-to-match
+//   values are not checked, they only end the search earlier.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa     : DFA of the patterns. Its states must not be evicted.
+//   tau     : distance threshold.
+//   data    : texts to read.
+//   lens    : lengths of the texts, or NULL if they are null-terminated.
+//   n       : number of texts, up to BATCH_GROUP.
+//   options : matching options (see 'seeqStringMatch').
+//   scan    : where each text stopped. The state is 0 if the text cannot
+//             match, and the position is then the number of bases (see
+//             'text_translate'). Otherwise the text must be matched from
+//             that position and state (see 'text_match').
+//
+// RETURN:                                                                
+//   void.
+//
+// SIDE EFFECTS:
+//   The vertices of the DFA are prefetched.
+{
+   int nondna_opt = options & MASK_NONDNA;
+   const int * translate = nondna_opt == SQ_CONVERT ? translate_convert : translate_ignore;
+   int stop6 = (options & MASK_INPUT) == SQ_LINES;
+   int stop7 = nondna_opt == SQ_FAIL;
+   // The states are not modified during the scan (see 'text_match').
+   const uint8_t * states = dfa->states;
+   const size_t nflat      = dfa->nflat;
+   const size_t state_size = dfa->state_size;
+   const int    narrow     = dfa_narrow(dfa);
+   const int    shared     = dfa->shared;
+#define vertex(s) slab_vertex(dfa, states, nflat, state_size, s)
+
+   // Text, length, next position and state of each lane. 'at' is the
+   // position of the last base and 'prev' the state before it.
+   size_t   text[BATCH_LANES], len[BATCH_LANES], pos[BATCH_LANES], at[BATCH_LANES];
+   uint32_t cur[BATCH_LANES], prev[BATCH_LANES];
+
+   size_t next = 0;
+   int active = 0;
+   for (; active < BATCH_LANES && next < n; active++, next++) {
+      text[active] = next;
+      len[active]  = lens != NULL ? lens[next] : SIZE_MAX;
+      pos[active]  = at[active] = 0;
+      cur[active]  = prev[active] = DFA_ROOT_STATE;
+   }
+
+   while (active > 0) {
+      for (int l = 0; l < active; ) {
+         uint32_t s = cur[l];
+         size_t   i = pos[l];
+         int      c = i < len[l] ? translate[(uint8_t) data[text[l]][i]] : 5;
+         uint32_t t = DFA_COMPUTE;
+         if (get_match(vertex_match(vertex(s), narrow)) <= tau) {
+            scan[text[l]] = (scan_t) {at[l], prev[l]};
+         } else if (c >= NBASES) {
+            if ((c == 6 && !stop6) || (c == 7 && !stop7)) {
+               pos[l]++;
+               l++;
+               continue;
+            }
+            scan[text[l]] = (scan_t) {i, 0};
+         } else if ((t = vertex_next(vertex(s), narrow, shared, c)) == DFA_COMPUTE || t == 0) {
+            scan[text[l]] = (scan_t) {i, s};
+         } else {
+            __builtin_prefetch(vertex(t));
+            at[l]   = i;
+            prev[l] = s;
+            cur[l]  = t;
+            pos[l]  = i + 1;
+            l++;
+            continue;
+         }
+         // The lane takes the next text, or the last lane.
+         if (next < n) {
+            text[l] = next;
+            len[l]  = lens != NULL ? lens[next] : SIZE_MAX;
+            pos[l]  = at[l] = 0;
+            cur[l]  = prev[l] = DFA_ROOT_STATE;
+            next++;
+         } else {
+            active--;
+            text[l] = text[active];
+            len[l]  = len[active];
+            pos[l]  = pos[active];
+            at[l]   = at[active];
+            cur[l]  = cur[active];
+            prev[l] = prev[active];
+         }
+      }
+   }
+#undef vertex
+}
+
+
+#ifdef SEEQ_GATHER
+static int
+gather_exit
+(
+ const dfa_t    * dfa,
+ int              tau,
+ const uint8_t  * codes,
+ const uint32_t * start,
+ const uint32_t * stop,
+ size_t           text,
+ uint32_t       * pos,
+ uint32_t         state,
+ scan_t         * scan
+)
+// SYNOPSIS:                                                              
+//   Scalar step of a lane that the vector step of 'batch_gather' did not
+//   move. An ignored code is skipped and the lane goes on, otherwise the
+//   text stops: at the end, before a transition that is not computed or
+//   that drops the distance to tau (to be matched from there), or when
+//   less bases are left than the min-to-match of the next state.
+//
+// RETURN:                                                                
+//   Returns 1 if the text stopped and 'scan' is set, 0 if it goes on.
+{
+   int c = codes[*pos];
+   if (c >= NBASES) {
+      // The translation ends at the first code that stops the search.
+      if (*pos < stop[text]) {
+         (*pos)++;
+         return 0;
+      }
+      scan[text] = (scan_t) {stop[text] - start[text], 0};
+      return 1;
+   }
+   uint32_t t = state_next(dfa, state, c);
+   if (t == DFA_COMPUTE || t == 0 || get_match(state_match(dfa, t)) <= tau)
+      scan[text] = (scan_t) {*pos - start[text], state};
+   else
+      scan[text] = (scan_t) {stop[text] - start[text], 0};
+   return 1;
+}
+
+
+__attribute__((target("avx2")))
+static void
+gather_avx2
+(
+ const dfa_t    * dfa,
+ int              tau,
+ const uint8_t  * codes,
+ const uint32_t * start,
+ const uint32_t * stop,
+ size_t           n,
+ scan_t         * scan
+)
+// SYNOPSIS:                                                              
+//   AVX2 kernel of 'batch_gather', 8 lanes.
+{
+   const int narrow = dfa_narrow(dfa);
+   const __m128i vshift = _mm_cvtsi32_si128(narrow ? 4 : 5);
+   const __m128i fshift = _mm_cvtsi32_si128(narrow ? 1 : 2);
+   const __m256i low    = _mm256_set1_epi32(narrow ? 0xFFFF : -1);
+   const __m256i dmask  = _mm256_set1_epi32(narrow ? 0xFF : 0xFFFF);
+   const __m128i mshift = _mm_cvtsi32_si128(narrow ? 8 : 16);
+   const __m256i nocomp = _mm256_set1_epi32(narrow ? DFA_NARROW_COMPUTE : (int) DFA_COMPUTE);
+   const __m256i bytes  = _mm256_set1_epi32(0xFF);
+   const __m256i last   = _mm256_set1_epi32(NBASES-1);
+   const __m256i nbases = _mm256_set1_epi32(NBASES);
+   const __m256i one    = _mm256_set1_epi32(1);
+   const __m256i vtau   = _mm256_set1_epi32(tau);
+
+   // Text, state, position, stop position and activity of each lane. The
+   // idle lanes read the code at 0 from the root.
+   size_t  text[8];
+   int32_t s[8], p[8], e[8], a[8];
+   size_t next = 0;
+   int active = 0;
+   for (int l = 0; l < 8; l++) {
+      a[l] = next < n ? -1 : 0;
+      text[l] = next;
+      s[l] = DFA_ROOT_STATE;
+      p[l] = next < n ? (int32_t) start[next] : 0;
+      e[l] = next < n ? (int32_t) stop[next] : 0;
+      if (next < n) active++, next++;
+   }
+
+   while (active > 0) {
+      __m256i S = _mm256_loadu_si256((const __m256i *) s);
+      __m256i P = _mm256_loadu_si256((const __m256i *) p);
+      __m256i E = _mm256_loadu_si256((const __m256i *) e);
+      __m256i A = _mm256_loadu_si256((const __m256i *) a);
+      int out = 0;
+      do {
+         // The active lanes move together until one stops, so the codes
+         // are gathered four at a time (the buffer is padded).
+         __m256i w = _mm256_i32gather_epi32((const int *) codes, P, 1);
+         for (int b = 0; b < 4 && !out; b++, w = _mm256_srli_epi32(w, 8)) {
+            __m256i c  = _mm256_and_si256(w, bytes);
+            __m256i ok = _mm256_cmpgt_epi32(nbases, c);
+            // The transition is read from the vertex of the state.
+            __m256i off = _mm256_add_epi32(_mm256_sll_epi32(S, vshift),
+                             _mm256_sll_epi32(_mm256_add_epi32(_mm256_min_epi32(c, last), one), fshift));
+            __m256i nx = _mm256_and_si256(_mm256_i32gather_epi32((const int *) dfa->states, off, 1), low);
+            ok = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(nx, nocomp),
+                                     _mm256_cmpeq_epi32(nx, _mm256_setzero_si256())), ok);
+            // The match value of the next state, of the current one if invalid.
+            __m256i t  = _mm256_blendv_epi8(S, nx, ok);
+            __m256i m  = _mm256_and_si256(_mm256_i32gather_epi32((const int *) dfa->states,
+                                          _mm256_sll_epi32(t, vshift), 1), low);
+            ok = _mm256_and_si256(ok, _mm256_cmpgt_epi32(_mm256_and_si256(m, dmask), vtau));
+            ok = _mm256_and_si256(ok, _mm256_cmpgt_epi32(_mm256_sub_epi32(E, P), _mm256_srl_epi32(m, mshift)));
+            __m256i go = _mm256_and_si256(ok, A);
+            S = _mm256_blendv_epi8(S, nx, go);
+            P = _mm256_sub_epi32(P, go);
+            out = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(ok, A)));
+         }
+      } while (!out);
+      _mm256_storeu_si256((__m256i *) s, S);
+      _mm256_storeu_si256((__m256i *) p, P);
+
+      for (; out; out &= out - 1) {
+         int l = __builtin_ctz((unsigned) out);
+         if (!gather_exit(dfa, tau, codes, start, stop, text[l], (uint32_t *) p + l, (uint32_t) s[l], scan))
+            continue;
+         // The lane takes the next text, or goes idle.
+         s[l] = DFA_ROOT_STATE;
+         if (next < n) {
+            text[l] = next;
+            p[l] = (int32_t) start[next];
+            e[l] = (int32_t) stop[next];
+            next++;
+         } else {
+            p[l] = e[l] = a[l] = 0;
+            active--;
+         }
+      }
+   }
+}
+
+
+__attribute__((target("avx512f")))
+static void
+gather_avx512
+(
+ const dfa_t    * dfa,
+ int              tau,
+ const uint8_t  * codes,
+ const uint32_t * start,
+ const uint32_t * stop,
+ size_t           n,
+ scan_t         * scan
+)
+// SYNOPSIS:                                                              
+//   AVX-512 kernel of 'batch_gather', 16 lanes. The match values are only
+//   gathered for the lanes with a valid transition.
+{
+   const int narrow = dfa_narrow(dfa);
+   const unsigned vshift = narrow ? 4 : 5;
+   const unsigned fshift = narrow ? 1 : 2;
+   const __m512i low    = _mm512_set1_epi32(narrow ? 0xFFFF : -1);
+   const __m512i dmask  = _mm512_set1_epi32(narrow ? 0xFF : 0xFFFF);
+   const unsigned mshift = narrow ? 8 : 16;
+   const __m512i nocomp = _mm512_set1_epi32(narrow ? DFA_NARROW_COMPUTE : (int) DFA_COMPUTE);
+   const __m512i bytes  = _mm512_set1_epi32(0xFF);
+   const __m512i last   = _mm512_set1_epi32(NBASES-1);
+   const __m512i nbases = _mm512_set1_epi32(NBASES);
+   const __m512i one    = _mm512_set1_epi32(1);
+   const __m512i vtau   = _mm512_set1_epi32(tau);
+
+   // Text, state, position and stop position of each lane (see
+   // 'gather_avx2'), and the mask of the active lanes.
+   size_t  text[16];
+   int32_t s[16], p[16], e[16];
+   __mmask16 a = 0;
+   size_t next = 0;
+   int active = 0;
+   for (int l = 0; l < 16; l++) {
+      text[l] = next;
+      s[l] = DFA_ROOT_STATE;
+      p[l] = next < n ? (int32_t) start[next] : 0;
+      e[l] = next < n ? (int32_t) stop[next] : 0;
+      if (next < n) a |= (__mmask16) (1 << l), active++, next++;
+   }
+
+   while (active > 0) {
+      __m512i S = _mm512_loadu_si512(s);
+      __m512i P = _mm512_loadu_si512(p);
+      __m512i E = _mm512_loadu_si512(e);
+      __mmask16 out = 0;
+      do {
+         __m512i w = _mm512_i32gather_epi32(P, codes, 1);
+         for (int b = 0; b < 4 && !out; b++, w = _mm512_srli_epi32(w, 8)) {
+            __m512i c = _mm512_and_si512(w, bytes);
+            __mmask16 ok = _mm512_cmplt_epi32_mask(c, nbases);
+            __m512i off = _mm512_add_epi32(_mm512_slli_epi32(S, vshift),
+                             _mm512_slli_epi32(_mm512_add_epi32(_mm512_min_epi32(c, last), one), fshift));
+            __m512i nx = _mm512_and_si512(_mm512_i32gather_epi32(off, dfa->states, 1), low);
+            ok = _mm512_mask_cmpneq_epi32_mask(ok, nx, nocomp) & _mm512_test_epi32_mask(nx, nx);
+            __m512i m = _mm512_and_si512(_mm512_mask_i32gather_epi32(S, ok, _mm512_slli_epi32(nx, vshift),
+                                                                      dfa->states, 1), low);
+            ok = _mm512_mask_cmpgt_epi32_mask(ok, _mm512_and_si512(m, dmask), vtau);
+            ok = _mm512_mask_cmpgt_epi32_mask(ok, _mm512_sub_epi32(E, P), _mm512_srli_epi32(m, mshift));
+            __mmask16 go = ok & a;
+            S = _mm512_mask_mov_epi32(S, go, nx);
+            P = _mm512_mask_add_epi32(P, go, P, one);
+            out = a & (__mmask16) ~ok;
+         }
+      } while (!out);
+      _mm512_storeu_si512(s, S);
+      _mm512_storeu_si512(p, P);
+
+      for (unsigned x = out; x; x &= x - 1) {
+         int l = __builtin_ctz(x);
+         if (!gather_exit(dfa, tau, codes, start, stop, text[l], (uint32_t *) p + l, (uint32_t) s[l], scan))
+            continue;
+         s[l] = DFA_ROOT_STATE;
+         if (next < n) {
+            text[l] = next;
+            p[l] = (int32_t) start[next];
+            e[l] = (int32_t) stop[next];
+            next++;
+         } else {
+            p[l] = e[l] = 0;
+            a &= (__mmask16) ~(1 << l);
+            active--;
+         }
+      }
+   }
+}
+#endif
+
+
+int
+batch_gather
+(
+ const dfa_t        * dfa,
+ int                  tau,
+ const char * const * data,
+ const size_t       * lens,
+ size_t               n,
+ int                  options,
+ seeq_ctx_t         * ctx,
+ scan_t             * scan
+)
+// SYNOPSIS:                                                              
+//   Same as 'batch_scan', for complete DFAs, with the gather instructions
+//   of AVX-512 (16 lanes) or AVX2 (8 lanes), selected at run time. The texts
+//   of the group are first translated one after the other in the code
+//   buffer of 'ctx', then each lane gathers its code, the transition and the
+//   match value of the next state. The base, the distance and the
+//   min-to-match are checked for all the lanes at once, and the lanes that
+//   do not pass are done one by one (see 'gather_exit'). The offsets of the
+//   gathers are 32-bit.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa     : DFA of the patterns.
+//   tau     : distance threshold.
+//   data    : texts to read.
+//   lens    : lengths of the texts, or NULL if they are null-terminated.
+//   n       : number of texts, up to BATCH_GROUP.
+//   options : matching options (see 'seeqStringMatch').
+//   ctx     : matching context, for the code buffer.
+//   scan    : where each text stopped (see 'batch_scan').
+//
+// RETURN:                                                                
+//   Returns 0, or 1 if the group must be read with 'batch_scan': the CPU
+//   has no AVX2, the DFA is not complete, too large or in slabs (see
+//   'dfa_flatten'), the texts are too long for the offsets or the buffer
+//   could not be allocated.
+//
+// SIDE EFFECTS:
+//   The code buffer of 'ctx' is modified.
+{
+#ifdef SEEQ_GATHER
+   int avx512 = __builtin_cpu_supports("avx512f");
+   if (!dfa->complete || dfa->pos >= (1 << 26) || dfa->pos > dfa->nflat || (!avx512 && !__builtin_cpu_supports("avx2")))
+      return 1;
+
+   // The code 0 is read by the idle lanes, and the gathers read 4 bytes.
+   size_t len[BATCH_GROUP];
+   size_t size = 1 + 3;
+   for (size_t k = 0; k < n; k++) {
+      len[k] = lens != NULL ? lens[k] : strlen(data[k]);
+      size  += len[k] + 1;
+      if (len[k] >= INT32_MAX || size >= INT32_MAX) return 1;
+   }
+   if (size > ctx->codesz) {
+      uint8_t * buf = realloc(ctx->codes, size);
+      if (buf == NULL) return 1;
+      ctx->codes  = buf;
+      ctx->codesz = size;
+   }
+
+   uint8_t * codes = ctx->codes;
+   uint32_t start[BATCH_GROUP], stop[BATCH_GROUP];
+   uint32_t off = 1;
+   codes[0] = 0;
+   for (size_t k = 0; k < n; k++) {
+      start[k] = off;
+      off += (uint32_t) text_translate(data[k], codes + off, len[k], options);
+      stop[k] = off - 1;
+   }
+   memset(codes + off, 5, 3);
+
+   if (avx512) gather_avx512(dfa, tau, codes, start, stop, n, scan);
+   else        gather_avx2(dfa, tau, codes, start, stop, n, scan);
+   return 0;
+#else
+   (void) dfa; (void) tau; (void) data; (void) lens; (void) n;
+   (void) options; (void) ctx; (void) scan;
+   return 1;
+#endif
+}
+
+long
+seeqBatchMatch
+(
+ const char * const * data,
+ const size_t       * lens,
+ size_t               n,
+ seeq_t             * sq,
+ seeqbatch_t        * batch,
+ int                  options
+)
+// SYNOPSIS:                                                              
+//   Same as 'seeqCtxBatchMatch', with the matching state of 'sq'.
+//                                                                        
+// PARAMETERS:                                                            
+//   data    : texts to match.
+//   lens    : lengths of the texts, or NULL if they are null-terminated.
+//   n       : number of texts.
+//   sq      : pointer to a seeq_t structure. (see 'seeqNew')
+//   batch   : arrays where the matches are stored.
+//   options : matching options (see 'seeqStringMatch').
+//             
+// RETURN:                                                                
+//   Returns the number of texts matched, or -1 in case of error and seeqerr
+//   and 'sq->ctx.err' are set appropriately. 
+//
+// SIDE EFFECTS:
+//   The matches are stored in 'batch'. The statistics of 'sq' are modified.
+{
+   return seeqCtxBatchMatch(data, lens, n, sq, &sq->ctx, batch, options);
+}
+
+
+long
+seeqCtxBatchMatch
+(
+ const char * const * data,
+ const size_t       * lens,
+ size_t               n,
+ const seeq_t       * sq,
+ seeq_ctx_t         * ctx,
+ seeqbatch_t        * batch,
+ int                  options
+)
+// SYNOPSIS:                                                              
+//   Matches a batch of texts (e.g. short reads) in one call. The matches are
+//   stored in the flat arrays of 'batch', in the order of the texts and of
+//   the positions in each text, tagged with the index of their text. The
+//   matching loop is inlined here, so the cost of a call and of reading the
+//   matches one by one ('seeqCtxMatchIter') is paid once per batch. The
+//   matching stops before the first text whose matches do not fit in the
+//   arrays, the call can be repeated from there.
+//                                                                        
+// PARAMETERS:                                                            
+//   data    : texts to match.
+//   lens    : lengths of the texts, or NULL if they are null-terminated.
+//   n       : number of texts.
+//   sq      : pointer to a seeq_t structure. (see 'seeqNew')
+//   ctx     : matching context of 'sq'. (see 'seeqCtxNew')
+//   batch   : arrays where the matches are stored. 'batch->size' is their
+//             capacity, 'batch->hits' is set to the number of matches.
+//   options : matching options (see 'seeqStringMatch').
+//             
+// RETURN:                                                                
+//   Returns the number of texts matched, less than 'n' if the arrays are
+//   full (0 if the matches of the first text do not fit), or -1 in case of
+//   error and seeqerr and 'ctx->err' are set appropriately. 
+//
+// SIDE EFFECTS:
+//   The matches are stored in 'batch'. The statistics of 'ctx' are modified
+//   and its match stack is emptied.
+{
+   // Set error to 0.
+   seeqerr = 0;
+
+   // Without prefilters, the texts are first read by the interleaved scan
+   // (see 'batch_scan' and 'batch_gather'), and only the ones that can match
+   // are matched from where it stopped. The stopping states must not be evicted.
+   const int interleave = ((dfa_t *) sq->dfa)->used == NULL &&
+      ((options & MASK_INPUT) == SQ_STREAM || (options & MASK_NONDNA) == SQ_IGNORE ||
+       (sq->seeds == NULL && (options & MASK_FILTER) != SQ_COMPOSITION));
+   scan_t scan[BATCH_GROUP];
+
+   batch->hits = 0;
+   size_t k;
+   for (k = 0; k < n; k++) {
+      size_t g = k % BATCH_GROUP;
+      if (interleave && g == 0) {
+         const size_t * l = lens != NULL ? lens + k : NULL;
+         size_t m = n - k < BATCH_GROUP ? n - k : BATCH_GROUP;
+         if (batch_gather(sq->dfa, sq->tau, data + k, l, m, options, ctx, scan))
+            batch_scan(sq->dfa, sq->tau, data + k, l, m, options, scan);
+      }
+      // The text is counted again if its matches do not fit.
+      seeqstats_t stats = ctx->stats;
+      long hits = 0;
+      if (interleave && scan[g].state == 0) {
+         // No match, counted as in 'text_match'.
+         ctx->hits = 0;
+         ctx->stats.texts++;
+         ctx->stats.bases += scan[g].pos;
+      } else {
+         size_t len = lens != NULL ? lens[k] : strlen(data[k]);
+         hits = interleave ?
+            string_match(data[k], len, sq, ctx, (int64_t) scan[g].pos, scan[g].state, options) :
+            string_match(data[k], len, sq, ctx, 0, DFA_ROOT_STATE, options);
+      }
+      if (hits < 0) {
+         ctx->err = seeqerr;
+         return -1;
+      }
+      if ((size_t) hits > batch->size - batch->hits) {
+         ctx->stats = stats;
+         break;
+      }
+      // The match stack is in reverse order (see 'seeqMatchIter').
+      for (size_t j = ctx->hits; j-- > 0; batch->hits++) {
+         const match_t * m = ctx->match + j;
+         batch->text[batch->hits]  = k;
+         batch->start[batch->hits] = m->start;
+         batch->end[batch->hits]   = m->end;
+         batch->dist[batch->hits]  = m->dist;
+         if (batch->pattern != NULL) batch->pattern[batch->hits] = m->pattern;
+         if (batch->strand != NULL)  batch->strand[batch->hits]  = m->strand;
+      }
+   }
+   ctx->hits = 0;
+   ctx->err  = seeqerr;
+   return (long) k;
+}
+
+
+long
+seeqPackedMatch
+(
+ const unsigned char * packed,
+ size_t                nbases,
+ const unsigned char * nmask,
+ seeq_t              * sq,
+ int                   options
+)
+// SYNOPSIS:                                                              
+//   Same as 'seeqStringMatch', for a sequence of 2-bit packed bases. The DFA
+//   reads the packed codes directly, the sequence is not decoded.
+//                                                                        
+// PARAMETERS:                                                            
+//   packed  : packed bases, four per byte, the first base in the two most
+//             significant bits.
+//   nbases  : number of bases, less than INT64_MAX.
+//   nmask   : bit mask of the bases that are 'N' (bit i%8 of byte i/8 for
+//             base i, the least significant bit first), or NULL if none.
+//   sq      : pointer to a seeq_t structure. (see 'seeqNew')
+//   options : matching options. Set to 0 for default (SQ_FIRST|SQ_PACKED_ACGT).
+//
+//             MATCH OPTIONS, FILTER OPTIONS: see 'seeqStringMatch'.
+//
+//             PACKING OPTIONS:
+//             * SQ_PACKED_ACGT: the 2-bit values 0-3 are A, C, G and T. [DEFAULT]
+//             * SQ_PACKED_TCAG: the 2-bit values 0-3 are T, C, A and G (UCSC .2bit).
+//             
+// RETURN:                                                                
+//   Returns the number of matches stored in 'sq', 0 if none was found or -1 in case of error and
+//   seeqerr and 'sq->ctx.err' are set appropriately. 
+//
+// SIDE EFFECTS:
+//   The match stack of 'sq' is modified.
+{
+   return seeqCtxPackedMatch(packed, nbases, nmask, sq, &sq->ctx, options);
+}
+
+
+long
+seeqCtxPackedMatch
+(
+ const unsigned char * packed,
+ size_t                nbases,
+ const unsigned char * nmask,
+ const seeq_t        * sq,
+ seeq_ctx_t          * ctx,
+ int                   options
+)
+// SYNOPSIS:                                                              
+//   Same as 'seeqPackedMatch', with the matching state in 'ctx' (see
+//   'seeqCtxMatchN').
+//                                                                        
+// PARAMETERS:                                                            
+//   packed  : packed bases (see 'seeqPackedMatch').
+//   nbases  : number of bases, less than INT64_MAX.
+//   nmask   : bit mask of the bases that are 'N', or NULL if none.
+//   sq      : pointer to a seeq_t structure. (see 'seeqNew')
+//   ctx     : matching context of 'sq'. (see 'seeqCtxNew')
+//   options : matching options (see 'seeqPackedMatch').
+//             
+// RETURN:                                                                
+//   Returns the number of matches stored in 'ctx', 0 if none was found or -1 in case of error and
+//   seeqerr and 'ctx->err' are set appropriately. 
+//
+// SIDE EFFECTS:
+//   The match stack and the statistics of 'ctx' are modified.
+{
+   // Set error to 0.
+   seeqerr = 0;
+
+   static const uint8_t acgt[4] = {0, 1, 2, 3};
+   static const uint8_t tcag[4] = {3, 1, 0, 2};
+
+   if (nbases >= INT64_MAX) {
+      ctx->err = seeqerr = 16;
+      return -1;
+   }
+   text_t text = {NULL, packed, nmask, (options & MASK_PACKING) == SQ_PACKED_TCAG ? tcag : acgt, nbases};
+
+   long hits = text_match(sq, ctx, &text, (int64_t) nbases, nbases, 0, DFA_ROOT_STATE,
+                          options & (MASK_MATCH | MASK_FILTER), 1);
+   ctx->err = seeqerr;
+   return hits;
+}
+
+
+int
+patset_match
+(
+ const seeq_t * sq,
+ seeq_ctx_t   * ctx,
+ const text_t * text,
+ int64_t        end,
+ int            dist,
+ uint32_t       state,
+ int          saved,
+ int          opt_best
+)
+// SYNOPSIS:                                                              
+//   Stores the matches of a pattern set (see 'seeqNewMulti') that end at
+//   position 'end' of the text. The matching patterns are the ones with the
+//   lowest distance (relative to their threshold) in the row of the DFA
+//   state. Their distance rises in the next position, as for a single
+//   pattern.
+//                                                                        
+// PARAMETERS:                                                            
+//   sq        : pointer to a seeq_t structure. (see 'seeqNewMulti')
+//   ctx       : matching context, where the matches are stored.
+//   text      : matched text.
+//   end       : end of the matches (position after the last matched base).
+//   dist      : relative distance of the matches.
+//   state     : DFA state at the last matched base.
+//   saved     : 1 if the row of 'state' is already in the pattern set.
+//   opt_best  : 1 to keep only the first matching pattern (SQ_BEST).
+//
+// RETURN:                                                                
+//   Returns 0 on success, or -1 if an error occurred.
+//
+// SIDE EFFECTS:
+//   The match stack of 'ctx' is modified.
+{
+   patset_t * pats = (patset_t *) sq->pats;
+   const int hamming = ((dfa_t *) sq->dfa)->metric == DFA_HAMMING;
+   const int starts  = ((dfa_t *) sq->dfa)->metric == DFA_STARTS;
+   if (!saved) state_row(sq->dfa, state, ctx->cache, ctx->row);
+   size_t off = 0;
+   for (int k = 0; k < pats->npat; k++) {
+      pattern_t * p = pats->pat + k;
+      const uint8_t * row = (uint8_t *) ctx->row + off;
+      // Distance of the pattern (last cell of its row, see 'dfa_newmulti').
+      int d = 0, len = 0;
+      if (hamming) {
+         int w = ham_width(p->tau);
+         for (int j = (p->wlen-1)*w; j < p->wlen*w; j++) d = 3*d + row[j];
+         off += (size_t)(p->wlen*w);
+      } else if (starts) {
+         int w = start_width(p->tau);
+         for (int j = (p->wlen-1)*w; j < p->wlen*w; j++) d = 3*d + row[j];
+         d = start_cell(d, p->wlen, p->tau, &len);
+         off += (size_t)(p->wlen*w);
+      } else {
+         for (int j = 0; j < p->wlen; j++) d += row[j] - 1;
+         off += (size_t)p->wlen;
+      }
+      if (d + sq->tau - p->tau != dist) continue;
+      size_t start;
+      if (hamming) start = ham_start(text, end, p->wlen);
+      else if (starts) start = ham_start(text, end, len);
+      else if (match_start(text, end, d, p->wlen, p->tau, &(p->rdfa),
+                           p->rkeys, ctx->rcache, &start)) return -1;
+      // Both strands of a pattern are tagged with the strand.
+      match_t hit = pats->strands ?
+         (match_t) {start, (size_t) end, (size_t) d, 0, (size_t) k} :
+         (match_t) {start, (size_t) end, (size_t) d, (size_t) k, 0};
+      // SQ_BEST keeps the first pattern.
+      if (opt_best) {
+         ctx->hits = 1;
+         ctx->match[0] = hit;
+         break;
+      }
+      if (ctx_addmatch(ctx, hit)) return -1;
+   }
+   return 0;
+}
+
+
+int
+match_start
+(
+ const text_t * text,
+ int64_t        end,
+ int            dist,
+ int            wlen,
+ int            tau,
+ dfa_t       ** rdfap,
+ char         * rkeys,
+ scratch_t    * rcache,
+ size_t       * start
+)
+// SYNOPSIS:                                                              
+//   Finds the start of a match with the reverse DFA of the pattern. The text
+//   is read backwards from the end of the match until the distance of the
+//   match is reached.
+//                                                                        
+// PARAMETERS:                                                            
+//   text      : matched text.
+//   end       : end of the match (position after the last matched base).
+//   dist      : distance of the match.
+//   wlen      : length of the pattern.
+//   tau       : Levenshtein distance threshold.
+//   rdfap     : pointer to a memory space containing the address of the reverse DFA.
+//   rkeys     : reversed expression keys.
+//   rcache    : private scratch for shared DFAs (see 'dfa_step'), or NULL.
+//   start     : pointer to a size_t where the start of the match will be placed.
+//
+// RETURN:                                                                
+//   Returns 0 on success, or -1 if an error occurred.
+//
+// SIDE EFFECTS:
+//   New states may be added to the reverse DFA.
+{
+   const int lazy = !(*rdfap)->complete;
+   uint8_t * used = (*rdfap)->used;
+   int64_t j = 0, ignores = 0;
+   uint32_t rnode = DFA_ROOT_STATE;
+   int d = tau + 1;
+   int last_d;
+   do {
+      int c = text_code(text, (size_t)(end - ++j));
+      last_d = d;
+      if (c < NBASES) {
+         ignores = 0;
+         uint32_t next = state_next(*rdfap, rnode, c);
+         if (lazy && next == DFA_COMPUTE)
+            if (dfa_step(rnode, c, wlen, tau, rdfap, rkeys, rcache, &next)) return -1;
+         rnode = next;
+         if (used != NULL) used[rnode] = 1;
+         d = get_match(rnode == 0 && rcache != NULL ?
+            rcache->s0->match : state_match(*rdfap, rnode));
+      } else {
+         ignores++;
+         continue;
+      }
+      // Stop when hitting the low point.
+   } while (d > dist && j < end);
+   j = (last_d < d ? j-1 : j) - ignores;
+   *start = (size_t) (end - j);
+   return 0;
+}
+
+size_t
+ham_start
+(
+ const text_t * text,
+ int64_t        end,
+ int            wlen
+)
+// SYNOPSIS:                                                              
+//   Finds the start of a match that spans 'wlen' bases of the text, as the
+//   Hamming matches (see SQ_HAMMING) and the matches of DFA_STARTS DFAs (see
+//   'start_row'). The ignored characters are skipped.
+//                                                                        
+// PARAMETERS:                                                            
+//   text : matched text.
+//   end  : end of the match (position after the last matched base).
+//   wlen : bases of the match.
+//
+// RETURN:                                                                
+//   Returns the start of the match.
+//
+// SIDE EFFECTS:
+//   None.
+{
+   size_t start = (size_t) end;
+   for (int n = 0; n < wlen; ) n += text_code(text, --start) < NBASES;
+   return start;
+}
+
+
+#ifdef SEEQ_SSSE3
+__attribute__((target("ssse3")))
+static size_t
+text_translate_ssse3
+(
+ const char * data,
+ uint8_t    * codes,
+ size_t       len,
+ int          nondna,
+ int          stop6,
+ int          stop7
+)
+// SYNOPSIS:                                                              
+//   SSSE3 version of 'text_translate', 16 characters at a time. Returns the
+//   start of the first block where the search ends, or of the remainder
+//   shorter than a block (the characters after 'len' are not read). The bases
+//   are lowercased, their low nibble is looked up with 'pshufb' in the
+//   table of their high nibble ('a' to 'o' or 'p' to 'z'), and the other
+//   characters are set to the non-DNA, newline or end codes.
+{
+   const __m128i lower = _mm_set1_epi8(0x20);
+   const __m128i nibble = _mm_set1_epi8(0x0F);
+   const __m128i none = _mm_set1_epi8((char) 0xFF);
+   //                                      a       c           g                   n
+   const __m128i ac = _mm_setr_epi8(-1, 0, -1, 1, -1, -1, -1, 2, -1, -1, -1, -1, -1, -1, 4, -1);
+   //                                                  t  u
+   const __m128i pz = _mm_setr_epi8(-1, -1, -1, -1, 3, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+   const __m128i c5 = _mm_set1_epi8(5);
+   const __m128i c6 = _mm_set1_epi8(6);
+   const __m128i c7 = _mm_set1_epi8((char) nondna);
+   // Codes that end the search (0xFE never matches).
+   const __m128i s6 = _mm_set1_epi8(stop6 ? 6 : (char) 0xFE);
+   const __m128i s7 = _mm_set1_epi8(stop7 ? 7 : (char) 0xFE);
+
+   size_t i = 0;
+   for (; i + 16 <= len; i += 16) {
+      __m128i x  = _mm_loadu_si128((const __m128i *) (data + i));
+      __m128i y  = _mm_or_si128(x, lower);
+      __m128i lo = _mm_and_si128(y, nibble);
+      __m128i hi = _mm_and_si128(_mm_srli_epi16(y, 4), nibble);
+      __m128i in6 = _mm_cmpeq_epi8(hi, _mm_set1_epi8(6));
+      __m128i in7 = _mm_cmpeq_epi8(hi, _mm_set1_epi8(7));
+      __m128i code = _mm_or_si128(_mm_and_si128(in6, _mm_shuffle_epi8(ac, lo)),
+                                  _mm_and_si128(in7, _mm_shuffle_epi8(pz, lo)));
+      code = _mm_or_si128(code, _mm_andnot_si128(_mm_or_si128(in6, in7), none));
+      // Non-DNA characters.
+      __m128i bad = _mm_cmpeq_epi8(code, none);
+      __m128i end = _mm_cmpeq_epi8(x, _mm_setzero_si128());
+      __m128i nl  = _mm_cmpeq_epi8(x, _mm_set1_epi8('\n'));
+      code = _mm_or_si128(_mm_andnot_si128(bad, code), _mm_and_si128(bad, c7));
+      code = _mm_or_si128(_mm_andnot_si128(_mm_or_si128(end, nl), code),
+                          _mm_or_si128(_mm_and_si128(end, c5), _mm_and_si128(nl, c6)));
+      _mm_storeu_si128((__m128i *) (codes + i), code);
+      __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(code, c5),
+                                  _mm_or_si128(_mm_cmpeq_epi8(code, s6), _mm_cmpeq_epi8(code, s7)));
+      if (_mm_movemask_epi8(stop)) break;
+   }
+   return i;
+}
+#endif
+
+
+size_t
+text_translate
+(
+ const char * data,
+ uint8_t    * codes,
+ size_t       len,
+ int          options
+)
+// SYNOPSIS:                                                              
+//   Translates a string to the codes of the DFA loop (see 'translate_ignore'),
+//   so that the loop reads validated codes. The translation stops at the
+//   first code that ends the search with 'options' (a null character, the
+//   end of the line or a non-DNA character), the codes after it may not be
+//   written. The code after the last character is the end of the string.
+//                                                                        
+// PARAMETERS:                                                            
+//   data    : text of length 'len', not necessarily null-terminated. No
+//             character after 'len' is read.
+//   codes   : output codes, of size 'len' + 1 at least.
+//   len     : length of 'data'.
+//   options : non-DNA and input options (see 'seeqStringMatch').
+//
+// RETURN:                                                                
+//   Returns the number of codes written.
+//
+// SIDE EFFECTS:
+//   None.
+{
+   int nondna_opt = options & MASK_NONDNA;
+   const int * translate = nondna_opt == SQ_CONVERT ? translate_convert : translate_ignore;
+   int stop6 = (options & MASK_INPUT) == SQ_LINES;
+   int stop7 = nondna_opt == SQ_FAIL;
+
+   size_t i = 0;
+#ifdef SEEQ_SSSE3
+   // The block where the search ends and the remainder are done below.
+   if (__builtin_cpu_supports("ssse3"))
+      i = text_translate_ssse3(data, codes, len, nondna_opt == SQ_CONVERT ? 4 : 7, stop6, stop7);
+#endif
+   for (; i < len; i++) {
+      int c = translate[(uint8_t) data[i]];
+      codes[i] = (uint8_t) c;
+      if (c == 5 || (stop6 && c == 6) || (stop7 && c == 7)) return i + 1;
+   }
+   codes[len] = 5;
+   return len + 1;
+}
+
+
+void
+state_row
+(
+ dfa_t           * dfa,
+ uint32_t          state,
+ const scratch_t * scratch,
+ uint8_t         * row
+)
+// SYNOPSIS:                                                              
+//   Copies the NW-alignment row (path) of a DFA state. The row of the state 0
+//   (cache mode) is the last row computed.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa     : the DFA.
+//   state   : DFA state.
+//   scratch : private scratch of the caller for shared DFAs, or NULL.
+//   row     : pointer to a memory space of the length of the pattern.
+//
+// RETURN:                                                                
+//   None.
+//
+// SIDE EFFECTS:
+//   None.
+{
+   size_t plen = dfa->trie->height;
+   if (state == 0) memcpy(row, scratch != NULL ? scratch->path : dfa->path_cache, plen);
+   else path_decode(state_code(dfa, state), row, plen);
+}
+
+int
+recursive_merge
+(
+ size_t      start,
+ size_t      end,
+ int         tau,
+ seeq_t    * sq,
+ mstack_t ** stackp
+)
+{
+   if (tau > sq->tau) return 0;
+   mstack_t   * stack = stackp[tau];
+   size_t next_start;
+   size_t next_end   = end;
+   
+   if (stack->pos > 0) {
+      // Remove upper overlaps.
+      match_t match = stack->match[stack->pos-1];
+      while (match.end > end && stack->pos > 0) match = stack->match[--stack->pos-1];
+
+      while (stack->pos > 0) {
+         match = stack->match[stack->pos-1];
+         if (start > match.start) break;
+         // Move match limits.
+         next_start =  match.end;
+         if (recursive_merge(next_start, next_end, tau+1, sq, stackp)) return -1;
+         next_end = match.start;
+         // We can safely insert without overlap.
+         stack->pos--;
+         if (seeqAddMatch(sq, match)) return -1;
+      }
+   }
+   next_start = start;
+   if (recursive_merge(next_start, next_end, tau+1, sq, stackp)) return -1;
+   return 0;
+}
+
+mstack_t *
+stackNew
+(
+ size_t size
+ )
+{
+   if (size < 1) size = 1;
+   mstack_t * stack = malloc(sizeof(mstack_t) + size * sizeof(match_t));
+   if (stack == NULL) return NULL;
+   stack->size = size;
+   stack->pos = 0;
+   return stack;
+}
+
+int
+stackAddMatch
+(
+ mstack_t ** stackp,
+ match_t    match
+)
+{
+   mstack_t * stack = *stackp;
+   // Realloc stack
+   if (stack->pos >= stack->size) {
+      size_t newsize = stack->size * 2;
+      *stackp = stack = realloc(stack, sizeof(mstack_t) + newsize * sizeof(match_t));
+      if (stack == NULL) return -1;
+      stack->size = newsize;
+   }
+
+   stack->match[stack->pos++] = match;
+   return 0;
+}
+
+
+int
+seeqAddMatch
+(
+ seeq_t  * sq,
+ match_t   match
+)
+{
+   return ctx_addmatch(&sq->ctx, match);
+}
+
+
+int
+ctx_addmatch
+(
+ seeq_ctx_t * ctx,
+ match_t      match
+)
+{
+   if (ctx->hits >= ctx->stacksize) {
+      size_t newsize = ctx->stacksize > 0 ? ctx->stacksize * 2 : 1;
+      match_t * stack = realloc(ctx->match, newsize * sizeof(match_t));
+      if (stack == NULL) return -1;
+      ctx->match = stack;
+      ctx->stacksize = newsize;
+   }
+
+   ctx->match[ctx->hits++] = match;
+   return 0;
+}
+
+
+match_t *
+seeqMatchIter
+(
+ seeq_t * sq
+)
+// SYNOPSIS:                                                              
+//   Iteratively returns the matches found in the last search.
+//                                                                        
+// PARAMETERS:                                                            
+//   sq: a seeq_t struct created with 'seeqNew()'.
+//
+// RETURN:                                                                
+//   A pointer to the match_t structure or NULL when sq is empty.
+//
+// SIDE EFFECTS:
+//   Decrements `sq->ctx.hits` on every call.
+{
+   return seeqCtxMatchIter(&sq->ctx);
+}
+
+match_t *
+seeqCtxMatchIter
+(
+ seeq_ctx_t * ctx
+)
+// SYNOPSIS:                                                              
+//   Same as 'seeqMatchIter', for the matches of a context (see 'seeqCtxNew').
+//                                                                        
+// PARAMETERS:                                                            
+//   ctx: a seeq_ctx_t struct created with 'seeqCtxNew()'.
+//
+// RETURN:                                                                
+//   A pointer to the match_t structure or NULL when ctx is empty.
+//
+// SIDE EFFECTS:
+//   Decrements `ctx->hits` on every call.
+{
+   if (ctx->hits == 0) return NULL;
+   return ctx->match + --ctx->hits;
+}
+
+char *
+seeqGetString
+(
+ seeq_t * sq
+)
+// SYNOPSIS:                                                              
+//   Returns a pointer to the last matched line.
+//                                                                        
+// PARAMETERS:                                                            
+//   sq: a seeq_t struct created with 'seeqNew()'.
+//
+// RETURN:                                                                
+//   Returns a pointer to the last matched line. The contents of the pointer will be
+//   modified if the passed structure is used to match again.
+//
+// SIDE EFFECTS:
+//   None.
+{
+   return sq->string;
+}
+
+const char *
+seeqPrintError
+(
+ void
+)
+// SYNOPSIS:                                                              
+//   Returns a description of the error produced in the last call to a libseeq function.
+//                                                                        
+// PARAMETERS:                                                            
+//   None.
+//
+// RETURN:                                                                
+//   A string with the error description.
+//
+// SIDE EFFECTS:
+//   None.
+{
+   if (seeqerr == 0) return strerror(errno);
+   else return seeq_strerror[seeqerr];
+}
+
+ 
+
+int
+parse
+(
+ const char * expr,
+       char * keys
+)
+// SYNOPSIS:                                                              
+//   Parses a pattern expression converting them into bytes, one for each
+//   matching position. The key byte is defined as follows:
+//
+//      bit0 (LSB): match 'A' or 'a'.
+//      bit1      : match 'C' or 'c'.
+//      bit2      : match 'G' or 'g'.
+//      bit3      : match 'T', 't', 'U' or 'u'.
+//      bit4      : match 'N' or 'n'.
+//      bit5..7   : not used.
+//
+//   Each key may have one or more bits set if different bases are allowed
+//   to match a single position. The expected input expression is a string
+//   containing nucleotides 'A','C','G','T','U' and 'N'. If one matching
+//   position allows more than one base, the matching bases must be enclosed
+//   in square brackets '[' ']'. For instance,
+//
+//      AC[AT]
+//
+//   would match a sequence containing A in the 1st position, C in the 2nd
+//   position and either A or T in the 3rd position. The associated keys
+//   would be
+//
+//      keys("AC[AT]") = {0x01, 0x02, 0x09}
+//
+//   If the expression contains 'N', that position will match any nucleotide,
+//   including 'N'.
+//                                                                        
+// PARAMETERS:                                                            
+//   expr: A null-terminated string containing the matching expression.
+//   keys: pointer to a previously allocated vector of chars. The size of the
+//         allocated region should be equal to strlen(expr).
+//                                                                        
+// RETURN:                                                                
+//   On success, parse returns the number of matching positions (keys) for the
+//   given expression, or -1 if an error occurred.
+//
+// SIDE EFFECTS:
+//   The contents of the pointer 'keys' are overwritten.
+{
+   // Set error to 0.
+   seeqerr = 0;
+   // Initialize keys to 0.
+   const int lmax = strlen(expr);
+   for (int l = 0; l < lmax; l++) keys[l] = 0;
+
+   int i = 0;
+   int l = 0;
+   int add = 0;
+   char c, lc = 0;
+   while((c = expr[i]) != 0 && l < lmax) {
+      if      (c == 'A' || c == 'a') keys[l] |= 0x01;
+      else if (c == 'C' || c == 'c') keys[l] |= 0x02;
+      else if (c == 'G' || c == 'g') keys[l] |= 0x04;
+      else if (c == 'T' || c == 't' || c == 'U' || c == 'u') keys[l] |= 0x08;
+      else if (c == 'N' || c == 'n') keys[l] |= 0x1F;
+      else if (c == '[') {
+         if (add) {
+            seeqerr = 2;
+            return -1;
+         }
+         add = 1;
+      }
+      else if (c == ']') {
+         if (!add) {
+            seeqerr = 3;
+            return -1;
+         }
+         if (lc == '[') l--;
+         add = 0;
+      }
+      else {
+         seeqerr = 4;
+         return -1;
+      }
+
+      if (!add) l++;
+      i++;
+      lc = c;
+   }
+   
+   if (add == 1) {
+      seeqerr = 5;
+      return -1;
+   }
+   else return l;
+}
+
+
+dfa_t *
+dfa_new
+(
+ int wlen,
+ int tau,
+ size_t vertices,
+ size_t trienodes,
+ size_t maxmemory
+)
+// SYNOPSIS:                                                              
+//   Creates and initializes a new dfa graph with a cache and a root vertices and the
+//   specified number of preallocated (empty) vertices. Initializes a trie of height wlen
+//   to store the alignment rows. The DFA network is initialized with the first
+//   NW-alignment row: [0 1 2 ... tau tau+1 tau+1 ... tau+1]. States 0 and 1 are the
+//   cache and root states, respectively.
+//                                                                        
+// PARAMETERS:                                                            
+//   wlen: length of the pattern as regurned by 'parse'.
+//   tau: mismatch threshold.
+//   vertices: the number of preallocated vertices.
+//   trienodes: initial size of the trie.
+//   maxmemory: DFA memory limit, in bytes.
+//                                                                        
+// RETURN:                                                                
+//   On success, the function returns a pointer to the new dfa_t structure.
+//   A NULL pointer is returned in case of error.
+//
+// SIDE EFFECTS:
+//   The returned dfa_t struct is allocated using malloc and must be manually freed.
+{
+   segment_t seg = {wlen, tau};
+   return dfa_newmulti(&seg, 1, DFA_LEVENSHTEIN, vertices, trienodes, maxmemory);
+}
+
+
+dfa_t *
+dfa_newmulti
+(
+ const segment_t * seg,
+ size_t            nseg,
+ int               metric,
+ size_t            vertices,
+ size_t            trienodes,
+ size_t            maxmemory
+)
+// SYNOPSIS:                                                              
+//   Same as 'dfa_new', for a set of patterns (see 'seeqNewMulti'). The rows
+//   of the states are the concatenation of the NW-alignment rows of all the
+//   patterns, each capped at its own distance. The match value of the states
+//   is the minimum over the patterns of the distance plus the difference
+//   between the largest distance and the distance of the pattern, so that
+//   the matching functions treat the set as a pattern with the largest
+//   distance. The rows of Hamming DFAs are the mismatch counts of the
+//   alignments (see 'ham_row'), the rows of DFA_STARTS DFAs also hold the
+//   lengths of the alignments (see 'start_row').
+//                                                                        
+// PARAMETERS:                                                            
+//   seg: length and mismatch threshold of each pattern.
+//   nseg: number of patterns.
+//   metric: DFA_LEVENSHTEIN, DFA_HAMMING or DFA_STARTS.
+//   vertices: the number of preallocated vertices.
+//   trienodes: initial size of the trie.
+//   maxmemory: DFA memory limit, in bytes.
+//                                                                        
+// RETURN:                                                                
+//   On success, the function returns a pointer to the new dfa_t structure.
+//   A NULL pointer is returned in case of error.
+//
+// SIDE EFFECTS:
+//   The returned dfa_t struct is allocated using malloc and must be manually freed.
+{
+   // Set error to 0.
+   seeqerr = 0;
+
+   if (vertices < 2) vertices = 2;
+   if (nseg < 1) return NULL;
+   // 'wlen' is the length of the rows.
+   int wlen = 0, tau = 0, mintomatch = seg[0].wlen;
+   for (size_t k = 0; k < nseg; k++) {
+      if (seg[k].wlen < 1 || seg[k].tau < 0) return NULL;
+      tau = seg[k].tau > tau ? seg[k].tau : tau;
+      if (metric == DFA_HAMMING) {
+         // No alignment has started yet.
+         wlen += seg[k].wlen * ham_width(seg[k].tau);
+         mintomatch = min(mintomatch, seg[k].wlen);
+      } else {
+         wlen += metric == DFA_STARTS ? seg[k].wlen * start_width(seg[k].tau) : seg[k].wlen;
+         mintomatch = min(mintomatch, seg[k].wlen - seg[k].tau);
+      }
+   }
+
+   // Allocate DFA.
+   dfa_t * dfa = malloc(sizeof(dfa_t));
+   if (dfa == NULL) {
+      return NULL;
+   }
+
+   // Fill struct.
+   dfa->pos  = 2;
+   dfa->maxmemory = maxmemory;
+   // Narrow vertices hold distances and lengths below 255.
+   dfa->state_size = wlen < 255 ? DFA_NARROW_SIZE : DFA_STATE_SIZE;
+   dfa->code_size = (size_t)wlen/5 + (wlen%5 > 0);
+   dfa->complete = 0;
+   dfa->used = NULL;
+   dfa->sweep = 0;
+   dfa->shared = 0;
+   dfa->refs = 1;
+   dfa->nseg = nseg;
+   dfa->seg  = NULL;
+   dfa->metric = metric;
+   dfa->pairs  = NULL;
+   dfa->npairs = 0;
+   dfa->hugepages = 0;
+   dfa->path_cache = NULL;
+   dfa->trie = NULL;
+
+   // Reserve the first slab of states.
+   size_t capacity = maxmemory > 0 ? maxmemory / (dfa->state_size + dfa->code_size) + 2 : ABS_MAX_POS;
+   if (dfa_reserve(dfa, capacity, vertices)) {
+      free(dfa);
+      return NULL;
+   }
+
+   // Path cache: current row (used in cache mode) and updated row.
+   dfa->path_cache = calloc(2*(size_t)wlen, sizeof(uint8_t));
+   dfa->trie = trie_new(trienodes, (size_t)wlen);
+
+   if (nseg > 1) {
+      dfa->seg = malloc(nseg * sizeof(segment_t));
+      if (dfa->seg != NULL) memcpy(dfa->seg, seg, nseg * sizeof(segment_t));
+   }
+
+   if (dfa->trie == NULL || (nseg > 1 && dfa->seg == NULL)) {
+      dfa_free(dfa);
+      return NULL;
+   }
+
+   // Initialize state 0 (cache) and state 1 (root).
+   for (uint32_t s = 0; s <= DFA_ROOT_STATE; s++) {
+      dfa_setmatch(dfa, s, set_mintomatch(mintomatch) | ((uint32_t) tau+1));
+      for (int i = 0; i < NBASES; i++) dfa_setnext(dfa, s, i, DFA_COMPUTE);
+   }
+
+   // Allocate memory for path and its encoded version.
+   uint8_t * path = malloc((size_t)wlen);
+   if (path == NULL || dfa->path_cache == NULL) {
+      free(path); dfa_free(dfa);
+      return NULL;
+   }
+
+   // Compute initial alignment.
+   for (size_t k = 0, off = 0; k < nseg; k++) {
+      if (metric == DFA_HAMMING) {
+         // All the counts at tau+1.
+         int w = ham_width(seg[k].tau);
+         for (int i = 0; i < seg[k].wlen; i++) {
+            for (int j = w-1, c = seg[k].tau+1; j >= 0; j--, c /= 3) path[off+j] = (uint8_t)(c % 3);
+            off += (size_t)w;
+         }
+      } else if (metric == DFA_STARTS) {
+         // The first i+1 bases of the pattern are deleted (no text base).
+         int t = seg[k].tau, w = start_width(t);
+         for (int i = 0; i < seg[k].wlen; i++) {
+            int v = i < t ? 1 + (i+1)*(2*t+1) + t-i-1 : 0;
+            for (int j = w-1; j >= 0; j--, v /= 3) path[off+j] = (uint8_t)(v % 3);
+            off += (size_t)w;
+         }
+      } else {
+         for (int i = 0; i < seg[k].wlen; i++) path[off+i] = i <= seg[k].tau ? 2 : 1;
+         off += (size_t)seg[k].wlen;
+      }
+   }
+
+   // Compute differential code of the path.
+   path_encode(path,state_code(dfa, DFA_ROOT_STATE),(size_t)wlen);
+
+   // Insert initial state into trie.
+   if (trie_insert(dfa, path, 1)) {
+      free(path); dfa_free(dfa);
+      return NULL;
+   }
+   // The root row is also the initial content of the cache.
+   memcpy(dfa->path_cache, path, (size_t)wlen);
+   free(path);
+
+   return dfa;
+}
+
+
+int
+dfa_reserve
+(
+ dfa_t  * dfa,
+ size_t   capacity,
+ size_t   vertices
+)
+// SYNOPSIS:                                                              
+//   Reserves the first slab of states of a DFA (see 'dfa_grow'). The states
+//   are at the beginning of the slab and the codes start after the last
+//   state. The room for the states is reserved for wide vertices (see
+//   'dfa_widen'). The slab holds DFA_SLAB_STATES states, or 'capacity'
+//   rounded to whole pages if it is smaller.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa      : pointer to the DFA, with 'state_size' and 'code_size' set.
+//   capacity : maximum number of states.
+//   vertices : number of states that are usable on return.
+//                                                                        
+// RETURN:                                                                
+//   On success the function returns 0, -1 is returned if an error occurred.
+//
+// SIDE EFFECTS:
+//   Sets 'map', 'mapsize', 'states', 'codes', 'nflat', 'slab', 'capacity'
+//   and 'size'.
+{
+   // Set error to 0.
+   seeqerr = 0;
+
+   size_t unit = (size_t) sysconf(_SC_PAGESIZE) / DFA_STATE_SIZE;
+   if (unit < 1) unit = 1;
+   if (capacity > ABS_MAX_POS) capacity = ABS_MAX_POS;
+   if (capacity < vertices) capacity = vertices;
+   size_t nflat = capacity < DFA_SLAB_STATES ? (capacity + unit - 1) / unit * unit : DFA_SLAB_STATES;
+
+   dfa->mapsize  = nflat * (DFA_STATE_SIZE + dfa->code_size);
+   dfa->map      = mem_reserve(dfa->mapsize);
+   dfa->slab     = NULL;
+   dfa->size     = 0;
+   if (dfa->map == NULL) return -1;
+
+   dfa->states   = dfa->map;
+   dfa->codes    = dfa->states + nflat * DFA_STATE_SIZE;
+   dfa->nflat    = nflat;
+   dfa->capacity = capacity;
+   return dfa_grow(dfa, vertices);
+}
+
+int
+dfa_grow
+(
+ dfa_t  * dfa,
+ size_t   size
+)
+// SYNOPSIS:                                                              
+//   Makes the first 'size' states of a DFA usable. The first slab (see
+//   'dfa_reserve') is committed up to 'size', and the states after it are
+//   stored in new slabs of DFA_SLAB_STATES states. The states never move,
+//   so the threads that read a shared DFA are not disturbed.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa  : pointer to the DFA.
+//   size : number of usable states.
+//                                                                        
+// RETURN:                                                                
+//   On success the function returns 0, -1 is returned if an error occurred.
+//
+// SIDE EFFECTS:
+//   Updates 'size', rounded up to whole slabs after the first one. The
+//   directory of the slabs is allocated when the second slab is added.
+{
+   // Set error to 0.
+   seeqerr = 0;
+
+   size_t flat = min(size, dfa->nflat);
+   if (flat > dfa->size) {
+      if (mem_commit(dfa->states, flat * dfa->state_size) ||
+          mem_commit(dfa->codes, flat * dfa->code_size)) return -1;
+      dfa->size = flat;
+   }
+
+   size_t slabsize = DFA_SLAB_STATES * (DFA_STATE_SIZE + dfa->code_size);
+   while (dfa->size < size) {
+      if (dfa->slab == NULL) {
+         dfaslab_t * slab = calloc((dfa->capacity >> DFA_SLAB_SHIFT) + 1, sizeof(dfaslab_t));
+         if (slab == NULL) return -1;
+         slab[0].states = dfa->states;
+         slab[0].codes  = dfa->codes;
+         dfa->slab = slab;
+      }
+      uint8_t * map = mem_reserve(slabsize);
+      if (map == NULL) return -1;
+      if (mem_commit(map, slabsize)) {
+         munmap(map, slabsize);
+         return -1;
+      }
+#ifdef MADV_HUGEPAGE
+      if (dfa->hugepages) madvise(map, slabsize, MADV_HUGEPAGE);
+#endif
+      dfa->slab[dfa->size >> DFA_SLAB_SHIFT] = (dfaslab_t) {map, map + DFA_SLAB_STATES * DFA_STATE_SIZE};
+      dfa->size += DFA_SLAB_STATES;
+   }
+
+   return 0;
+}
+
+int
+dfa_flatten
+(
+ dfa_t * dfa
+)
+// SYNOPSIS:                                                              
+//   Copies the states of a complete DFA that uses more than one slab (see
+//   'dfa_grow') to a single range, so that all the states are read without
+//   the slab directory (see 'state_vertex' and 'batch_gather'). Complete
+//   DFAs do not grow, so the states do not need to be in slabs any more.
+//   The DFA is left in slabs if the range cannot be allocated.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa : pointer to a complete DFA, not shared yet.
+//                                                                        
+// RETURN:                                                                
+//   Returns 0 if the DFA is in one range, 1 if it is left in slabs.
+//
+// SIDE EFFECTS:
+//   The slabs are released.
+{
+   if (dfa->pos <= dfa->nflat) return 0;
+
+   size_t mapsize = dfa->pos * (dfa->state_size + dfa->code_size);
+   uint8_t * map = mem_reserve(mapsize);
+   if (map == NULL) return 1;
+   if (mem_commit(map, mapsize)) {
+      munmap(map, mapsize);
+      return 1;
+   }
+
+   uint8_t * states = map;
+   uint8_t * codes  = map + dfa->pos * dfa->state_size;
+   for (size_t s = 0; s < dfa->pos; s += DFA_SLAB_STATES) {
+      size_t n = min(dfa->pos - s, DFA_SLAB_STATES);
+      memcpy(states + s * dfa->state_size, state_vertex(dfa, s), n * dfa->state_size);
+      memcpy(codes + s * dfa->code_size, state_code(dfa, s), n * dfa->code_size);
+   }
+
+   size_t slabsize = DFA_SLAB_STATES * (DFA_STATE_SIZE + dfa->code_size);
+   for (size_t k = 1; k < dfa->size >> DFA_SLAB_SHIFT; k++) munmap(dfa->slab[k].states, slabsize);
+   free(dfa->slab);
+   munmap(dfa->map, dfa->mapsize);
+
+   dfa->map      = map;
+   dfa->mapsize  = mapsize;
+   dfa->states   = states;
+   dfa->codes    = codes;
+   dfa->slab     = NULL;
+   dfa->size     = dfa->pos;
+   dfa->nflat    = dfa->pos;
+   dfa->capacity = dfa->pos;
+   return 0;
+}
+
+int
+dfa_step
+(
+ uint32_t   dfa_state,
+ int        base,
+ int        plen,
+ int        tau,
+ dfa_t   ** dfap,
+ char     * exp,
+ scratch_t * scratch,
+ uint32_t * dfa_next
+)
+// SYNOPSIS:                                                              
+//   Updates the current status of DFA graph. Based on the parameters passed,
+//   the function will compute the next row of the Needleman-Wunsch matrix and
+//   update the graph accordingly. If the new row points to an already-known
+//   state, the two existing vertices will be linked with an edge. Otherwise,
+//   a new vertex will be created for the new row.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa_state : current state of the DFA.
+//   base      : next base to resolve (0 for 'A', 1 for 'C', 2 for 'G', 3 for 'T'/'U' and 4 for 'N').
+//   plen      : length of the pattern, as returned by 'parse()'.
+//   tau       : Levenshtein distance threshold.
+//   dfap      : pointer to a memory space containing the address of the DFA.
+//   exp       : expression keys, as returned by parse.
+//   scratch   : private scratch of the caller for shared DFAs (see 'seeqClone'),
+//               or NULL to use the scratch of the DFA.
+//   dfa_next  : a pointer to an uint32_t where the computed DFA transition will be placed,
+//
+// RETURN:                                                                
+//   dfa_step returns 0 on success, or -1 if an error occurred.
+//
+// SIDE EFFECTS:
+//   New states may be added to the DFA. The contents of *dfa_next will be
+//   overriden. For shared DFAs, the new states and transitions are computed
+//   under the DFA lock and the transitions are published with 'dfa_link'.
+{
+   // Set error to 0.
+   seeqerr = 0;
+
+   uint32_t state = dfa_state;
+   dfa_t    * dfa = *dfap;
+   int      value = 1 << base;
+
+   // Code reference.
+   uint8_t  * code   = state_code(dfa, state);
+
+   // Return next vertex if already computed.
+   uint32_t next = state_next(dfa, state, base);
+   if (next != DFA_COMPUTE) {
+      *dfa_next = next;
+      return 0;
+   }
+   
+   // The updated row is written after the current one in the path cache.
+   // In cached mode the current row is the last row computed (already in
+   // the path cache).
+   size_t     rlen = dfa->trie->height;
+   uint8_t  * old  = scratch != NULL ? scratch->path : dfa->path_cache;
+   uint8_t  * path = old + rlen;
+
+   // Update row.
+   uint32_t match;
+   if (dfa->seg == NULL && dfa->metric == DFA_LEVENSHTEIN) {
+      int mintomatch;
+      int dist = nw_row(state != 0 ? code : NULL, old, path, exp, value, plen, tau, &mintomatch);
+      match = ((uint32_t)dist | set_mintomatch(mintomatch));
+   } else {
+      // Pattern sets, Hamming and DFA_STARTS DFAs: the row of each pattern
+      // is updated on its own (see 'dfa_newmulti').
+      if (state != 0) path_decode(code, old, rlen);
+      segment_t one = {plen, tau};
+      const segment_t * seg = dfa->seg != NULL ? dfa->seg : &one;
+      int dist = tau + 1, mintomatch = plen;
+      for (size_t k = 0, off = 0, e = 0; k < dfa->nseg; e += (size_t)seg[k++].wlen) {
+         int m, d;
+         if (dfa->metric == DFA_HAMMING) {
+            d = ham_row(old + off, path + off, exp + e, value, seg[k].wlen, seg[k].tau, &m);
+            off += (size_t)(seg[k].wlen * ham_width(seg[k].tau));
+         } else if (dfa->metric == DFA_STARTS) {
+            d = start_row(old + off, path + off, exp + e, value, seg[k].wlen, seg[k].tau, &m);
+            off += (size_t)(seg[k].wlen * start_width(seg[k].tau));
+         } else {
+            d = nw_row(NULL, old + off, path + off, exp + e, value, seg[k].wlen, seg[k].tau, &m);
+            off += (size_t)seg[k].wlen;
+         }
+         dist       = min(dist, d + tau - seg[k].tau);
+         mintomatch = min(mintomatch, m);
+      }
+      match = ((uint32_t)dist | set_mintomatch(mintomatch));
+   }
+
+   // The rows are computed without locking. The trie and the new states
+   // of shared DFAs are only modified by one thread at a time.
+   if (dfa->shared) pthread_mutex_lock(&dfa->lock);
+
+   // Check if this state already exists.
+   uint32_t dfalink;
+   int retval = 0;
+
+   // UPDATE:
+   // The entire DFA should be passed to find the remaining path stored
+   // in the DFA node (using path_compare).
+   int exists = trie_search(dfa, path, &dfalink, rlen);
+
+   if (exists == 1) {
+      // If exists, just link with the existing state.
+      *dfa_next = state != 0 ? dfa_link(dfa, state, base, dfalink) : dfalink;
+   } else if (exists == 0) {
+      // Leave cache mode if there is room for the new state (see 'dfa_evict').
+      retval = dfa_newstate(dfap, path, match, base, state);
+      // The new state is the last one. Set to cache mode if max
+      // memory is reached.
+      *dfa_next = retval == 0 ? (uint32_t)((*dfap)->pos - 1) : 0;
+   }
+
+   if (dfa->shared) pthread_mutex_unlock(&dfa->lock);
+   if (exists == -1 || retval == -1) return -1;
+
+   // Look for unused states from time to time in cache mode.
+   if (*dfa_next == 0 && dfa->used != NULL && ++dfa->sweep >= DFA_SWEEP_PERIOD * dfa->pos) {
+      dfa->sweep = 0;
+      if (dfa_evict(dfa)) return -1;
+   }
+
+   // Keep the row in the cache if running in cached mode.
+   if (*dfa_next == 0) {
+      if (scratch != NULL) scratch->s0->match = match;
+      else dfa_setmatch(*dfap, 0, match);
+      memcpy(old, path, rlen);
+   }
+
+   return 0;
+}
+
+
+int
+nw_row
+(
+ const uint8_t * code,
+ uint8_t       * old,
+ uint8_t       * path,
+ const char    * exp,
+ int             value,
+ int             plen,
+ int             tau,
+ int           * mintomatch
+)
+// SYNOPSIS:                                                              
+//   Computes the next row of the Needleman-Wunsch matrix of a pattern, capped
+//   at tau+1, and writes its path (differential values) in 'path'.
+//                                                                        
+// PARAMETERS:                                                            
+//   code       : differential code of the current row (see 'path_encode'),
+//                or NULL if the current row is in 'old'.
+//   old        : current row path. Overwritten with the decoded 'code' if
+//                the pattern is longer than BITPAR_MAX_PLEN.
+//   path       : updated row path.
+//   exp        : expression keys, as returned by parse.
+//   value      : text base, as a key bit (1 << base).
+//   plen       : length of the pattern.
+//   tau        : Levenshtein distance threshold.
+//   mintomatch : pointer to an int where the minimum number of text bases
+//                to reach a match will be placed.
+//
+// RETURN:                                                                
+//   Returns the distance of the updated row (the capped value of its last cell).
+//
+// SIDE EFFECTS:
+//   None.
+{
+   // The update is done without the tau+1 cap, which is applied to the
+   // absolute value of the updated cells as they are emitted (capping
+   // the input row or the output row yields the same result).
+   const int cap = tau + 1;
+   int score = 0, prev = 0;
+   int last_active = 1;
+
+   if (plen <= BITPAR_MAX_PLEN) {
+      // Bit-parallel kernel (Myers/Hyyro). The vertical differentials of
+      // the row are held in two words, 'pv' (+1) and 'mv' (-1), and the
+      // whole row is updated with a few word operations.
+      uint64_t pv = 0, mv = 0, eq = 0;
+      if (code != NULL) {
+         for (int i = 0; i < plen; i += 5) {
+            uint16_t bits = code_bits[code[i/5]];
+            pv |= (uint64_t)(bits & 0xFF) << i;
+            mv |= (uint64_t)(bits >> 8) << i;
+         }
+      } else {
+         for (int i = 0; i < plen; i++) {
+            pv |= (uint64_t)(old[i] == 2) << i;
+            mv |= (uint64_t)(old[i] == 0) << i;
+         }
+      }
+      for (int i = 0; i < plen; i++) eq |= (uint64_t)((value & exp[i]) != 0) << i;
+
+      // Text position above the first row is always 0 (semi-global
+      // alignment), hence no horizontal differential is shifted in.
+      uint64_t xv = eq | mv;
+      uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+      uint64_t ph = mv | ~(xh | pv);
+      uint64_t mh = pv & xh;
+      ph <<= 1;
+      mh <<= 1;
+      pv = mh | ~(xv | ph);
+      mv = ph & xv;
+
+      // Emit the path applying the cap.
+      for (int i = 0; i < plen; i++) {
+         score += (int)((pv >> i) & 1) - (int)((mv >> i) & 1);
+         int capped = min(score, cap);
+         path[i] = (uint8_t)(capped - prev + 1);
+         prev    = capped;
+         if (capped <= tau) last_active = i + 1;
+      }
+   } else {
+      // Restore alignment if not running in cached mode.
+      if (code != NULL) path_decode(code, old, (size_t)plen);
+
+      // Scalar kernel for long patterns. The row is updated from its
+      // differential encoding using the precomputed table 'nw_update'.
+      // Only the horizontal differential (updated row - current row) is
+      // carried from one cell to the next and the alignment scores are
+      // never restored.
+      int h = 1;
+      for (int i = 0; i < plen; i++) {
+         uint8_t t = nw_update[h][old[i]][(value & exp[i]) == 0];
+         h      = t >> 2;
+         score += (t & 3) - 1;
+         int capped = min(score, cap);
+         path[i] = (uint8_t)(capped - prev + 1);
+         prev    = capped;
+         if (capped <= tau) last_active = i + 1;
+      }
+   }
+
+   *mintomatch = plen - last_active;
+   return prev;
+}
+
+
+int
+ham_row
+(
+ const uint8_t * old,
+ uint8_t       * path,
+ const char    * exp,
+ int             value,
+ int             plen,
+ int             tau,
+ int           * mintomatch
+)
+// SYNOPSIS:                                                              
+//   Computes the next row of a Hamming DFA (substitutions only). Cell i of
+//   the row is the number of mismatches of the alignment of the first i+1
+//   bases of the pattern that ends at the current text base, capped at
+//   tau+1. Alignments only move along their diagonal, so each cell is the
+//   previous cell of the current row plus the mismatch of the text base.
+//                                                                        
+// PARAMETERS:                                                            
+//   old        : current row (see 'ham_width').
+//   path       : updated row.
+//   exp        : expression keys, as returned by parse.
+//   value      : text base, as a key bit (1 << base).
+//   plen       : length of the pattern.
+//   tau        : mismatch threshold.
+//   mintomatch : pointer to an int where the minimum number of text bases
+//                to reach a match will be placed.
+//
+// RETURN:                                                                
+//   Returns the distance of the updated row (the value of its last cell).
+//
+// SIDE EFFECTS:
+//   None.
+{
+   const int cap = tau + 1;
+   const int w   = ham_width(tau);
+   // An alignment starts at every text base.
+   int diag = 0, count = 0;
+   int last_active = 0;
+
+   for (int i = 0; i < plen; i++) {
+      count = min(diag + ((value & exp[i]) == 0), cap);
+      diag  = 0;
+      for (int j = 0; j < w; j++) diag = 3*diag + old[i*w+j];
+      for (int j = w-1, c = count; j >= 0; j--, c /= 3) path[i*w+j] = (uint8_t)(c % 3);
+      if (count <= tau) last_active = i + 1;
+   }
+
+   *mintomatch = plen - last_active;
+   return count;
+}
+
+
+int
+ham_width
+(
+ int tau
+)
+// SYNOPSIS:                                                              
+//   Number of base-3 digits of the cells of a Hamming row, so that the
+//   counts from 0 to tau+1 fit in the trie symbols.
+//                                                                        
+// PARAMETERS:                                                            
+//   tau : mismatch threshold.
+//
+// RETURN:                                                                
+//   Returns the number of digits per cell.
+//
+// SIDE EFFECTS:
+//   None.
+{
+   int w = 1;
+   for (int n = 3; n < tau + 2; n *= 3) w++;
+   return w;
+}
+
+
+int
+start_row
+(
+ const uint8_t * old,
+ uint8_t       * path,
+ const char    * exp,
+ int             value,
+ int             plen,
+ int             tau,
+ int           * mintomatch
+)
+// SYNOPSIS:                                                              
+//   Computes the next row of a DFA_STARTS DFA (see SQ_FWDSTART). The rows
+//   are the NW-alignment rows capped at tau+1, as in 'nw_row', and each
+//   cell also holds the number of text bases of the shortest alignment of
+//   that distance, so that the start of the matches is known in the same
+//   pass. The length of the alignment of the first i bases of the pattern
+//   is within the distance of i, cell i-1 holds 0 if the distance is
+//   tau+1, or 1 + distance*(2*tau+1) + length-i+tau otherwise, written
+//   with 'start_width' base-3 digits.
+//                                                                        
+// PARAMETERS:                                                            
+//   old        : current row.
+//   path       : updated row.
+//   exp        : expression keys, as returned by parse.
+//   value      : text base, as a key bit (1 << base).
+//   plen       : length of the pattern.
+//   tau        : Levenshtein distance threshold.
+//   mintomatch : pointer to an int where the minimum number of text bases
+//                to reach a match will be placed.
+//
+// RETURN:                                                                
+//   Returns the distance of the updated row (the value of its last cell).
+//
+// SIDE EFFECTS:
+//   None.
+{
+   const int cap  = tau + 1;
+   const int span = 2*tau + 1;
+   const int w    = start_width(tau);
+   // The empty prefix of the pattern aligns with no text base.
+   int diag = 0, diag_len = 0;
+   int left = 0, left_len = 0;
+   int last_active = 0;
+
+   for (int i = 0; i < plen; i++) {
+      int v = 0, up_len = 0;
+      for (int j = 0; j < w; j++) v = 3*v + old[i*w+j];
+      int up = start_cell(v, i+1, tau, &up_len);
+      // Lowest distance, then shortest alignment: substitution, the text
+      // base inserted or the pattern base deleted.
+      int d = diag + ((value & exp[i]) == 0), len = diag_len + 1;
+      if (up + 1 < d || (up + 1 == d && up_len + 1 < len)) {
+         d   = up + 1;
+         len = up_len + 1;
+      }
+      if (left + 1 < d || (left + 1 == d && left_len < len)) {
+         d   = left + 1;
+         len = left_len;
+      }
+      diag = up;
+      diag_len = up_len;
+      left = min(d, cap);
+      left_len = len;
+      v = 0;
+      if (d <= tau) {
+         v = 1 + d*span + len - (i+1) + tau;
+         last_active = i + 1;
+      }
+      for (int j = w-1; j >= 0; j--, v /= 3) path[i*w+j] = (uint8_t)(v % 3);
+   }
+
+   *mintomatch = plen - last_active;
+   return left;
+}
+
+
+int
+start_width
+(
+ int tau
+)
+// SYNOPSIS:                                                              
+//   Number of base-3 digits of the cells of a DFA_STARTS row (see
+//   'start_row').
+//                                                                        
+// PARAMETERS:                                                            
+//   tau : Levenshtein distance threshold.
+//
+// RETURN:                                                                
+//   Returns the number of digits per cell.
+//
+// SIDE EFFECTS:
+//   None.
+{
+   int w = 1;
+   for (long n = 3; n < (long)(tau+1)*(2*tau+1) + 1; n *= 3) w++;
+   return w;
+}
+
+
+int
+state_start
+(
+ const dfa_t     * dfa,
+ uint32_t          state,
+ const scratch_t * scratch,
+ int               plen,
+ int               tau
+)
+// SYNOPSIS:                                                              
+//   Length of the shortest alignment of the pattern that ends at a state of
+//   a DFA_STARTS DFA (see 'start_row'), read from the last cell of its row.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa     : the DFA.
+//   state   : DFA state, with a distance lower than tau+1.
+//   scratch : private scratch for shared DFAs (see 'dfa_step'), or NULL.
+//   plen    : length of the pattern.
+//   tau     : Levenshtein distance threshold.
+//
+// RETURN:                                                                
+//   Returns the length of the alignment, in text bases.
+//
+// SIDE EFFECTS:
+//   None.
+{
+   static const uint8_t power[5] = {81,27,9,3,1};
+   const int w = start_width(tau);
+   // The row of the state 0 is the last row computed (see 'dfa_step').
+   const uint8_t * row  = scratch != NULL ? scratch->path : dfa->path_cache;
+   const uint8_t * code = state_code(dfa, state);
+   int v = 0, len = 0;
+   for (size_t i = (size_t)((plen-1)*w); i < (size_t)(plen*w); i++)
+      v = 3*v + (state == 0 ? row[i] : code[i/5] / power[i%5] % 3);
+   start_cell(v, plen, tau, &len);
+   return len;
+}
+
+
+uint32_t
+dfa_newvertex
+(
+ dfa_t   ** dfap
+)
+// SYNOPSIS:                                                              
+//   Adds a new vertex to the dfa graph. The new vertex is not linked to any other
+//   vertex in any way, so the connection must be done manually.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfap : pointer to a memory space containing the address of the DFA.
+//                                                                        
+// RETURN:                                                                
+//   On success, the function returns the id of the new vertex. In case of error
+//   the function returns U32T_ERROR.
+//
+// SIDE EFFECTS:
+//   If the dfa has reached its maximum size, the first slab grows doubling
+//   its size, or a new slab is added. The states are never moved (see
+//   'dfa_grow').
+{
+   // Set error to 0.
+   seeqerr = 0;
+
+   dfa_t * dfa = *dfap;
+
+   // Widen the vertices when the ids do not fit.
+   if (dfa_narrow(dfa) && dfa->pos >= DFA_NARROW_COMPUTE && dfa_widen(dfa)) return U32T_ERROR;
+
+   // Create new vertex in DFA graph.
+   if (dfa->pos >= dfa->size) {
+      size_t newsize = dfa->size < dfa->nflat ? dfa->size * 2 : dfa->size + DFA_SLAB_STATES;
+      if (newsize > dfa->capacity) newsize = dfa->capacity;
+      if (dfa->pos >= newsize) return U32T_ERROR;
+      if (dfa_grow(dfa, newsize)) return U32T_ERROR;
+   }
+
+   // Initialize DFA vertex.
+   dfa_setmatch(dfa, (uint32_t)dfa->pos, DFA_COMPUTE);
+   for (int j = 0; j < NBASES; j++) dfa_setnext(dfa, (uint32_t)dfa->pos, j, DFA_COMPUTE);
+
+   // Increase counter.
+   return (uint32_t)(dfa->pos++);
+}
+
+int
+dfa_precompile
+(
+ dfa_t   ** dfap,
+ int        plen,
+ int        tau,
+ char     * exp
+)
+// SYNOPSIS:                                                              
+//   Computes all the states reachable from the DFA root and all their
+//   transitions. States are explored in breadth-first order, so that the
+//   DFA is filled with the states closest to the root if the memory limit
+//   is reached before the exploration is complete.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfap      : pointer to a memory space containing the address of the DFA.
+//   plen      : length of the pattern, as returned by 'parse()'.
+//   tau       : Levenshtein distance threshold.
+//   exp       : expression keys, as returned by parse.
+//
+// RETURN:                                                                
+//   Returns 0 if the DFA is complete, 1 if the memory limit was reached
+//   before completion or -1 if an error occurred.
+//
+// SIDE EFFECTS:
+//   New states are added to the DFA. The 'complete' flag of the DFA is
+//   set if all the transitions have been computed.
+{
+   // New states are appended to the DFA, the loop ends when
+   // all the states have been expanded.
+   for (size_t state = DFA_ROOT_STATE; state < (*dfap)->pos; state++) {
+      for (int base = 0; base < NBASES; base++) {
+         uint32_t next;
+         if (dfa_step((uint32_t) state, base, plen, tau, dfap, exp, NULL, &next)) return -1;
+         // Memory limit reached (cache mode).
+         if (next == 0) return 1;
+      }
+   }
+
+   (*dfap)->complete = 1;
+   dfa_flatten(*dfap);
+   return 0;
+}
+
+int
+dfa_newstate
+(
+ dfa_t   ** dfap,
+ uint8_t  * path,
+ uint32_t   match,
+ int        edge,
+ size_t     dfa_state
+)
+// SYNOPSIS:                                                              
+//   Creates a new vertex to allocate a new DFA state, which represents an 
+//   unseen NW alignment row. This function inserts the new NW alignment row in
+//   the trie and connects the new vertex with its origin (the current DFA state).
+//   The vertex is connected once it is complete, so that threads matching with
+//   a shared DFA never see a partially initialized state. The new vertex is
+//   not connected if the current DFA state is the state 0 (cache mode).
+//                                                                        
+// PARAMETERS:                                                            
+//   dfap      : pointer to a memory space containing the address of the DFA.
+//   path      : path of the trie that represents the new NW alignment.
+//   match     : match value of the new state.
+//   edge      : the edge slot to use of the current DFA state.
+//   dfa_state : current DFA state.
+//                                                                        
+// RETURN:                                                                
+//   On success, the function returns 0, 1 when the memory limit
+//   has been reached or -1 if an error occurred. The new state is the
+//   last state of the DFA.
+//
+// SIDE EFFECTS:
+//   The state array and the trie may grow. Existing states are not moved.
+{
+   // Set error to 0.
+   seeqerr = 0;
+
+   dfa_t  * dfa  = *dfap;
+   trie_t * trie = dfa->trie;
+
+   // Check memory usage.
+   size_t memory = dfa->pos * (dfa->state_size + dfa->code_size); // DFA memory.
+   memory += trie->pos * sizeof(node_t); // Trie memory.
+   if (dfa->maxmemory > 0 && memory > dfa->maxmemory) return 1;
+   // Absolute memory limit (reserved addresses). Inserting a path
+   // takes at most one trie node per level.
+   if (dfa->pos >= dfa->capacity) return 1;
+   if (trie->pos + trie->height >= ABS_MAX_POS) return 1;
+
+   // Create new vertex in dfa graph.
+   uint32_t vertexid = dfa_newvertex(dfap);
+   if (vertexid == U32T_ERROR) return -1;
+
+   // Encode path.
+   path_encode(path, state_code(*dfap, vertexid), (*dfap)->trie->height);
+   dfa_setmatch(*dfap, vertexid, match);
+
+   // Insert new state in the trie.
+   if (trie_insert(*dfap, path, vertexid)) {
+      // Delete DFA state.
+      (*dfap)->pos--;
+      return -1;
+   }
+
+   // Connect dfa vertices.
+   if (dfa_state != 0) dfa_link(*dfap, (uint32_t)dfa_state, edge, vertexid);
+
+   return 0;
+}
+
+uint32_t
+dfa_link
+(
+ dfa_t    * dfa,
+ uint32_t   state,
+ int        edge,
+ uint32_t   next
+)
+// SYNOPSIS:                                                              
+//   Publishes the transition of 'state' through 'edge'. The transition is
+//   set with an atomic compare-and-swap, so that threads matching with a
+//   shared DFA see it only after the target state has been written. If the
+//   transition was already set, it is left unchanged.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa    : the DFA.
+//   state  : origin DFA state.
+//   edge   : the edge slot of the vertex (base).
+//   next   : target DFA state.
+//                                                                        
+// RETURN:                                                                
+//   Returns the DFA state linked through 'edge'.
+//
+// SIDE EFFECTS:
+//   None.
+{
+   if (dfa_narrow(dfa)) {
+      uint16_t expected = DFA_NARROW_COMPUTE;
+      uint16_t * slot = ((vertex16_t *) state_vertex(dfa, state))->next + edge;
+      if (__atomic_compare_exchange_n(slot, &expected, (uint16_t) next, 0,
+                                      __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+         return next;
+      return expected;
+   }
+   uint32_t expected = DFA_COMPUTE;
+   uint32_t * slot = ((vertex_t *) state_vertex(dfa, state))->next + edge;
+   if (__atomic_compare_exchange_n(slot, &expected, next, 0,
+                                   __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+      return next;
+   return expected;
+}
+
+void
+dfa_setmatch
+(
+ dfa_t    * dfa,
+ uint32_t   state,
+ uint32_t   match
+)
+// SYNOPSIS:                                                              
+//   Sets the match value (distance and min-to-match) of a DFA state.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa    : the DFA.
+//   state  : DFA state.
+//   match  : match value, as in 'vertex_t'.
+//                                                                        
+// RETURN:                                                                
+//   None.
+//
+// SIDE EFFECTS:
+//   None.
+{
+   if (dfa_narrow(dfa))
+      ((vertex16_t *) state_vertex(dfa, state))->match = match == DFA_COMPUTE ?
+         DFA_NARROW_COMPUTE : (uint16_t) (get_match(match) | get_mintomatch(match) << 8);
+   else
+      ((vertex_t *) state_vertex(dfa, state))->match = match;
+}
+
+void
+dfa_setnext
+(
+ dfa_t    * dfa,
+ uint32_t   state,
+ int        edge,
+ uint32_t   next
+)
+// SYNOPSIS:                                                              
+//   Sets the transition of a DFA state through 'edge'. Unlike 'dfa_link',
+//   the transition is overwritten and is not published to other threads.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa    : the DFA.
+//   state  : origin DFA state.
+//   edge   : the edge slot of the vertex (base).
+//   next   : target DFA state or DFA_COMPUTE.
+//                                                                        
+// RETURN:                                                                
+//   None.
+//
+// SIDE EFFECTS:
+//   None.
+{
+   if (dfa_narrow(dfa))
+      ((vertex16_t *) state_vertex(dfa, state))->next[edge] =
+         next == DFA_COMPUTE ? DFA_NARROW_COMPUTE : (uint16_t) next;
+   else
+      ((vertex_t *) state_vertex(dfa, state))->next[edge] = next;
+}
+
+int
+dfa_widen
+(
+ dfa_t * dfa
+)
+// SYNOPSIS:                                                              
+//   Converts the narrow vertices of a DFA (see 'vertex16_t') to the wide
+//   layout. The vertices are converted in place, from the last to the
+//   first, so that no vertex is overwritten before it is read.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa    : the DFA.
+//                                                                        
+// RETURN:                                                                
+//   Returns 0 on success, -1 if the memory could not be committed.
+//
+// SIDE EFFECTS:
+//   The state size of the DFA is set to DFA_STATE_SIZE.
+{
+   if (!dfa_narrow(dfa)) return 0;
+   if (mem_commit(dfa->states, dfa->size * DFA_STATE_SIZE) == -1) {
+      seeqerr = 1;
+      return -1;
+   }
+   for (size_t i = dfa->pos; i-- > 0;) {
+      vertex16_t narrow = *(vertex16_t *) (dfa->states + i * DFA_NARROW_SIZE);
+      vertex_t * wide = (vertex_t *) (dfa->states + i * DFA_STATE_SIZE);
+      wide->match = narrow.match == DFA_NARROW_COMPUTE ? DFA_COMPUTE :
+         set_mintomatch(narrow.match >> 8) | (narrow.match & 0xFF);
+      for (int j = 0; j < NBASES; j++)
+         wide->next[j] = narrow.next[j] == DFA_NARROW_COMPUTE ? DFA_COMPUTE : narrow.next[j];
+   }
+   dfa->state_size = DFA_STATE_SIZE;
+   return 0;
+}
+
+void
+dfa_hugepages
+(
+ dfa_t * dfa
+)
+// SYNOPSIS:                                                              
+//   Advises the system to store the states and the trie of a DFA in
+//   transparent huge pages (see SQ_HUGEPAGES). The advice only applies
+//   to the pages that have not been used yet.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa : pointer to the DFA.
+//
+// RETURN:                                                                
+//   None.
+//
+// SIDE EFFECTS:
+//   None.
+{
+#ifdef MADV_HUGEPAGE
+   madvise(dfa->map, dfa->mapsize, MADV_HUGEPAGE);
+   madvise(dfa->trie->nodes, dfa->trie->mapsize, MADV_HUGEPAGE);
+   // The slabs added later (see 'dfa_grow').
+   dfa->hugepages = 1;
+   dfa->trie->hugepages = 1;
+#else
+   (void) dfa;
+#endif
+}
+
+
+int
+dfa_stride
+(
+ dfa_t * dfa
+)
+// SYNOPSIS:                                                              
+//   Adds a table of 2-base transitions to a DFA (see SQ_STRIDE2). The entry
+//   of a state and two bases holds the state after the first base in the
+//   low 32 bits and the state after both bases in the high 32 bits, so that
+//   the text is read two bases per dependent load. The entries are filled
+//   while matching, by composing the single-base transitions that the text
+//   uses, and 0 means not computed (the state 0 is never stored). Only the
+//   first DFA_STRIDE_STATES states have entries, and they are dropped when
+//   the states are renumbered (see 'dfa_evict').
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa : pointer to the DFA.
+//                                                                        
+// RETURN:                                                                
+//   On success the function returns 0, -1 is returned if an error occurred.
+//
+// SIDE EFFECTS:
+//   The table uses up to NBASES*NBASES*8 bytes per state, on top of the
+//   memory limit of the DFA. The pages are only allocated when used.
+{
+   // Set error to 0.
+   seeqerr = 0;
+
+   if (dfa->pairs != NULL) return 0;
+   size_t npairs = min(dfa->capacity, DFA_STRIDE_STATES);
+   size_t size = npairs * NBASES * NBASES * sizeof(uint64_t);
+   uint64_t * pairs = mem_reserve(size);
+   if (pairs == NULL) return -1;
+   if (mem_commit(pairs, size) == -1) {
+      munmap(pairs, size);
+      return -1;
+   }
+   dfa->pairs  = pairs;
+   dfa->npairs = npairs;
+   return 0;
+}
+
+
+int
+dfa_share
+(
+ dfa_t * dfa
+)
+// SYNOPSIS:                                                              
+//   Prepares a DFA to be used concurrently by many threads (see 'seeqClone').
+//   The states of a DFA never move (see 'dfa_grow'), so they can be read
+//   without locking while new states are added.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa : pointer to the DFA.
+//                                                                        
+// RETURN:                                                                
+//   On success the function returns 0, -1 is returned if an error occurred.
+//
+// SIDE EFFECTS:
+//   The DFA is flagged as shared. Shared DFAs do not evict states, they
+//   run in cache mode when the memory limit is reached. Incomplete DFAs
+//   are widened (see 'dfa_widen'), so that they never change layout while
+//   other threads read them.
+{
+   // Set error to 0.
+   seeqerr = 0;
+
+   if (dfa->shared) return 0;
+   if (!dfa->complete && dfa_widen(dfa)) return -1;
+   if (pthread_mutex_init(&dfa->lock, NULL)) return -1;
+   dfa->shared = 1;
+   // Other threads may be in any state.
+   free(dfa->used);
+   dfa->used = NULL;
 
+   return 0;
+}
 
 int
-dfa_step
+dfa_evictable
 (
- uint32_t   dfa_state,
- int        base,
- int        plen,
- int        tau,
- dfa_t   ** dfap,
- char     * exp,
- uint32_t * dfa_next
+ dfa_t * dfa
 )
 // SYNOPSIS:                                                              
-//   Updates the current status of DFA graph. Based on the parameters passed,
-//   the function will compute the next row of the Needleman-Wunsch matrix and
-//   update the graph accordingly. If the new row points to an already-known
-//   state, the two existing vertices will be linked with an edge. Otherwise,
-//   a new vertex will be created for the new row.
+//   Sets a DFA to evict states when its memory limit is reached, instead of
+//   running in cache mode (see 'dfa_evict'). DFAs without memory limit and
+//   shared DFAs do not evict states.
 //                                                                        
 // PARAMETERS:                                                            
-//   dfa_state : current state of the DFA.
-//   base      : next base to resolve (0 for 'A', 1 for 'C', 2 for 'G', 3 for 'T'/'U' and 4 for 'N').
-//   plen      : length of the pattern, as returned by 'parse()'.
-//   tau       : Levenshtein distance threshold.
-//   dfap      : pointer to a memory space containing the address of the DFA.
-//   exp       : expression keys, as returned by parse.
-//   dfa_next  : a pointer to an uint32_t where the computed DFA transition will be placed,
-//
+//   dfa : pointer to the DFA.
+//                                                                        
 // RETURN:                                                                
-//   dfa_step returns 0 on success, or -1 if an error occurred.
+//   On success the function returns 0, -1 is returned if an error occurred.
 //
 // SIDE EFFECTS:
-//   The DFA structure may be reallocated. The contents of *dfa_next will be
-//   overriden.
+//   Allocates the 'used' flags of the states, which are set by the matching
+//   functions.
 {
    // Set error to 0.
    seeqerr = 0;
 
-   uint32_t state = dfa_state;
-   dfa_t    * dfa = *dfap;
-   int      value = 1 << base;
+   if (dfa->maxmemory == 0 || dfa->complete || dfa->shared) return 0;
+   // The memory limit is checked before adding a state.
+   dfa->used = calloc(dfa->maxmemory / (dfa->state_size + dfa->code_size) + 2, sizeof(uint8_t));
+   return dfa->used == NULL ? -1 : 0;
+}
 
-   // Vertex reference.
-   vertex_t * vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
+int
+dfa_evict
+(
+ dfa_t  * dfa
+)
+// SYNOPSIS:                                                              
+//   Evicts the states that have not been used by the text since the last
+//   call, if they are at least a quarter of the DFA. This is called
+//   periodically when the DFA runs in cache mode (see 'dfa_step'), so that
+//   the states that were computed for a different kind of text do not take
+//   the memory. The states that are kept are renumbered from the root, the
+//   transitions to the evicted states are cleared and the trie is rebuilt.
+//   The DFA then grows again with the states that the text uses.
+//                                                                        
+// PARAMETERS:                                                            
+//   dfa : pointer to the DFA.
+//                                                                        
+// RETURN:                                                                
+//   On success the function returns 0, -1 is returned if an error occurred.
+//
+// SIDE EFFECTS:
+//   The ids of the states are changed and the 'used' flags are cleared.
+//   The state 0 is not changed.
+{
+   // Set error to 0.
+   seeqerr = 0;
 
-   // Return next vertex if already computed.
-   if (vertex->next[base] != DFA_COMPUTE) {
-      *dfa_next = vertex->next[base];
+   // The root is always kept.
+   size_t keep = DFA_ROOT_STATE + 1;
+   for (size_t i = DFA_ROOT_STATE + 1; i < dfa->pos; i++) keep += dfa->used[i];
+   if (keep > dfa->pos - dfa->pos / 4) {
+      memset(dfa->used, 0, dfa->pos);
       return 0;
    }
-   
-   // Get the current alignment from the DFA state.
-   int      * align = dfa->align_cache;
-   uint8_t  * path  = calloc(plen, sizeof(uint8_t));
-   if (path == NULL) return -1;
-
-   // Restore alignment if not running in cached mode.
-   // TODO:
-   // Avoid the cache miss of the alignment. The alignment could be stored
-   // in the same dfa vertex structure, but then dynamic size would be needed.
-   // This could be implemented converting the stack of vertices into a char*
-   // and computing the memory offset of each vertex depending on the pattern
-   // length and the size of the compressed alignment
-   // (that is: dfa_t is ceil(pattern length/5.0) bytes bigger)
-   if (state != 0) {
-      path_decode(vertex->code, path, (size_t)plen);
-      path_to_align(path, align, (size_t)plen);
-   }
- 
-   // Initialize first column.
-   int nextold, prev, old = align[0];
-   align[0] = prev = 0;
-   int last_active = 1;
 
-   // Update row.
-   // TODO:
-   // This could be done much faster using a precomputed table of state transitions.
-   // Depending on what is the current i-th differential transition, the updated i-th
-   // differential transition, the current i+1-th differential transition and whether,
-   // the i+1-th position is in match or mismatch.
-   // This is a graph with 5 states (current transition and updated transition), each
-   // with 6 state transition that emits the i+1-th updated transition.
-   for (int i = 1; i < plen+1; i++) {
-      nextold   = align[i];
-      align[i]  = min(tau + 1, min(old + ((value & exp[i-1]) == 0), min(prev, align[i]) + 1));
-      if (align[i] <= tau) last_active = i;
-      path[i-1] = (uint8_t)(align[i] - prev + 1);
-      prev      = align[i];
-      old       = nextold;
-   }
-
-   // Save match value.
-   uint32_t match = ((uint32_t)prev | set_mintomatch(plen - last_active));
-   
-   // Check if this state already exists.
-   uint32_t dfalink;
+   trie_t * trie = dfa->trie;
+   uint32_t * newid = malloc(dfa->pos * sizeof(uint32_t));
+   uint8_t  * path  = malloc(trie->height);
+   if (newid == NULL || path == NULL) {
+      free(newid); free(path);
+      return -1;
+   }
 
-   // UPDATE:
-   // The entire DFA should be passed to find the remaining path stored
-   // in the DFA node (using path_compare).
-   int exists = trie_search(dfa, path, &dfalink, plen);
+   // Number the states that are kept.
+   keep = DFA_ROOT_STATE + 1;
+   newid[0] = 0;
+   newid[DFA_ROOT_STATE] = DFA_ROOT_STATE;
+   for (size_t i = DFA_ROOT_STATE + 1; i < dfa->pos; i++) {
+      newid[i] = dfa->used[i] ? (uint32_t) keep++ : DFA_COMPUTE;
+   }
 
-   if (exists == 1) {
-      // If exists, just link with the existing state.
-      *dfa_next = dfalink;
-      // Update edge in dfa.
-      if (state != 0) vertex->next[base] = dfalink;   
-   } else if (state == 0) {
-      *dfa_next = 0;
-      vertex_t * s0 = (vertex_t *) dfa->states;
-      s0->match = match;
-   } else if (exists == 0) {
-      int retval = dfa_newstate(dfap, path, base, state);
-      dfa = *dfap;
-      if (dfa == NULL) {
-         goto dfa_step_abort;
-      }
-      vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-      if (retval == 0) {
-         // Update edge in dfa.
-         *dfa_next = vertex->next[base];
-         vertex_t * new_vertex = (vertex_t *) (dfa->states + vertex->next[base] * dfa->state_size);
-         new_vertex->match = match;
-      }
-      else  if (retval == 1) {
-         // Set to cache mode if max memory is reached.
-         *dfa_next = 0;
-         vertex_t * s0 = (vertex_t *) dfa->states;
-         s0->match = match;
+   // Move the states and their transitions. The new ids are lower than
+   // or equal to the old ones.
+   for (size_t i = DFA_ROOT_STATE; i < dfa->pos; i++) {
+      if (newid[i] == DFA_COMPUTE) continue;
+      if (newid[i] != i) {
+         memcpy(state_vertex(dfa, newid[i]), state_vertex(dfa, i), dfa->state_size);
+         memcpy(state_code(dfa, newid[i]), state_code(dfa, i), dfa->code_size);
       }
-      else {
-         goto dfa_step_abort;
+      for (int j = 0; j < NBASES; j++) {
+         uint32_t next = state_next(dfa, newid[i], j);
+         if (next != DFA_COMPUTE) dfa_setnext(dfa, newid[i], j, newid[next]);
       }
    }
-   else if (exists == -1) {
-      goto dfa_step_abort;
+
+   // Rebuild the trie.
+   memset(&(trie->nodes[0]), 0, sizeof(node_t));
+   trie->pos = 1;
+   for (size_t i = DFA_ROOT_STATE; i < keep; i++) {
+      path_decode(state_code(dfa, i), path, trie->height);
+      if (trie_insert(dfa, path, (uint32_t) i)) {
+         free(newid); free(path);
+         return -1;
+      }
    }
 
-   free(path);
+   // The 2-base transitions refer to the old ids.
+   if (dfa->pairs != NULL)
+      memset(dfa->pairs, 0, min(dfa->pos, dfa->npairs) * NBASES * NBASES * sizeof(uint64_t));
+
+   memset(dfa->used, 0, dfa->pos);
+   dfa->pos = keep;
+
+   free(newid); free(path);
+
    return 0;
+}
 
-dfa_step_abort:
-   free(path);
-   return -1;
+void
+dfa_free
+(
+ dfa_t * dfa
+)
+{
+   if (dfa == NULL) return;
+   if (dfa->shared)              pthread_mutex_destroy(&dfa->lock);
+   if (dfa->path_cache != NULL)  free(dfa->path_cache);
+   if (dfa->used != NULL)        free(dfa->used);
+   if (dfa->trie != NULL)        trie_free(dfa->trie);
+   if (dfa->seg != NULL)         free(dfa->seg);
+   if (dfa->pairs != NULL)       munmap(dfa->pairs, dfa->npairs * NBASES * NBASES * sizeof(uint64_t));
+   // Slabs, and first slab or file mapping (see 'dfa_map').
+   if (dfa->slab != NULL) {
+      for (size_t k = 1; k < dfa->size >> DFA_SLAB_SHIFT; k++)
+         munmap(dfa->slab[k].states, DFA_SLAB_STATES * (DFA_STATE_SIZE + dfa->code_size));
+      free(dfa->slab);
+   }
+   if (dfa->map != NULL)         munmap(dfa->map, dfa->mapsize);
+   free(dfa);
+}
 
+void
+dfa_release
+(
+ dfa_t * dfa
+)
+// SYNOPSIS:                                                              
+//   Drops a reference to a DFA (see 'seeqClone') and frees it when the
+//   last reference is dropped.
+{
+   if (__atomic_sub_fetch(&dfa->refs, 1, __ATOMIC_ACQ_REL) == 0) dfa_free(dfa);
 }
 
+void
+patset_free
+(
+ patset_t * pats
+)
+// SYNOPSIS:                                                              
+//   Frees a pattern set (see 'seeqNewMulti').
+{
+   for (int k = 0; k < pats->npat; k++) {
+      free(pats->pat[k].rkeys);
+      if (pats->pat[k].rdfa != NULL) dfa_free(pats->pat[k].rdfa);
+   }
+   free(pats);
+}
 
-uint32_t
-dfa_newvertex
+scratch_t *
+scratch_new
 (
- dfa_t   ** dfap
+ int wlen
 )
 // SYNOPSIS:                                                              
-//   Adds a new vertex to the dfa graph. The new vertex is not linked to any other
-//   vertex in any way, so the connection must be done manually.
+//   Creates a private construction scratch for a shared DFA (see 'dfa_step').
 //                                                                        
 // PARAMETERS:                                                            
-//   dfap : pointer to a memory space containing the address of the DFA.
+//   wlen : length of the rows of the DFA states (height of the trie).
 //                                                                        
 // RETURN:                                                                
-//   On success, the function returns the id of the new vertex. In case of error
-//   the function returns U32T_ERROR.
+//   On success, the function returns a pointer to the new scratch_t structure.
+//   A NULL pointer is returned in case of error.
+//
+// SIDE EFFECTS:
+//   The returned scratch_t struct must be freed with 'scratch_free'.
+{
+   scratch_t * scratch = malloc(sizeof(scratch_t));
+   if (scratch == NULL) return NULL;
+   scratch->s0   = malloc(sizeof(vertex_t));
+   scratch->path = calloc(2*(size_t)wlen, sizeof(uint8_t));
+   if (scratch->s0 == NULL || scratch->path == NULL) {
+      scratch_free(scratch);
+      return NULL;
+   }
+   scratch->s0->match = DFA_COMPUTE;
+   for (int i = 0; i < NBASES; i++) scratch->s0->next[i] = DFA_COMPUTE;
+   return scratch;
+}
+
+void
+scratch_free
+(
+ scratch_t * scratch
+)
+{
+   free(scratch->s0);
+   free(scratch->path);
+   free(scratch);
+}
+
+dfa_t *
+dfa_map
+(
+ int              fd,
+ size_t           fsize,
+ const dfasec_t * sec,
+ size_t           maxmemory,
+ int              verify
+)
+// SYNOPSIS:                                                              
+//   Creates a DFA from a section of a DFA file (see 'seeqSave'). Complete
+//   DFAs are used read-only from the file mapping, incomplete DFAs and
+//   their trie are copied to memory so that they can be extended. The
+//   copied sections are checked, they are read anyway.
+//                                                                        
+// PARAMETERS:                                                            
+//   fd        : file descriptor of the DFA file.
+//   fsize     : size of the DFA file.
+//   sec       : descriptor of the DFA section.
+//   maxmemory : DFA memory limit, in bytes.
+//   verify    : 1 to check the section of a complete DFA (see 'dfa_check').
+//                                                                        
+// RETURN:                                                                
+//   On success, the function returns a pointer to the new dfa_t structure.
+//   A NULL pointer is returned in case of error.
 //
 // SIDE EFFECTS:
-//   If the dfa has reached its maximum size, the dfa will be reallocated
-//   doubling its current size. The address of the dfa may have changed after
-//   calling dfa_newvertex.
+//   The returned dfa_t struct must be freed with 'dfa_free'.
 {
    // Set error to 0.
    seeqerr = 0;
 
-   dfa_t * dfa = *dfap;
+   // Check section bounds.
+   size_t wlen = (size_t) sec->height;
+   if (wlen < 1 ||
+       (sec->state_size != DFA_STATE_SIZE && (sec->state_size != DFA_NARROW_SIZE ||
+        wlen > 254 || sec->nstates > DFA_NARROW_COMPUTE)) || sec->code_size != wlen/5 + (wlen%5 > 0) ||
+       sec->nstates < 2 || sec->nstates > ABS_MAX_POS || sec->nnodes < 1 ||
+       sec->states > fsize || (fsize - sec->states) / sec->state_size < sec->nstates ||
+       sec->codes > fsize || (fsize - sec->codes) / sec->code_size < sec->nstates ||
+       sec->nodes > fsize || (fsize - sec->nodes) / sizeof(node_t) < sec->nnodes) {
+      seeqerr = 13;
+      return NULL;
+   }
 
-   // Create new vertex in DFA graph.
-   if (dfa->pos >= dfa->size) {
-      size_t newsize = dfa->size * 2;
-      if (newsize > ABS_MAX_POS) newsize = ABS_MAX_POS;
-      *dfap = dfa = realloc(dfa, sizeof(dfa_t) + newsize * dfa->state_size);
-      if (dfa == NULL) return U32T_ERROR;
-      dfa->size = newsize;
+   dfa_t * dfa = malloc(sizeof(dfa_t));
+   if (dfa == NULL) return NULL;
+   dfa->size       = sec->nstates;
+   dfa->pos        = sec->nstates;
+   dfa->maxmemory  = maxmemory;
+   dfa->state_size = sec->state_size;
+   dfa->code_size  = sec->code_size;
+   dfa->capacity   = sec->nstates;
+   dfa->complete   = sec->complete != 0;
+   dfa->used       = NULL;
+   dfa->sweep      = 0;
+   dfa->nseg       = 1;
+   dfa->seg        = NULL;
+   dfa->metric     = DFA_LEVENSHTEIN;
+   dfa->pairs      = NULL;
+   dfa->npairs     = 0;
+   dfa->shared     = 0;
+   dfa->refs       = 1;
+   dfa->map        = NULL;
+   dfa->mapsize    = 0;
+   dfa->states     = NULL;
+   dfa->codes      = NULL;
+   dfa->nflat      = 0;
+   dfa->slab       = NULL;
+   dfa->hugepages  = 0;
+   dfa->trie       = NULL;
+   dfa->path_cache = calloc(2*wlen, sizeof(uint8_t));
+   // The trie is only used to compute new states.
+   dfa->trie = trie_new(dfa->complete ? 1 : sec->nnodes, wlen);
+   if (dfa->path_cache == NULL || dfa->trie == NULL) {
+      dfa_free(dfa);
+      return NULL;
    }
 
-   // Initialize DFA vertex.
-   vertex_t * new_vertex = (vertex_t *)(dfa->states + dfa->pos * dfa->state_size);
-   new_vertex->match = DFA_COMPUTE;
-   for (int j = 0; j < NBASES; j++) new_vertex->next[j] = DFA_COMPUTE;
+   uint8_t * map = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (map == MAP_FAILED) {
+      dfa_free(dfa);
+      return NULL;
+   }
 
-   // Increase counter.
-   return (uint32_t)(dfa->pos++);
+   // Check the states, codes and nodes before using them. The pages of
+   // complete DFAs are otherwise only read as they are used, and they are
+   // shared with the other processes that map the file.
+   if ((!dfa->complete || verify) && dfa_check(map, sec)) {
+      seeqerr = 13;
+      munmap(map, fsize);
+      dfa_free(dfa);
+      return NULL;
+   }
+
+   if (dfa->complete) {
+      dfa->map     = map;
+      dfa->mapsize = fsize;
+      dfa->states  = map + sec->states;
+      dfa->codes   = map + sec->codes;
+      dfa->nflat   = sec->nstates;
+   } else {
+      size_t capacity = maxmemory > 0 ? maxmemory / (dfa->state_size + dfa->code_size) + 2 : ABS_MAX_POS;
+      if (dfa_reserve(dfa, capacity, sec->nstates)) {
+         munmap(map, fsize);
+         dfa_free(dfa);
+         return NULL;
+      }
+      // Copied by slabs (see 'dfa_grow').
+      for (size_t i = 0; i < sec->nstates; i += DFA_SLAB_STATES) {
+         size_t n = min(sec->nstates - i, DFA_SLAB_STATES);
+         memcpy(state_vertex(dfa, i), map + sec->states + i * sec->state_size, n * sec->state_size);
+         memcpy(state_code(dfa, i), map + sec->codes + i * sec->code_size, n * sec->code_size);
+      }
+      for (size_t i = 0; i < sec->nnodes; i += TRIE_SLAB_NODES) {
+         size_t n = min(sec->nnodes - i, TRIE_SLAB_NODES);
+         memcpy(trie_node(dfa->trie, i), map + sec->nodes + i * sizeof(node_t), n * sizeof(node_t));
+      }
+      dfa->trie->pos = sec->nnodes;
+      munmap(map, fsize);
+   }
+
+   return dfa;
 }
 
 int
-dfa_newstate
+dfa_check
 (
- dfa_t   ** dfap,
- uint8_t  * path,
- int        edge,
- size_t     dfa_state
+ const uint8_t  * map,
+ const dfasec_t * sec
 )
 // SYNOPSIS:                                                              
-//   Creates a new vertex to allocate a new DFA state, which represents an 
-//   unseen NW alignment row. This function inserts the new NW alignment row in
-//   the trie and connects the new vertex with its origin (the current DFA state).
+//   Checks a section of a DFA file (see 'seeqSave') whose bounds have been
+//   checked by 'dfa_map'. The transitions must be states of the section, or
+//   DFA_COMPUTE in incomplete DFAs, the codes must be valid paths (see
+//   'path_decode') and the children of the trie nodes must be nodes of the
+//   section, or states when they are flagged as leaves.
 //                                                                        
 // PARAMETERS:                                                            
-//   dfap      : pointer to a memory space containing the address of the DFA.
-//   path      : path of the trie that represents the new NW alignment.
-//   dfa_state : current DFA state.
-//   edge      : the edge slot to use of the current DFA state.
+//   map : mapping of the DFA file.
+//   sec : descriptor of the DFA section.
 //                                                                        
 // RETURN:                                                                
-//   On success, the function returns 0, 1 when the memory limit
-//   has been reached or -1 if an error occurred.
+//   Returns 0 if the section is valid, or 1 otherwise.
 //
 // SIDE EFFECTS:
-//   The dfa may be reallocated, so the content of *dfap may be different
-//   at the end of the funcion.
+//   None.
 {
-   // Set error to 0.
-   seeqerr = 0;
-
-   // Check memory usage.
-   size_t memory = (*dfap)->pos * (*dfap)->state_size; // DFA memory.
-   memory += (*dfap)->trie->pos * sizeof(node_t); // Trie memory.
-   if ((*dfap)->maxmemory > 0 && memory > (*dfap)->maxmemory) {
-      (*dfap)->trie = realloc((*dfap)->trie, sizeof(trie_t) + (*dfap)->trie->pos * sizeof(node_t));
-      if ((*dfap)->trie == NULL) return -1;
-      (*dfap)->trie->size = (*dfap)->trie->pos;
-      *dfap = realloc(*dfap, sizeof(dfa_t) + (*dfap)->pos * (*dfap)->state_size);
-      if (*dfap == NULL) return -1;
-      (*dfap)->size = (*dfap)->pos;
-      return 1;
+   // The state 0 of complete DFAs is not computed and never reached.
+   const uint64_t nstates = sec->nstates;
+   const uint64_t first   = sec->complete ? 1 : 0;
+   for (uint64_t s = first; s < nstates; s++) {
+      const uint8_t * vertex = map + sec->states + s * sec->state_size;
+      for (int j = 0; j < NBASES; j++) {
+         uint32_t next = sec->state_size == DFA_NARROW_SIZE ? ((const vertex16_t *) vertex)->next[j] :
+            ((const vertex_t *) vertex)->next[j];
+         if (sec->state_size == DFA_NARROW_SIZE && next == DFA_NARROW_COMPUTE) next = DFA_COMPUTE;
+         if ((next < first || next >= nstates) && (sec->complete || next != DFA_COMPUTE)) return 1;
+      }
    }
-   // Absolute memory limit.
-   if ((*dfap)->pos == ABS_MAX_POS) return 1;
-
-   // Create new vertex in dfa graph.
-   uint32_t vertexid = dfa_newvertex(dfap);
-   if (vertexid == U32T_ERROR) return -1;
-   vertex_t * old_vertex = (vertex_t *) ((*dfap)->states + dfa_state * (*dfap)->state_size);
-   vertex_t * new_vertex = (vertex_t *) ((*dfap)->states + vertexid * (*dfap)->state_size);
 
-   // Encode path.
-   path_encode(path, new_vertex->code, (*dfap)->trie->height);
-
-   // Connect dfa vertices.
-   old_vertex->next[edge] = (uint32_t) vertexid;
+   // A byte holds 5 ternary symbols.
+   const uint8_t * codes = map + sec->codes;
+   for (uint64_t i = 0; i < nstates * sec->code_size; i++)
+      if (codes[i] >= 243) return 1;
 
-   if (trie_insert(*dfap, path, vertexid)) {
-      // Delete DFA state.
-      (*dfap)->pos--;
-      return -1;
+   // The trie of complete DFAs is not loaded.
+   if (sec->complete) return 0;
+   const node_t * nodes = (const node_t *) (map + sec->nodes);
+   for (uint64_t n = 0; n < sec->nnodes; n++) {
+      if (nodes[n].flags >> TRIE_CHILDREN) return 1;
+      for (int j = 0; j < TRIE_CHILDREN; j++) {
+         uint64_t bound = (nodes[n].flags >> j) & 1 ? nstates : sec->nnodes;
+         if (nodes[n].child[j] >= bound) return 1;
+      }
    }
 
-   // Insert new state in the trie.
    return 0;
 }
 
-void
-dfa_free
+uint64_t
+dfa_checksum
 (
- dfa_t * dfa
+ const dfahdr_t * hdr,
+ const dfasec_t * sec
 )
+// SYNOPSIS:                                                              
+//   Computes the checksum (64-bit FNV-1a) of the header of a DFA file and
+//   of its 'ndfa' section descriptors (see 'seeqSave').
+//                                                                        
+// PARAMETERS:                                                            
+//   hdr : header of the DFA file. Its checksum is not included.
+//   sec : section descriptors.
+//                                                                        
+// RETURN:                                                                
+//   Returns the checksum.
+//
+// SIDE EFFECTS:
+//   None.
 {
-   if (dfa->align_cache != NULL) free(dfa->align_cache);
-   if (dfa->trie != NULL)        free(dfa->trie);
-   free(dfa);
+   dfahdr_t copy = *hdr;
+   copy.checksum = 0;
+   uint64_t hash = 0xcbf29ce484222325ULL;
+   for (size_t i = 0; i < sizeof(dfahdr_t); i++) {
+      hash ^= ((const uint8_t *) &copy)[i];
+      hash *= 0x100000001b3ULL;
+   }
+   for (size_t i = 0; i < (size_t) hdr->ndfa * sizeof(dfasec_t); i++) {
+      hash ^= ((const uint8_t *) sec)[i];
+      hash *= 0x100000001b3ULL;
+   }
+   return hash;
 }
 
 trie_t *
@@ -984,7 +4740,7 @@ trie_new
 //   A NULL pointer is returned in case of error.
 //
 // SIDE EFFECTS:
-//   The returned trie_t struct is allocated using malloc and must be manually freed.
+//   The returned trie_t struct must be freed with 'trie_free'.
 {
    // Set error to 0.
    seeqerr = 0;
@@ -993,11 +4749,26 @@ trie_new
    if (initial_size < 1) initial_size = 1;
    if (height < 1) height = 1;
 
-   trie_t * trie = malloc(sizeof(trie_t) + initial_size*sizeof(node_t));
+   trie_t * trie = malloc(sizeof(trie_t));
    if (trie == NULL) return NULL;
 
+   // Reserve the first slab of nodes.
+   trie->mapsize = TRIE_SLAB_NODES * sizeof(node_t);
+   trie->nodes = mem_reserve(trie->mapsize);
+   trie->slab = NULL;
+   trie->size = 0;
+   trie->hugepages = 0;
+   if (trie->nodes == NULL) {
+      free(trie);
+      return NULL;
+   }
+   if (trie_grow(trie, initial_size)) {
+      trie_free(trie);
+      return NULL;
+   }
+
    // Initialize root node.
-   memset(&(trie->nodes[0]), 0, initial_size*sizeof(node_t));
+   memset(trie->nodes, 0, sizeof(node_t));
 
    // Initialize trie struct.
    trie->pos = 1;
@@ -1045,19 +4816,19 @@ trie_search
          return -1;
       }
       // Check if current node is a leaf.
-      if (trie->nodes[id].flags & (((uint32_t)1)<<path[i])) {
+      if (trie_node(trie, id)->flags & (((uint32_t)1)<<path[i])) {
          // Compare paths.
-         vertex_t * vertex = (vertex_t *)(dfa->states + trie->nodes[id].child[(int)path[i]] * dfa->state_size);
-         if (path_compare((uint8_t *)path, vertex->code, trie->height) == 0) return 0;
+         uint8_t * code = state_code(dfa, trie_node(trie, id)->child[(int)path[i]]);
+         if (path_compare((uint8_t *)path, code, trie->height) == 0) return 0;
          else break;
       }
       // Update path.
-      id = trie->nodes[id].child[(int)path[i]];
+      id = trie_node(trie, id)->child[(int)path[i]];
       // Check if next node exists.
       if (id == 0) return 0;
    }
    // Save leaf value.
-   if (dfastate != NULL) *dfastate = trie->nodes[id].child[(int)path[i]];
+   if (dfastate != NULL) *dfastate = trie_node(trie, id)->child[(int)path[i]];
    return 1;
 }
 
@@ -1082,8 +4853,8 @@ trie_insert
 //   On success the function returns 0, -1 is returned if an error occurred.
 //
 // SIDE EFFECTS:
-//   If the trie has reached its limit of allocated nodes, it will be reallocated
-//   doubling its size. The address of the trie may have changed after calling dfa_insert.
+//   If the trie has reached its limit of allocated nodes, it will grow doubling
+//   its size. The nodes are never moved (see 'trie_grow').
 {
    // Set error to 0.
    seeqerr = 0;
@@ -1101,48 +4872,47 @@ trie_insert
    size_t i;
    for (i = 0; i < dfa->trie->height - 1; i++) {
       // Check if the current node is an intermediate leaf.
-      if (dfa->trie->nodes[id].flags & (((uint32_t)1)<<path[i])) {
+      if (trie_node(dfa->trie, id)->flags & (((uint32_t)1)<<path[i])) {
          size_t auxid = id;
          // Save data.
-         uint32_t tmpdfa = dfa->trie->nodes[id].child[(int)path[i]];
+         uint32_t tmpdfa = trie_node(dfa->trie, id)->child[(int)path[i]];
          // Get the other node's full path.
          uint8_t * tmppath = malloc(dfa->trie->height);
          if (tmppath == NULL) return -1;
-         vertex_t * vertex = (vertex_t *) (dfa->states + tmpdfa * dfa->state_size);
-         path_decode(vertex->code, tmppath, dfa->trie->height);
+         path_decode(state_code(dfa, tmpdfa), tmppath, dfa->trie->height);
          // Unflag leaf.
-         dfa->trie->nodes[auxid].flags &= ~(((uint32_t)1)<<path[i]);
+         trie_node(dfa->trie, auxid)->flags &= ~(((uint32_t)1)<<path[i]);
          // Move down the node.
          size_t j = i;
          while ((uint8_t) path[j] == tmppath[j] && j < dfa->trie->height) {
-            if (dfa->trie->pos == ABS_MAX_POS) {
+            if (dfa->trie->pos >= ABS_MAX_POS) {
                // Memory limit reached. Revert movement.
-               dfa->trie->nodes[id].flags |= (((uint32_t)1)<<path[i]);
-               dfa->trie->nodes[id].child[(int)path[i]] = tmpdfa;
+               trie_node(dfa->trie, id)->flags |= (((uint32_t)1)<<path[i]);
+               trie_node(dfa->trie, id)->child[(int)path[i]] = tmpdfa;
                return 1;
             }
             uint32_t newid = trie_newnode(&(dfa->trie));
             if (newid == U32T_ERROR) return -1;
-            dfa->trie->nodes[auxid].child[(int)tmppath[j]] = newid;
+            trie_node(dfa->trie, auxid)->child[(int)tmppath[j]] = newid;
             auxid = newid;
             j++;
          }
          // Copy data and flag leaf.
-         dfa->trie->nodes[auxid].child[(int)tmppath[j]] = tmpdfa;
-         dfa->trie->nodes[auxid].flags |= (((uint32_t)1) << tmppath[j]);
+         trie_node(dfa->trie, auxid)->child[(int)tmppath[j]] = tmpdfa;
+         trie_node(dfa->trie, auxid)->flags |= (((uint32_t)1) << tmppath[j]);
          free(tmppath);
       }
 
       // Walk the tree.
-      if (dfa->trie->nodes[id].child[(int)path[i]] != 0) {
+      if (trie_node(dfa->trie, id)->child[(int)path[i]] != 0) {
          // Follow path.
-         id = dfa->trie->nodes[id].child[(int)path[i]];
+         id = trie_node(dfa->trie, id)->child[(int)path[i]];
       } else break;
    }
 
    // Write leaf: Store DFA reference vertex and flag leaf.
-   dfa->trie->nodes[id].child[(int)path[i]] = dfastate;
-   dfa->trie->nodes[id].flags |= (((uint32_t)1)<<path[i]);
+   trie_node(dfa->trie, id)->child[(int)path[i]] = dfastate;
+   trie_node(dfa->trie, id)->flags |= (((uint32_t)1)<<path[i]);
 
    return 0;
 }
@@ -1155,25 +4925,123 @@ trie_newnode
 {
    trie_t * trie = *triep;
 
-   // Check trie size.
+   // Check trie size. The nodes are never moved (see 'trie_grow').
    if (trie->pos >= trie->size) {
-      size_t newsize = trie->size * 2;
-      if (newsize > ABS_MAX_POS) newsize = ABS_MAX_POS;
-      *triep = trie = realloc(trie, sizeof(trie_t) + newsize * sizeof(node_t));
-      if (trie == NULL) return U32T_ERROR;
-      // Initialize new nodes.
-      trie->size = newsize;
+      size_t newsize = trie->size < TRIE_SLAB_NODES ? trie->size * 2 : trie->size + TRIE_SLAB_NODES;
+      if (trie->pos >= ABS_MAX_POS) return U32T_ERROR;
+      if (trie_grow(trie, newsize)) return U32T_ERROR;
    }
       
    // Consume one node of the trie.
    size_t newid = trie->pos;
-   trie->nodes[newid].child[0] = trie->nodes[newid].child[1] = trie->nodes[newid].child[2] = 0;
-   trie->nodes[newid].flags = 0;
+   node_t * node = trie_node(trie, newid);
+   node->child[0] = node->child[1] = node->child[2] = 0;
+   node->flags = 0;
    trie->pos++;
 
    return (uint32_t)newid;
 }
 
+int
+trie_grow
+(
+ trie_t * trie,
+ size_t   size
+)
+// SYNOPSIS:                                                              
+//   Makes the first 'size' nodes of a trie usable. The first slab is
+//   committed up to 'size', the nodes after it are stored in new slabs of
+//   TRIE_SLAB_NODES nodes (see 'dfa_grow').
+//                                                                        
+// RETURN:                                                                
+//   On success the function returns 0, -1 is returned if an error occurred.
+{
+   size_t flat = min(size, TRIE_SLAB_NODES);
+   if (flat > trie->size) {
+      if (mem_commit(trie->nodes, flat * sizeof(node_t))) return -1;
+      trie->size = flat;
+   }
+
+   size_t slabsize = TRIE_SLAB_NODES * sizeof(node_t);
+   while (trie->size < size) {
+      if (trie->slab == NULL) {
+         node_t ** slab = calloc((ABS_MAX_POS >> TRIE_SLAB_SHIFT) + 1, sizeof(node_t *));
+         if (slab == NULL) return -1;
+         slab[0] = trie->nodes;
+         trie->slab = slab;
+      }
+      node_t * map = mem_reserve(slabsize);
+      if (map == NULL) return -1;
+      if (mem_commit(map, slabsize)) {
+         munmap(map, slabsize);
+         return -1;
+      }
+#ifdef MADV_HUGEPAGE
+      if (trie->hugepages) madvise(map, slabsize, MADV_HUGEPAGE);
+#endif
+      trie->slab[trie->size >> TRIE_SLAB_SHIFT] = map;
+      trie->size += TRIE_SLAB_NODES;
+   }
+
+   return 0;
+}
+
+void
+trie_free
+(
+ trie_t * trie
+)
+// SYNOPSIS:                                                              
+//   Frees a trie created with 'trie_new'.
+{
+   for (size_t k = 1; k < trie->size >> TRIE_SLAB_SHIFT; k++)
+      munmap(trie->slab[k], TRIE_SLAB_NODES * sizeof(node_t));
+   free(trie->slab);
+   munmap(trie->nodes, trie->mapsize);
+   free(trie);
+}
+
+void *
+mem_reserve
+(
+ size_t size
+)
+// SYNOPSIS:                                                              
+//   Reserves a range of addresses where an array can grow in place. The
+//   range is not usable until it is committed with 'mem_commit', and the
+//   memory is only allocated when the pages are used. Growing an array
+//   does not copy its contents and pointers to its elements remain valid.
+//                                                                        
+// PARAMETERS:                                                            
+//   size : size of the range, in bytes.
+//                                                                        
+// RETURN:                                                                
+//   Returns the address of the range or NULL in case of error.
+//
+// SIDE EFFECTS:
+//   The range must be released with 'munmap'.
+{
+   void * map = mmap(NULL, size > 0 ? size : 1, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   return map == MAP_FAILED ? NULL : map;
+}
+
+int
+mem_commit
+(
+ void   * map,
+ size_t   size
+)
+// SYNOPSIS:                                                              
+//   Makes the first 'size' bytes of a range reserved with 'mem_reserve'
+//   usable.
+//                                                                        
+// RETURN:                                                                
+//   Returns 0 on success or -1 in case of error.
+{
+   size_t page = (size_t) sysconf(_SC_PAGESIZE);
+   return mprotect(map, (size + page - 1) / page * page, PROT_READ | PROT_WRITE);
+}
+
 void
 path_to_align
 (
@@ -1211,10 +5079,19 @@ path_decode
 // Convert binary to ternary alphabet. (One byte yields 5 ternary symbols)
 {
    static const uint8_t power[5] = {81,27,9,3,1};
-   // Allocate path.
-   uint8_t tmp = 0;
-   for (size_t i = 0; i < nelements; i++) {
-      if (i%5 == 0) tmp = data[i/5];
+   // Full bytes (divisions by constants).
+   size_t i = 0;
+   for ( ; i + 5 <= nelements; i += 5) {
+      uint8_t tmp = data[i/5];
+      path[i]   = tmp / 81; tmp %= 81;
+      path[i+1] = tmp / 27; tmp %= 27;
+      path[i+2] = tmp / 9;  tmp %= 9;
+      path[i+3] = tmp / 3;
+      path[i+4] = tmp % 3;
+   }
+   // Last byte.
+   uint8_t tmp = i < nelements ? data[i/5] : 0;
+   for ( ; i < nelements; i++) {
       path[i] = tmp / power[i%5];
       tmp = tmp % power[i%5];
    }
@@ -1231,11 +5108,21 @@ path_compare
 // Direct comparion of ternary symbols with its binary representation.
 {
    static const uint8_t power[5] = {81,27,9,3,1};
-   uint8_t tmp = data[0];
-   for (size_t i = 0; i < nelements; i++) {
-      if (i % 5 == 0) tmp = data[i/5];
-      if (tmp / power[i%5] != path[i]) return 0;
-      tmp %= power[i%5];
+   // Encode 5 symbols at a time and compare bytes.
+   size_t i = 0;
+   for ( ; i + 5 <= nelements; i += 5) {
+      const uint8_t * p = path + i;
+      if (p[0] > 2 || p[1] > 2 || p[2] > 2 || p[3] > 2 || p[4] > 2) return 0;
+      if (p[0]*81 + p[1]*27 + p[2]*9 + p[3]*3 + p[4] != data[i/5]) return 0;
+   }
+   // Last byte.
+   if (i < nelements) {
+      int code = 0;
+      for (size_t j = i; j < nelements; j++) {
+         if (path[j] > 2) return 0;
+         code += path[j] * power[j%5];
+      }
+      if (code != data[i/5]) return 0;
    }
    return 1;
 }
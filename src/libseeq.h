@@ -43,9 +43,59 @@
 #define SQ_LINES      0x00
 #define SQ_STREAM     0x10
 
+#define SQ_PACKED_ACGT 0x00
+#define SQ_PACKED_TCAG 0x20
+
+#define SQ_NOFILTER    0x00
+#define SQ_COMPOSITION 0x40
+
 #define MASK_MATCH    0x03
 #define MASK_NONDNA   0x0C
 #define MASK_INPUT    0x10
+#define MASK_PACKING  0x20
+#define MASK_FILTER   0x40
+
+// Compile options.
+#define SQ_LAZY       0x00
+#define SQ_PRECOMPILE 0x100
+
+#define MASK_COMPILE  0x100
+
+#define SQ_PRIVATE    0x000
+#define SQ_SHARED     0x200
+
+#define MASK_SHARE    0x200
+
+#define SQ_SMALLPAGES 0x000
+#define SQ_HUGEPAGES  0x400
+
+#define MASK_PAGES    0x400
+
+#define SQ_LEVENSHTEIN 0x000
+#define SQ_HAMMING     0x800
+
+#define MASK_METRIC   0x800
+
+#define SQ_FORWARD     0x0000
+#define SQ_BOTHSTRANDS 0x1000
+
+#define MASK_STRAND   0x1000
+
+#define SQ_STRIDE1     0x0000
+#define SQ_STRIDE2     0x2000
+
+#define MASK_STRIDE   0x2000
+
+#define SQ_REVSTART    0x0000
+#define SQ_FWDSTART    0x4000
+
+#define MASK_START    0x4000
+
+// Load options (see 'seeqLoadOpt').
+#define SQ_NOVERIFY    0x0000
+#define SQ_VERIFY      0x8000
+
+#define MASK_VERIFY   0x8000
 
 
 // Init options
@@ -53,22 +103,53 @@
 
 #include <stdio.h>
 
-extern int seeqerr;
+extern __thread int seeqerr;
 
 typedef struct seeq_t   seeq_t;
 typedef struct match_t  match_t;
 typedef struct mstack_t  mstack_t;
+typedef struct seeqstats_t seeqstats_t;
+typedef struct seeq_ctx_t seeq_ctx_t;
+typedef struct seeqbatch_t seeqbatch_t;
 
 struct match_t {
    size_t   start;
    size_t   end;
    size_t   dist;
+   size_t   pattern;  // Index of the pattern in the set (see 'seeqNewMulti').
+   size_t   strand;   // 1 if the reverse complement matched (see SQ_BOTHSTRANDS).
 };
 
-struct seeq_t {
+// Prefilter statistics, accumulated by the matching functions. The bases
+// are counted up to the end of the search (see 'seeqStringMatch').
+struct seeqstats_t {
+   size_t   texts;     // Texts matched.
+   size_t   rejected;  // Texts rejected by the prefilters, without DFA steps.
+   size_t   bases;     // Bases of the texts.
+   size_t   skipped;   // Bases skipped by the DFA.
+   size_t   checked;   // Match ends checked by the composition filter.
+   size_t   excluded;  // Match ends excluded by the composition filter.
+};
+
+// Matching context (see 'seeqCtxNew'). It holds what the matching functions
+// modify, so that many threads can match with one seeq_t, each with its own
+// context. The functions of seeq_t use the context embedded in it.
+struct seeq_ctx_t {
    size_t    hits;
    size_t    stacksize;
    match_t * match;
+   int       err;     // Value of seeqerr after the last call.
+   void    * cache;
+   void    * rcache;
+   void    * codes;   // Translated text (see 'seeqStringMatch').
+   size_t    codesz;
+   void    * comp;    // Composition filter (see SQ_COMPOSITION).
+   void    * row;     // Alignment row of pattern sets (see 'seeqNewMulti').
+   seeqstats_t stats;
+};
+
+struct seeq_t {
+   seeq_ctx_t ctx;    // Matching state of the functions of seeq_t.
    size_t    bufsz;
    char    * string;
    int       tau;
@@ -77,6 +158,21 @@ struct seeq_t {
    char    * rkeys;
    void    * dfa;
    void    * rdfa;
+   void    * pats;
+   void    * seeds;   // Exact-seed prefilter (see 'seeqStringMatch').
+};
+
+// Matches of a batch of texts (see 'seeqBatchMatch'), in arrays allocated
+// by the caller. Match 'i' is in position 'i' of each array.
+struct seeqbatch_t {
+   size_t   size;      // Capacity of the arrays.
+   size_t   hits;      // Matches stored.
+   size_t * text;      // Index of the text in the batch.
+   size_t * start;
+   size_t * end;
+   size_t * dist;
+   size_t * pattern;   // Index of the pattern, or NULL if not needed.
+   size_t * strand;    // Strand of the match, or NULL if not needed.
 };
 
 struct mstack_t {
@@ -87,10 +183,26 @@ struct mstack_t {
 
 
 seeq_t     * seeqNew         (const char *, int, size_t);
+seeq_t     * seeqNewOpt      (const char *, int, size_t, int);
+seeq_t     * seeqNewMulti    (const char **, const int *, int, size_t);
+seeq_t     * seeqNewMultiOpt (const char **, const int *, int, size_t, int);
+int          seeqSave        (seeq_t *, const char *);
+seeq_t     * seeqLoad        (const char *, size_t);
+seeq_t     * seeqLoadOpt     (const char *, size_t, int);
+seeq_t     * seeqClone       (seeq_t *);
 void         seeqFree        (seeq_t *);
 match_t    * seeqMatchIter   (seeq_t *);
 char       * seeqGetString   (seeq_t *);
 long         seeqStringMatch (const char *, seeq_t *, int);
+long         seeqMatchN      (const char *, size_t, seeq_t *, int);
+long         seeqBatchMatch  (const char * const *, const size_t *, size_t, seeq_t *, seeqbatch_t *, int);
+long         seeqPackedMatch (const unsigned char *, size_t, const unsigned char *, seeq_t *, int);
+seeq_ctx_t * seeqCtxNew      (const seeq_t *);
+void         seeqCtxFree     (seeq_ctx_t *);
+long         seeqCtxMatchN   (const char *, size_t, const seeq_t *, seeq_ctx_t *, int);
+long         seeqCtxPackedMatch (const unsigned char *, size_t, const unsigned char *, const seeq_t *, seeq_ctx_t *, int);
+long         seeqCtxBatchMatch (const char * const *, const size_t *, size_t, const seeq_t *, seeq_ctx_t *, seeqbatch_t *, int);
+match_t    * seeqCtxMatchIter(seeq_ctx_t *);
 const char * seeqPrintError  (void);
 int          seeqAddMatch    (seeq_t *, match_t);
 mstack_t   * stackNew        (size_t);
@@ -37,10 +37,14 @@ static const char *USAGE = "Usage:"
 "  seeq [options] pattern inputfile\n"
 "\n   MATCHING OPTIONS:\n"
 "    -d --distance [#]    maximum Levenshtein distance [default 0]\n"
+"    -s --hamming         substitutions only (Hamming distance)\n"
+"    -o --both-strands    match the pattern and its reverse complement\n"
 "    -i --invert          return only the non-matching lines\n"
 "    -b --best            scan the whole line to find the best match [default: first match only]\n"
 "    -a --all             returns all the matches (implies -m) [default: first match only]\n"
 "    -x --nondna [0,1,2]  non-DNA characters: 0-skip line, 1-convert to 'N', 2-ignore. [default 0]\n"
+"    -2 --twobit          the input is a UCSC .2bit file, matched without decoding\n"
+"    -q --composition     skip the text whose base composition cannot match (see -z)\n"
 "\n   FORMAT OPTIONS:\n"
 "    -c --count           returns the count of matching lines\n"
 "    -m --match-only      print only the matched sequence\n"
@@ -53,7 +57,11 @@ static const char *USAGE = "Usage:"
 "    -r --prefix          print only the prefix, ending before the match\n"
 "\n   OTHER OPTIONS:\n"
 "    -v --version         print version\n"
-"    -y --memory          set DFA memory limit (in MB)\n"
+"    -y --memory          set DFA memory limit (in MB) [default: no limit, 64 with -w]\n"
+"    -w --precompile      compute the whole DFA before matching (within the memory limit)\n"
+"    -t --threads [#]     number of matching threads [default 1]\n"
+"    -u --unordered       with -t, print the matched lines in any order\n"
+"    -g --cache-dir [dir] DFA cache directory [default: $SEEQ_CACHE_DIR, or no cache]\n"
 "    -z --verbose         verbose using stderr\n";
 
 
@@ -83,7 +91,7 @@ main
 {
    // Backtrace handler
    signal(SIGSEGV, SIGSEGV_handler); 
-   char *expr, *input;
+   char *expr, *input, *cachedir;
 
    // Unset flags (value -1).
    int showdist_flag  = -1;
@@ -102,9 +110,17 @@ main
    int nondna_flag    = -1;
    int memory_flag    = -1;
    int all_flag       = -1;
+   int precomp_flag   = -1;
+   int hamming_flag   = -1;
+   int strands_flag   = -1;
+   int twobit_flag    = -1;
+   int comp_flag      = -1;
+   int threads_flag   = -1;
+   int unorder_flag   = -1;
 
    // Unset options (value 'UNSET').
    input = NULL;
+   cachedir = NULL;
 
    if (argc == 1) {
       say_version();
@@ -133,11 +149,19 @@ main
          {"best",          no_argument, 0, 'b'},                  
          {"all",           no_argument, 0, 'a'},                  
          {"memory",  required_argument, 0, 'y'},                  
+         {"precompile",    no_argument, 0, 'w'},
+         {"cache-dir",required_argument,0, 'g'},
          {"distance",required_argument, 0, 'd'},
+         {"hamming",       no_argument, 0, 's'},
+         {"both-strands",  no_argument, 0, 'o'},
+         {"twobit",        no_argument, 0, '2'},
+         {"composition",   no_argument, 0, 'q'},
+         {"threads", required_argument, 0, 't'},
+         {"unordered",     no_argument, 0, 'u'},
          {0, 0, 0, 0}
       };
 
-      c = getopt_long(argc, argv, "apmnilczfvkherby:d:x:",
+      c = getopt_long(argc, argv, "apmnilczfvkherbwso2quy:d:x:g:t:",
             long_options, &option_index);
  
       /* Detect the end of the options. */
@@ -182,6 +206,37 @@ main
          }
          break;
 
+      case 't':
+         if (threads_flag < 0) {
+            int threads = atoi(optarg);
+            if (threads < 1) {
+               say_version();
+               fprintf(stderr, "error: threads must be a positive integer.\n");
+               say_help();
+               return EXIT_FAILURE;
+            }
+            threads_flag = threads;
+         }
+         else {
+            say_version();
+            fprintf(stderr, "error: threads option set more than once.\n");
+            say_help();
+            return EXIT_FAILURE;
+         }
+         break;
+
+      case 'u':
+         if (unorder_flag < 0) {
+            unorder_flag = 1;
+         }
+         else {
+            say_version();
+            fprintf(stderr, "error: 'unordered' option set more than once.\n");
+            say_help();
+            return EXIT_FAILURE;
+         }
+         break;
+
       case 'v':
          say_version();
          return EXIT_SUCCESS;
@@ -242,6 +297,78 @@ main
          break;
 
 
+      case 'g':
+         if (cachedir == NULL) {
+            cachedir = optarg;
+         }
+         else {
+            say_version();
+            fprintf(stderr, "error: cache directory set more than once.\n");
+            say_help();
+            return EXIT_FAILURE;
+         }
+         break;
+
+      case 'w':
+         if (precomp_flag < 0) {
+            precomp_flag = 1;
+         }
+         else {
+            say_version();
+            fprintf(stderr, "error: 'precompile' option set more than once.\n");
+            say_help();
+            return EXIT_FAILURE;
+         }
+         break;
+
+      case 's':
+         if (hamming_flag < 0) {
+            hamming_flag = 1;
+         }
+         else {
+            say_version();
+            fprintf(stderr, "error: 'hamming' option set more than once.\n");
+            say_help();
+            return EXIT_FAILURE;
+         }
+         break;
+
+      case 'o':
+         if (strands_flag < 0) {
+            strands_flag = 1;
+         }
+         else {
+            say_version();
+            fprintf(stderr, "error: 'both-strands' option set more than once.\n");
+            say_help();
+            return EXIT_FAILURE;
+         }
+         break;
+
+      case '2':
+         if (twobit_flag < 0) {
+            twobit_flag = 1;
+         }
+         else {
+            say_version();
+            fprintf(stderr, "error: 'twobit' option set more than once.\n");
+            say_help();
+            return EXIT_FAILURE;
+         }
+         break;
+
+      case 'q':
+         if (comp_flag < 0) {
+            comp_flag = 1;
+         }
+         else {
+            say_version();
+            fprintf(stderr, "error: 'composition' option set more than once.\n");
+            say_help();
+            return EXIT_FAILURE;
+         }
+         break;
+
       case 'b':
          if (best_flag < 0) {
             best_flag = 1;
@@ -405,8 +532,17 @@ main
    if (prefix_flag == -1) prefix_flag = 0;
    if (best_flag == -1) best_flag = 0;
    if (nondna_flag == -1) nondna_flag = 0;
-   if (memory_flag == -1) memory_flag = 0;
    if (all_flag == -1) all_flag = 0;
+   if (precomp_flag == -1) precomp_flag = 0;
+   if (memory_flag == -1) memory_flag = precomp_flag ? PRECOMPILE_MEMORY : 0;
+   if (hamming_flag == -1) hamming_flag = 0;
+   if (strands_flag == -1) strands_flag = 0;
+   if (twobit_flag == -1) twobit_flag = 0;
+   if (comp_flag == -1) comp_flag = 0;
+   if (threads_flag == -1) threads_flag = 1;
+   if (unorder_flag == -1) unorder_flag = 0;
+   if (cachedir == NULL) cachedir = getenv("SEEQ_CACHE_DIR");
+   if (cachedir != NULL && cachedir[0] == 0) cachedir = NULL;
    if (printline_flag == -1) printline_flag = (!matchonly_flag && !endline_flag && !prefix_flag);
 
    if (!showdist_flag && !showpos_flag && !printline_flag && !matchonly_flag && !showline_flag && !count_flag && !compact_flag && !prefix_flag && !endline_flag) {
@@ -437,6 +573,14 @@ main
    args.non_dna    = nondna_flag;
    args.all       = all_flag;
    args.memory    = (size_t)memory_flag * 1024*1024;
+   args.precompile = precomp_flag;
+   args.hamming    = hamming_flag;
+   args.strands    = strands_flag;
+   args.twobit     = twobit_flag;
+   args.composition = comp_flag;
+   args.threads    = threads_flag;
+   args.unordered  = unorder_flag;
+   args.cachedir   = cachedir;
    return seeq(expr, input, args);
 }
 
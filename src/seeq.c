@@ -27,6 +27,97 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+// SSE2 newline scan (see 'newline_mask'), part of the x86-64 baseline.
+#if defined(__GNUC__) && defined(__SSE2__)
+#define SEEQ_SSE2
+#include <emmintrin.h>
+#endif
+
+// Size of the reads of the input (see 'file_fill') and of the blocks of
+// the threaded matching (see 'seeqThreads').
+#define BLOCK_SIZE 0x100000
+
+
+static void
+print_match
+(
+ FILE                   * out,
+ const char             * string,
+ size_t                   len,
+ size_t                   line,
+ const char             * info,
+ const match_t          * match,
+ const struct seeqarg_t * args,
+ int                      header,
+ int                      color
+)
+// SYNOPSIS:                                                              
+//   Prints a match of the line 'string' in the format set by 'args' (see
+//   'seeq'), followed by a newline.
+//                                                                        
+// PARAMETERS:                                                            
+//   out    : output stream.
+//   string : matched line, not null-terminated (it may be read-only).
+//   len    : length of the line.
+//   line   : number of the line.
+//   info   : FASTA header of the line.
+//   match  : the match.
+//   args   : seeq arguments.
+//   header : print the FASTA header before the match.
+//   color  : color the match (terminal output).
+//                                                                        
+// RETURN:                                                                
+//   void.
+//
+// SIDE EFFECTS:
+//   None.
+{
+   const char strand = match->strand ? '-' : '+';
+   if (args->compact) {
+      fprintf(out, "%ld:%ld-%ld:%ld",line, match->start, match->end-1, match->dist);
+      if (args->strands) fprintf(out, ":%c", strand);
+   }
+   else {
+      if (args->showline) fprintf(out, "%ld ", line);
+      if (args->showpos)  fprintf(out, "%ld-%ld ", match->start, match->end-1);
+      if (args->showpos && args->strands) fprintf(out, "%c ", strand);
+      if (args->showdist) fprintf(out, "%ld ", match->dist);
+      // For all the options below we need to show the header
+      // if fasta format.
+      if (header) fprintf(out, "%s\n", info);
+      if (args->matchonly) {
+         fwrite(string + match->start, 1, match->end - match->start, out);
+      } else if (args->prefix) {
+         fwrite(string, 1, match->start, out);
+      } else if (args->endline) {
+         fwrite(string + match->end, 1, len - match->end, out);
+      } else if (args->split) {
+         fwrite(string, 1, match->start, out);
+         fputc('\t', out);
+         fwrite(string + match->start, 1, match->end - match->start, out);
+         fputc('\t', out);
+         fwrite(string + match->end, 1, len - match->end, out);
+      } else if (args->printline) {
+         if (color) {
+            fwrite(string, 1, match->start, out);
+            // Color match.
+            fprintf(out, (match->dist ? BOLDRED : BOLDGREEN));
+            fwrite(string + match->start, 1, match->end - match->start, out);
+            fprintf(out, RESET);
+            fwrite(string + match->end, 1, len - match->end, out);
+         }
+         else fwrite(string, 1, len, out);
+      }
+   }
+   fprintf(out, "\n");
+}
 
 
 int
@@ -41,7 +132,8 @@ seeq
 //   passed in "input", or from the standard input if the input argu-
 //   ment is set to NULL. The output generated is sent to the standard
 //   output and depends on the flags enabled in the 'args' struct.
-//   The matching metric is the Levenshtein distance. The input sequences
+//   The matching metric is the Levenshtein distance, or the Hamming distance
+//   if 'hamming' is set. The input sequences
 //   must be a succession of DNA/RNA nucleotides ('A','C','T','G','U','N')
 //   separated by newline characters '\n'.
 //                                                                        
@@ -62,6 +154,14 @@ seeq
 //     - endline: Prints only the end of the line starting after the match.
 //     - prefix: Prints only the beginnig of the line ending before the match.
 //     - invert: Prints only the non-matched lines.
+//     - precompile: Computes the whole DFA before matching.
+//     - hamming: Matches with substitutions only (Hamming distance).
+//     - strands: Matches the pattern and its reverse complement.
+//     - twobit: The input is a UCSC .2bit file (see 'seeqTwoBit').
+//     - composition: Composition filter (see SQ_COMPOSITION).
+//     - threads: Number of matching threads (see 'seeqThreads').
+//     - unordered: Print the lines of each thread as they are matched.
+//     - cachedir: DFA cache directory, NULL to disable the DFA cache.
 //     ** All format options are enabled setting its value to 1, except dist,
 //     ** which must contain a positive integer value.
 //                                                                        
@@ -73,11 +173,75 @@ seeq
 {
    const int verbose = args.verbose;
    const int tau = args.dist;
+   int options = args.precompile ? SQ_PRECOMPILE : SQ_LAZY;
+   if (args.hamming) options |= SQ_HAMMING;
+   if (args.strands) options |= SQ_BOTHSTRANDS;
+   // The 2-base transitions are not bounded by the memory limit.
+   if (args.memory == 0) options |= SQ_STRIDE2;
+   // The matching threads share the DFAs.
+   if (args.threads > 1) options |= SQ_SHARED;
+
+   seeq_t * sq = NULL;
+   char * cachefile = NULL;
+
+   // Look up the DFA cache (both-strand DFAs are not saved).
+   if (args.cachedir != NULL && !args.strands) {
+      seeq_t * key = seeqNew(expression, tau, 0);
+      if (key == NULL) {
+         fprintf(stderr, "error in 'seeqNew()'; %s\n:", seeqPrintError());
+         return EXIT_FAILURE;
+      }
+      cachefile = seeqCacheFile(args.cachedir, key, options);
+      if (cachefile != NULL) sq = seeqLoadOpt(cachefile, args.memory, options);
+      // Discard hash collisions.
+      if (sq != NULL && (sq->wlen != key->wlen || sq->tau != key->tau ||
+                         memcmp(sq->keys, key->keys, (size_t) key->wlen))) {
+         seeqFree(sq);
+         sq = NULL;
+      }
+      seeqFree(key);
+      if (sq != NULL) {
+         if (verbose) fprintf(stderr, "DFA loaded from %s\n", cachefile);
+         // Already in the cache.
+         free(cachefile);
+         cachefile = NULL;
+      }
+   }
 
-   seeq_t * sq = seeqNew(expression, tau, args.memory);
    if (sq == NULL) {
-      fprintf(stderr, "error in 'seeqNew()'; %s\n:", seeqPrintError());
-      return EXIT_FAILURE;
+      if (verbose && args.precompile) fprintf(stderr, "precompiling DFA...\n");
+      sq = seeqNewOpt(expression, tau, args.memory, options);
+      if (sq == NULL) {
+         fprintf(stderr, "error in 'seeqNew()'; %s\n:", seeqPrintError());
+         free(cachefile);
+         return EXIT_FAILURE;
+      }
+   }
+
+   // The DFAs are created or loaded with SQ_SHARED, a context can only
+   // fail for lack of memory.
+   if (args.threads > 1 && !args.twobit) {
+      seeq_ctx_t * ctx = seeqCtxNew(sq);
+      if (ctx == NULL) {
+         fprintf(stderr, "warning: cannot share the DFA (%s), matching with one thread\n", seeqPrintError());
+         args.threads = 1;
+      }
+      seeqCtxFree(ctx);
+   }
+
+   // 2-bit packed input.
+   if (args.twobit) {
+      clock_t clk = clock();
+      int retval = seeqTwoBit(input, sq, args);
+      if (verbose) fprintf(stderr, "done in %.3fs\n", (clock()-clk)*1.0/CLOCKS_PER_SEC);
+      if (retval == 0 && cachefile != NULL) {
+         mkdir(args.cachedir, 0777);
+         if (seeqSave(sq, cachefile))
+            fprintf(stderr, "warning: could not write DFA cache file %s: %s\n", cachefile, seeqPrintError());
+      }
+      free(cachefile);
+      seeqFree(sq);
+      return retval == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
    }
 
    if (verbose) fprintf(stderr, "opening input file... ");
@@ -85,6 +249,7 @@ seeq
    if (sqfile == NULL) {
       fprintf(stderr, "error in 'seeqOpen()': %s\n", seeqPrintError());
       seeqFree(sq);
+      free(cachefile);
       return EXIT_FAILURE;
    }
 
@@ -97,12 +262,13 @@ seeq
       clk = clock();
    }
 
-   int match_options = 0;
+   int match_options = args.composition ? SQ_COMPOSITION : SQ_NOFILTER;
    if (args.non_dna == 1) match_options |= SQ_CONVERT;
    else if (args.non_dna == 2) match_options |= SQ_IGNORE;
 
    if (args.count) {
-      long retval = seeqFileMatch(sqfile, sq, match_options, SQ_COUNTLINES);
+      long retval = args.threads > 1 ? seeqThreads(sqfile, sq, args, match_options) :
+         seeqFileMatch(sqfile, sq, match_options, SQ_COUNTLINES);
       if (retval < 0) fprintf(stderr, "error in 'seeqFileMatch()': %s\n", seeqPrintError());
       else fprintf(stdout, "%ld\n", retval);
    } else {
@@ -121,58 +287,21 @@ seeq
         !args.showdist;
 
       long retval = 0;
-      if (args.invert) {
+      if (args.threads > 1) {
+         retval = seeqThreads(sqfile, sq, args, match_options);
+      } else if (args.invert) {
          while ((retval = seeqFileMatch(sqfile, sq, match_options, SQ_NOMATCH)) > 0) {
             if (args.showline) fprintf(stdout, "%ld ", sqfile->line);
             if (print_fasta_header) fprintf(stdout, "%s\n", sqfile->info);
             fprintf(stdout, "%s\n", sq->string);
          }
       } else {
+         const int color = COLOR_TERMINAL && isatty(fileno(stdout));
          while ((retval = seeqFileMatch(sqfile, sq, match_options, SQ_MATCH)) > 0) {
             match_t * match;
-            while((match = seeqMatchIter(sq)) != NULL) {
-               if (args.compact) fprintf(stdout, "%ld:%ld-%ld:%ld",sqfile->line, match->start, match->end-1, match->dist);
-               else {
-                  if (args.showline) fprintf(stdout, "%ld ", sqfile->line);
-                  if (args.showpos)  fprintf(stdout, "%ld-%ld ", match->start, match->end-1);
-                  if (args.showdist) fprintf(stdout, "%ld ", match->dist);
-                  // For all the options below we need to show the header
-                  // if fasta format.
-                  if (print_fasta_header) fprintf(stdout, "%s\n", sqfile->info);
-                  if (args.matchonly) {
-                     char tmp = sq->string[match->end];
-                     sq->string[match->end] = 0;
-                     fprintf(stdout, "%s", sq->string + match->start);
-                     sq->string[match->end] = tmp;
-                  } else if (args.prefix) {
-                     sq->string[match->start] = 0;
-                     fprintf(stdout, "%s", sq->string);
-                  } else if (args.endline) {
-                     fprintf(stdout, "%s", sq->string + match->end);
-                  } else if (args.split) {
-                     fprintf(stdout, "%.*s\t", (unsigned int) match->start, sq->string);
-                     fprintf(stdout, "%.*s\t", (unsigned int) (match->end - match->start), sq->string + match->start);
-                     fprintf(stdout, "%.*s", (unsigned int) (strlen(sq->string) - match->end), sq->string + match->end);
-                  } else if (args.printline) {
-                     if (COLOR_TERMINAL && isatty(fileno(stdout))) {
-                        // Prefix.
-                        char tmp = sq->string[match->start];
-                        sq->string[match->start] = 0;
-                        fprintf(stdout, "%s", sq->string);
-                        sq->string[match->start] = tmp;
-                        // Color match.
-                        fprintf(stdout, (match->dist ? BOLDRED : BOLDGREEN));
-                        tmp = sq->string[match->end];
-                        sq->string[match->end] = 0;
-                        fprintf(stdout, "%s" RESET, sq->string + match->start);
-                        sq->string[match->end] = tmp;
-                        fprintf(stdout, "%s", sq->string + match->end);
-                     }
-                     else fprintf(stdout, "%s", sq->string);
-                  }
-               }
-               fprintf(stdout, "\n");
-            }
+            size_t len = strlen(sq->string);
+            while((match = seeqMatchIter(sq)) != NULL)
+               print_match(stdout, sq->string, len, sqfile->line, sqfile->info, match, &args, print_fasta_header, color);
          }
       }
       if (retval == -1) {
@@ -182,22 +311,466 @@ seeq
    
    if (verbose) {
       size_t * data = (size_t *) sq->dfa;
-      size_t mem_dfa  = *data * ((6*4) + strlen(expression)/5 + (strlen(expression)%5 > 0));
+      size_t mem_dfa  = *data * (*(data + 3) + strlen(expression)/5 + (strlen(expression)%5 > 0));
       size_t mem_trie = *(size_t *)(*(data + 4)) * 16;
-      data = (size_t *) sq->rdfa;
-      size_t mem_rdfa  = *data * ((6*4) + strlen(expression)/5 + (strlen(expression)%5 > 0));
-      size_t mem_rtrie = *(size_t *)(*(data + 4)) * 16;
+      // Pattern sets have no reverse DFA.
+      size_t mem_rdfa = 0, mem_rtrie = 0;
+      if ((data = (size_t *) sq->rdfa) != NULL) {
+         mem_rdfa  = *data * (*(data + 3) + strlen(expression)/5 + (strlen(expression)%5 > 0));
+         mem_rtrie = *(size_t *)(*(data + 4)) * 16;
+      }
       double mb = 1024.0*1024.0;
       fprintf(stderr, "memory: %.2f MB (DFA: %.2f MB, trie: %.2f MB)\n", (mem_dfa + mem_trie + mem_rdfa + mem_rtrie)/mb, (mem_dfa+mem_rdfa)/mb, (mem_trie+mem_rtrie)/mb);
+      seeqstats_t * st = &sq->ctx.stats;
+      fprintf(stderr, "prefilter: %zu of %zu lines rejected, %zu of %zu bases skipped\n",
+              st->rejected, st->texts, st->skipped, st->bases);
+      if (args.composition)
+         fprintf(stderr, "composition: %zu of %zu match ends excluded\n", st->excluded, st->checked);
       fprintf(stderr, "done in %.3fs\n", (clock()-clk)*1.0/CLOCKS_PER_SEC);
    }
    
+   // Save the DFA to the cache.
+   if (cachefile != NULL) {
+      mkdir(args.cachedir, 0777);
+      if (seeqSave(sq, cachefile))
+         fprintf(stderr, "warning: could not write DFA cache file %s: %s\n", cachefile, seeqPrintError());
+      free(cachefile);
+   }
+
    seeqFree(sq);
    seeqClose(sqfile);
 
    return EXIT_SUCCESS;
 }
 
+
+char *
+seeqCacheFile
+(
+ const char * cachedir,
+ seeq_t     * sq,
+ int          options
+)
+// SYNOPSIS:                                                              
+//   Builds the path of the DFA cache file of 'sq' in 'cachedir'. The file
+//   name is the hash (64-bit FNV-1a) of the pattern keys, the distance, the
+//   metric and the compile mode, so lazy DFAs are never loaded for '-w'.
+//                                                                        
+// PARAMETERS:                                                            
+//   cachedir : DFA cache directory.
+//   sq       : pointer to a seeq_t structure. (see 'seeqNew')
+//   options  : compile options of the DFA (see 'seeqNewOpt').
+//
+// RETURN:                                                                
+//   Returns the path of the cache file (allocated with malloc) or NULL
+//   in case of error.
+//
+// SIDE EFFECTS:
+//   None.
+{
+   uint64_t hash = 0xcbf29ce484222325ULL;
+   for (int i = 0; i < sq->wlen; i++) {
+      hash ^= (uint8_t) sq->keys[i];
+      hash *= 0x100000001b3ULL;
+   }
+   for (int i = 0; i < 4; i++) {
+      hash ^= (uint8_t) (sq->tau >> (8*i));
+      hash *= 0x100000001b3ULL;
+   }
+   hash ^= (uint8_t) ((options & (MASK_METRIC | MASK_COMPILE)) >> 8);
+   hash *= 0x100000001b3ULL;
+
+   char * path = malloc(strlen(cachedir) + 32);
+   if (path == NULL) return NULL;
+   sprintf(path, "%s/%016llx.sqdfa", cachedir, (unsigned long long) hash);
+   return path;
+}
+
+static uint64_t
+twobit_read
+(
+ const uint8_t * p,
+ int             swap,
+ int             bytes
+)
+// SYNOPSIS:                                                              
+//   Reads a 32 or 64-bit integer of a .2bit file, in the byte order of the
+//   file (see 'seeqTwoBit').
+{
+   uint64_t v = 0;
+   for (int i = 0; i < bytes; i++) v |= (uint64_t) p[swap ? bytes-1-i : i] << (8*i);
+   return v;
+}
+
+int
+seeqTwoBit
+(
+ const char       * input,
+ seeq_t           * sq,
+ struct seeqarg_t   args
+)
+// SYNOPSIS:                                                              
+//   Matches the sequences of a UCSC .2bit file, each one as a line of text,
+//   without decoding them (see 'seeqPackedMatch'). The N blocks of the file
+//   are passed as the mask of 'N' bases. The matches are printed as
+//   'name:start-end:dist', followed by ':+' or ':-' with both strands, and
+//   by the matched bases if 'matchonly' is set. With 'count', the number of
+//   matching sequences (or matches, with 'all') is printed instead, and with
+//   'invert' the names of the sequences without matches.
+//                                                                        
+// PARAMETERS:                                                            
+//   input : name of the .2bit file, or NULL to read it from stdin.
+//   sq    : pointer to a seeq_t structure. (see 'seeqNew')
+//   args  : seeq arguments (see 'seeq').
+//
+// RETURN:                                                                
+//   Returns 0 on success or -1 in case of error. The error is printed.
+//
+// SIDE EFFECTS:
+//   The match stack of 'sq' is modified.
+{
+   // Map the file, or read stdin.
+   uint8_t * data = NULL;
+   size_t size = 0;
+   int mapped = input != NULL;
+   if (mapped) {
+      int fd = open(input, O_RDONLY);
+      struct stat st;
+      if (fd == -1 || fstat(fd, &st) == -1) {
+         fprintf(stderr, "error opening '%s': %s\n", input, strerror(errno));
+         if (fd != -1) close(fd);
+         return -1;
+      }
+      size = (size_t) st.st_size;
+      data = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+      close(fd);
+      if (data == MAP_FAILED) {
+         fprintf(stderr, "error mapping '%s': %s\n", input, strerror(errno));
+         return -1;
+      }
+   } else {
+      size_t bufsz = 0;
+      size_t readsz;
+      do {
+         if (size == bufsz) {
+            bufsz = bufsz ? 2*bufsz : 1 << 20;
+            uint8_t * buf = realloc(data, bufsz);
+            if (buf == NULL) {
+               fprintf(stderr, "error reading stdin: %s\n", strerror(errno));
+               free(data);
+               return -1;
+            }
+            data = buf;
+         }
+         readsz = fread(data + size, 1, bufsz - size, stdin);
+         size += readsz;
+      } while (readsz > 0);
+   }
+
+   // Header: signature, version, sequence count and reserved word.
+   int swap = 0, retval = -1;
+   uint64_t nseq = 0, version = 0, pos = 16;
+   if (size >= 16) {
+      swap = twobit_read(data, 0, 4) != 0x1A412743;
+      version = twobit_read(data + 4, swap, 4);
+      nseq = twobit_read(data + 8, swap, 4);
+   }
+   const int offsz = version == 1 ? 8 : 4;
+   if (size < 16 || twobit_read(data, swap, 4) != 0x1A412743 || version > 1) {
+      fprintf(stderr, "error: input is not a .2bit file.\n");
+      nseq = 0;
+   } else {
+      retval = 0;
+   }
+
+   int options = SQ_PACKED_TCAG | (args.composition ? SQ_COMPOSITION : SQ_NOFILTER);
+   if (args.count) options |= args.all ? SQ_ALL : SQ_FIRST;
+   else if (args.all) options |= SQ_ALL;
+   else if (args.best) options |= SQ_BEST;
+
+   uint8_t * nmask = NULL;
+   size_t masksz = 0;
+   long count = 0;
+   int corrupt = 0;
+   for (uint64_t k = 0; k < nseq; k++) {
+      // Index entry: name and offset of the sequence record.
+      if (pos >= size || size - pos < 1u + data[pos] + offsz) {
+         corrupt = 1;
+         break;
+      }
+      int namelen = data[pos];
+      const char * name = (const char *) data + pos + 1;
+      uint64_t off = twobit_read(data + pos + 1 + namelen, swap, offsz);
+      pos += 1u + (uint64_t) namelen + (uint64_t) offsz;
+
+      // Record: size, N blocks, mask blocks, reserved word and bases.
+      if (off >= size || size - off < 8) {
+         corrupt = 1;
+         break;
+      }
+      uint64_t nbases  = twobit_read(data + off, swap, 4);
+      uint64_t nblocks = twobit_read(data + off + 4, swap, 4);
+      uint64_t mpos = off + 8 + 8*nblocks;
+      uint64_t dna = mpos + 4 > size ? size + 1 : mpos + 4 + 8*twobit_read(data + mpos, swap, 4) + 4;
+      if (dna > size || size - dna < (nbases + 3) / 4) {
+         corrupt = 1;
+         break;
+      }
+
+      // Mask of the N blocks.
+      if (nblocks > 0) {
+         size_t need = (size_t) (nbases + 7) / 8;
+         if (need > masksz) {
+            uint8_t * buf = realloc(nmask, need);
+            if (buf == NULL) {
+               fprintf(stderr, "error: %s\n", strerror(errno));
+               retval = -1;
+               break;
+            }
+            nmask = buf;
+            masksz = need;
+         }
+         memset(nmask, 0, need);
+         for (uint64_t b = 0; b < nblocks; b++) {
+            uint64_t start = twobit_read(data + off + 8 + 4*b, swap, 4);
+            uint64_t len   = twobit_read(data + off + 8 + 4*(nblocks+b), swap, 4);
+            for (uint64_t i = start; i < start + len && i < nbases; i++) nmask[i/8] |= (uint8_t) (1 << (i%8));
+         }
+      }
+
+      long hits = seeqPackedMatch(data + dna, (size_t) nbases, nblocks > 0 ? nmask : NULL, sq, options);
+      if (hits < 0) {
+         fprintf(stderr, "error in 'seeqPackedMatch()': %s\n", seeqPrintError());
+         retval = -1;
+         break;
+      }
+      count += hits;
+      if (args.count) continue;
+      if (args.invert) {
+         if (hits == 0) fprintf(stdout, "%.*s\n", namelen, name);
+         continue;
+      }
+
+      match_t * match;
+      while ((match = seeqMatchIter(sq)) != NULL) {
+         fprintf(stdout, "%.*s:%ld-%ld:%ld", namelen, name, match->start, match->end-1, match->dist);
+         if (args.strands) fprintf(stdout, ":%c", match->strand ? '-' : '+');
+         if (args.matchonly) {
+            fputc('\t', stdout);
+            for (size_t i = match->start; i < match->end; i++) {
+               int n = nblocks > 0 && (nmask[i/8] >> (i%8)) & 1;
+               fputc(n ? 'N' : "TCAG"[(data[dna + i/4] >> (6 - 2*(i%4))) & 3], stdout);
+            }
+         }
+         fputc('\n', stdout);
+      }
+   }
+   if (corrupt) {
+      fprintf(stderr, "error: .2bit file is truncated or corrupted.\n");
+      retval = -1;
+   }
+   if (retval == 0 && args.count) fprintf(stdout, "%ld\n", count);
+
+   free(nmask);
+   if (mapped) {
+      if (data != NULL) munmap(data, size);
+   } else {
+      free(data);
+   }
+   return retval;
+}
+
+static uint64_t
+newline_mask
+(
+ const char * data,
+ size_t       len
+)
+// SYNOPSIS:                                                              
+//   Returns the newlines of the first 'len' bytes of 'data' (at most 64),
+//   bit i set if data[i] is a newline.
+{
+#ifdef SEEQ_SSE2
+   if (len == 64) {
+      const __m128i nl = _mm_set1_epi8('\n');
+      uint64_t m0 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) data), nl));
+      uint64_t m1 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (data + 16)), nl));
+      uint64_t m2 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (data + 32)), nl));
+      uint64_t m3 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (data + 48)), nl));
+      return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+   }
+#endif
+   uint64_t mask = 0;
+   for (size_t i = 0; i < len; i++)
+      if (data[i] == '\n') mask |= (uint64_t) 1 << i;
+   return mask;
+}
+
+
+static int
+file_fill
+(
+ seeqfile_t * sqfile
+)
+// SYNOPSIS:                                                              
+//   Reads more input after 'sqfile->end'. The line at 'sqfile->pos' (none
+//   of its bytes is a newline) is first moved to the start of the buffer,
+//   which grows when the line fills it.
+//
+// RETURN:                                                                
+//   Returns 0 on success (sqfile->eof is set at the end of the input), or
+//   -1 in case of error and seeqerr is set.
+{
+   size_t tail = sqfile->end - sqfile->pos;
+   if (tail > 0 && sqfile->pos > 0) memmove(sqfile->buf, sqfile->buf + sqfile->pos, tail);
+   sqfile->pos = 0;
+   sqfile->end = tail;
+   sqfile->win = sqfile->scanned = tail;
+   sqfile->mask = 0;
+
+   if (sqfile->bufsz - tail < BLOCK_SIZE / 2) {
+      size_t bufsz = sqfile->bufsz < BLOCK_SIZE ? BLOCK_SIZE : 2 * sqfile->bufsz;
+      char * buf = realloc(sqfile->buf, bufsz);
+      if (buf == NULL) {
+         seeqerr = 0;
+         return -1;
+      }
+      sqfile->buf = buf;
+      sqfile->bufsz = bufsz;
+   }
+
+   ssize_t readsz;
+   do readsz = read(fileno(sqfile->fdi), sqfile->buf + tail, sqfile->bufsz - tail);
+   while (readsz < 0 && errno == EINTR);
+   if (readsz < 0) {
+      seeqerr = 0;
+      return -1;
+   }
+   if (readsz == 0) sqfile->eof = 1;
+   sqfile->end += (size_t) readsz;
+   return 0;
+}
+
+
+static int
+file_line
+(
+ seeqfile_t  * sqfile,
+ const char ** line,
+ size_t      * len
+)
+// SYNOPSIS:                                                              
+//   Passes the next line of the input, without the newline. The newlines
+//   are found in windows of 64 bytes and kept as a bit mask, so that the
+//   short lines cost a few bit operations each.
+//
+// PARAMETERS:                                                            
+//   sqfile : pointer to a seeqfile_t structure obtained with 'seeqOpen'.
+//   line   : set to the start of the line, in the input buffer.
+//   len    : set to the length of the line.
+//
+// RETURN:                                                                
+//   Returns 1 if a line is read, 0 at the end of the input, or -1 in case
+//   of error and seeqerr is set.
+//
+// SIDE EFFECTS:
+//   The line is valid until the next call.
+{
+   while (sqfile->mask == 0) {
+      size_t w = sqfile->end - sqfile->scanned;
+      if (w > 64) w = 64;
+      if (w > 0) {
+         sqfile->win = sqfile->scanned;
+         sqfile->mask = newline_mask(sqfile->buf + sqfile->win, w);
+         sqfile->scanned += w;
+      } else if (!sqfile->eof) {
+         if (file_fill(sqfile) == -1) return -1;
+      } else if (sqfile->pos < sqfile->end) {
+         // Last line, without newline.
+         *line = sqfile->buf + sqfile->pos;
+         *len  = sqfile->end - sqfile->pos;
+         sqfile->pos = sqfile->end;
+         return 1;
+      } else {
+         return 0;
+      }
+   }
+
+   size_t nl = sqfile->win + (size_t) __builtin_ctzll(sqfile->mask);
+   sqfile->mask &= sqfile->mask - 1;
+   *line = sqfile->buf + sqfile->pos;
+   *len  = nl - sqfile->pos;
+   sqfile->pos = nl + 1;
+   return 1;
+}
+
+
+static ssize_t
+file_read
+(
+ seeqfile_t * sqfile,
+ char       * data,
+ size_t       size
+)
+// SYNOPSIS:                                                              
+//   Copies the next 'size' bytes of a stream to 'data', or less at the end
+//   of the input. The bytes buffered by 'seeqOpen' are copied first.
+//
+// RETURN:                                                                
+//   Returns the number of bytes copied, or -1 in case of error and seeqerr
+//   is set.
+{
+   size_t copied = sqfile->end - sqfile->pos;
+   if (copied > size) copied = size;
+   if (copied > 0) memcpy(data, sqfile->buf + sqfile->pos, copied);
+   sqfile->pos += copied;
+   sqfile->win = sqfile->scanned = sqfile->pos;
+   sqfile->mask = 0;
+
+   while (copied < size && !sqfile->eof) {
+      ssize_t readsz = read(fileno(sqfile->fdi), data + copied, size - copied);
+      if (readsz < 0) {
+         if (errno == EINTR) continue;
+         seeqerr = 0;
+         return -1;
+      }
+      if (readsz == 0) sqfile->eof = 1;
+      copied += (size_t) readsz;
+   }
+   return (ssize_t) copied;
+}
+
+
+static int
+copy_line
+(
+ char      ** dest,
+ size_t     * destsz,
+ const char * line,
+ size_t       len
+)
+// SYNOPSIS:                                                              
+//   Copies a line to the buffer '*dest' as a null-terminated string. The
+//   buffer grows if needed.
+//
+// RETURN:                                                                
+//   Returns 0 on success, or -1 in case of error and seeqerr is set.
+{
+   if (*destsz < len + 1) {
+      char * buf = realloc(*dest, len + 1);
+      if (buf == NULL) {
+         seeqerr = 0;
+         return -1;
+      }
+      *dest = buf;
+      *destsz = len + 1;
+   }
+   memcpy(*dest, line, len);
+   (*dest)[len] = 0;
+   return 0;
+}
+
+
 seeqfile_t *
 seeqOpen
 (
@@ -206,7 +779,8 @@ seeqOpen
 // SYNOPSIS:                                                              
 //   Creates a seeqfile_t structure to match a file directly against a pattern.
 //   If 'file' is set to NULL, the lines will be read from 'stdin'. The returned
-//   structure must be passed to 'seeqFileMatch'.
+//   structure must be passed to 'seeqFileMatch'. Regular files are mapped in
+//   memory, other inputs are read in blocks of BLOCK_SIZE bytes.
 //                                                                        
 // PARAMETERS:                                                            
 //   file       : name of the file to match. Set to NULL to read from stdin.
@@ -239,18 +813,39 @@ seeqOpen
    sqfile->line = 0;
    sqfile->fdi = fdi;
 
+   // Map regular files, read the first block of the others.
+   struct stat st;
+   if (file != NULL && fstat(fileno(fdi), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void * data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fileno(fdi), 0);
+      if (data != MAP_FAILED) {
+         madvise(data, (size_t) st.st_size, MADV_SEQUENTIAL);
+         sqfile->buf = data;
+         sqfile->bufsz = sqfile->end = (size_t) st.st_size;
+         sqfile->mapped = 1;
+         sqfile->eof = 1;
+      }
+   }
+   if (!sqfile->mapped && file_fill(sqfile) == -1) {
+      int errnum = errno;
+      seeqClose(sqfile);
+      errno = errnum;
+      seeqerr = 0;
+      return NULL;
+   }
+
    // Check if file is fasta.
-   char c = getc(fdi);
-   if (c == '>') {
+   if (sqfile->end > 0 && sqfile->buf[0] == '>') {
       sqfile->flags = 1;
-      sqfile->info = calloc(32, sizeof(char));
+      sqfile->infosz = 32;
+      sqfile->info = calloc(sqfile->infosz, sizeof(char));
       if (sqfile->info == NULL) {
-         seeqerr = errno;
-         free(sqfile);
+         int errnum = errno;
+         seeqClose(sqfile);
+         errno = errnum;
+         seeqerr = 0;
          return NULL;
       }
    }
-   ungetc(c, fdi);
 
    return sqfile;
 }
@@ -277,6 +872,8 @@ seeqClose
    FILE * fdi = sqfile->fdi;
 
    // Free and clean.
+   if (sqfile->mapped) munmap(sqfile->buf, sqfile->bufsz);
+   else free(sqfile->buf);
    free(sqfile->info);
    sqfile->info = NULL;
    free(sqfile);
@@ -356,37 +953,600 @@ seeqFileMatch
    // Aux vars.
    long count = 0;
    size_t startline = sqfile->line;
-   ssize_t readsz;
-
-   while ((readsz = getline(&(sq->string), &(sq->bufsz), sqfile->fdi)) > 0) {
-      // Remove newline.
-      char * data = sq->string;
-      if (data[readsz-1] == '\n') data[--readsz] = 0;
+   const char * data;
+   size_t len;
+   int status;
 
+   // The lines are matched in the input buffer, and copied to 'sq->string'
+   // only when returned.
+   while ((status = file_line(sqfile, &data, &len)) > 0) {
       // If fasta format, keep the header in buffer.
-      if (format_is_fasta && data[0] == '>') {
-         sqfile->info = strdup(data);
-         if (sqfile->info == NULL) {
-            seeqerr = 666;
-            return -1;
-         }
+      if (format_is_fasta && len > 0 && data[0] == '>') {
+         if (copy_line(&sqfile->info, &sqfile->infosz, data, len) == -1) return -1;
          continue;
       }
 
       // Dicount headers from line count.
       sqfile->line++;
 
-      // Call String Match
-      long rval = seeqStringMatch(data, sq, match_opt);
+      // Match the line in the read buffer, its length is known.
+      long rval = seeqMatchN(data, len, sq, match_opt);
       if (rval == -1) return -1;
       else count += rval;
 
       // Break when match is found.
       if (file_opt == SQ_ANY || (count > 0 && (file_opt == SQ_MATCH)) || ((rval == 0) && (file_opt == SQ_NOMATCH)))
-         return 1;
+         return copy_line(&sq->string, &sq->bufsz, data, len) == -1 ? -1 : 1;
    }
+   if (status == -1) return -1;
 
-   // If nothing was read, return 0.
-   if (sqfile->line == startline) return 0;
+   // If nothing was read, return 0. The lines matched before EOF were not
+   // the line searched by SQ_MATCH or SQ_NOMATCH.
+   if (sqfile->line == startline || file_opt == SQ_MATCH || file_opt == SQ_NOMATCH) return 0;
    else return count;
 }
+
+
+// Threaded matching (see 'seeqThreads'). The input is cut in blocks of
+// about BLOCK_SIZE bytes that end at a newline.
+
+typedef struct block_t block_t;
+typedef struct pipe_t  pipe_t;
+typedef struct worker_t worker_t;
+
+struct block_t {
+   size_t    seq;      // Position of the block in the input.
+   size_t    line;     // Lines before the block (headers excluded).
+   char    * info;     // FASTA header in effect at the start of the block.
+   size_t    infosz;
+   const char * text;  // Lines of the block, in 'data' or in the file mapping.
+   size_t    size;
+   char    * data;     // Copy of the lines read from a stream.
+   size_t    bufsz;
+   char    * out;      // Output of the block.
+   size_t    outsz;
+   long      count;    // Matched lines (SQ_COUNTLINES).
+   int       err;      // seeqerr and errno of an error, 'err' -1 if none.
+   int       errnum;
+   block_t * next;
+};
+
+struct pipe_t {
+   pthread_mutex_t    lock;
+   pthread_cond_t     cond;
+   block_t          * free;     // Blocks to fill.
+   block_t          * todo;     // Blocks to match, in input order.
+   block_t         ** last;
+   block_t          * done;     // Blocks to write.
+   size_t             nread;
+   size_t             nwritten;
+   int                eof;      // No more blocks will be read.
+   int                err;      // First error (see 'block_t').
+   int                errnum;
+   long               count;
+   seeqstats_t        stats;
+   // Matching and output.
+   const seeq_t     * sq;
+   struct seeqarg_t   args;
+   int                options;
+   int                fasta;
+   int                header;
+   int                color;
+};
+
+struct worker_t {
+   pipe_t     * pipe;
+   seeq_ctx_t * ctx;
+   pthread_t    thread;
+};
+
+
+static void
+block_match
+(
+ pipe_t     * p,
+ seeq_ctx_t * ctx,
+ block_t    * b
+)
+// SYNOPSIS:                                                              
+//   Matches the lines of a block and prints the output to 'b->out', as
+//   'seeq' prints it. The lines are not modified, they may be read-only.
+{
+   b->count = 0;
+   b->err   = -1;
+   FILE * out = open_memstream(&b->out, &b->outsz);
+   if (out == NULL) {
+      b->err = 0;
+      b->errnum = errno;
+      return;
+   }
+
+   // FASTA headers of the block are copied to be printed as strings.
+   const char * info = b->info;
+   char * header = NULL;
+   size_t headersz = 0;
+   size_t line = b->line;
+   const char * end = b->text + b->size;
+   for (const char * s = b->text; s < end; ) {
+      const char * nl = memchr(s, '\n', (size_t) (end - s));
+      size_t len = nl != NULL ? (size_t) (nl - s) : (size_t) (end - s);
+      const char * string = s;
+      s += len + 1;
+
+      if (p->fasta && string[0] == '>') {
+         if (copy_line(&header, &headersz, string, len) == -1) {
+            b->err = 0;
+            b->errnum = errno;
+            break;
+         }
+         info = header;
+         continue;
+      }
+      line++;
+
+      long hits = seeqCtxMatchN(string, len, p->sq, ctx, p->options);
+      if (hits < 0) {
+         b->err = ctx->err;
+         b->errnum = errno;
+         break;
+      }
+      if (p->args.count) {
+         b->count += hits;
+      } else if (p->args.invert) {
+         if (hits > 0) continue;
+         if (p->args.showline) fprintf(out, "%ld ", line);
+         if (p->header) fprintf(out, "%s\n", info);
+         fwrite(string, 1, len, out);
+         fputc('\n', out);
+      } else {
+         match_t * match;
+         while ((match = seeqCtxMatchIter(ctx)) != NULL)
+            print_match(out, string, len, line, info, match, &p->args, p->header, p->color);
+      }
+   }
+   free(header);
+
+   if (fclose(out) != 0 && b->err == -1) {
+      b->err = 0;
+      b->errnum = errno;
+   }
+}
+
+
+static void *
+pipe_match
+(
+ void * arg
+)
+// SYNOPSIS:                                                              
+//   Matcher thread of 'seeqThreads'. Takes the blocks in input order and
+//   passes them to the writer when matched.
+{
+   worker_t * w = arg;
+   pipe_t * p = w->pipe;
+   for (;;) {
+      pthread_mutex_lock(&p->lock);
+      while (p->todo == NULL && !p->eof) pthread_cond_wait(&p->cond, &p->lock);
+      block_t * b = p->todo;
+      if (b == NULL) {
+         pthread_mutex_unlock(&p->lock);
+         break;
+      }
+      p->todo = b->next;
+      if (p->todo == NULL) p->last = &p->todo;
+      pthread_mutex_unlock(&p->lock);
+
+      block_match(p, w->ctx, b);
+
+      pthread_mutex_lock(&p->lock);
+      b->next = p->done;
+      p->done = b;
+      pthread_cond_broadcast(&p->cond);
+      pthread_mutex_unlock(&p->lock);
+   }
+
+   seeqstats_t * st = &w->ctx->stats;
+   pthread_mutex_lock(&p->lock);
+   p->stats.texts    += st->texts;
+   p->stats.rejected += st->rejected;
+   p->stats.bases    += st->bases;
+   p->stats.skipped  += st->skipped;
+   p->stats.checked  += st->checked;
+   p->stats.excluded += st->excluded;
+   pthread_mutex_unlock(&p->lock);
+   return NULL;
+}
+
+
+static void *
+pipe_write
+(
+ void * arg
+)
+// SYNOPSIS:                                                              
+//   Writer thread of 'seeqThreads'. Writes the output of the blocks in
+//   input order (or as they are matched with 'unordered') and returns
+//   them to the reader. Nothing is written after an error.
+{
+   pipe_t * p = arg;
+   for (;;) {
+      pthread_mutex_lock(&p->lock);
+      block_t ** b;
+      for (;;) {
+         b = &p->done;
+         if (!p->args.unordered)
+            while (*b != NULL && (*b)->seq != p->nwritten) b = &(*b)->next;
+         if (*b != NULL || (p->eof && p->nwritten == p->nread)) break;
+         pthread_cond_wait(&p->cond, &p->lock);
+      }
+      block_t * blk = *b;
+      if (blk == NULL) {
+         pthread_mutex_unlock(&p->lock);
+         break;
+      }
+      *b = blk->next;
+      int failed = p->err != -1;
+      pthread_mutex_unlock(&p->lock);
+
+      if (!failed) {
+         if (blk->outsz > 0 && fwrite(blk->out, 1, blk->outsz, stdout) != blk->outsz && blk->err == -1) {
+            blk->err = 0;
+            blk->errnum = errno;
+         }
+      }
+      free(blk->out);
+      blk->out = NULL;
+
+      pthread_mutex_lock(&p->lock);
+      if (!failed) {
+         p->count += blk->count;
+         if (blk->err != -1) {
+            p->err = blk->err;
+            p->errnum = blk->errnum;
+         }
+      }
+      p->nwritten++;
+      blk->next = p->free;
+      p->free = blk;
+      pthread_cond_broadcast(&p->cond);
+      pthread_mutex_unlock(&p->lock);
+   }
+   return NULL;
+}
+
+
+static void
+block_map
+(
+ block_t    * b,
+ seeqfile_t * sqfile,
+ int        * eof
+)
+// SYNOPSIS:                                                              
+//   Passes the next block of a mapped file (see 'seeqOpen') without copying
+//   it. The block ends at the last newline of the next BLOCK_SIZE bytes, or
+//   at the first one after them when a line is longer.
+{
+   const char * text = sqfile->buf + sqfile->pos;
+   size_t avail = sqfile->end - sqfile->pos;
+   size_t cut = avail;
+   if (avail > BLOCK_SIZE) {
+      const char * nl = memrchr(text, '\n', BLOCK_SIZE);
+      if (nl == NULL) nl = memchr(text + BLOCK_SIZE, '\n', avail - BLOCK_SIZE);
+      if (nl != NULL) cut = (size_t) (nl - text) + 1;
+   }
+   b->text = text;
+   b->size = cut;
+   sqfile->pos += cut;
+   sqfile->win = sqfile->scanned = sqfile->pos;
+   sqfile->mask = 0;
+   *eof = sqfile->pos == sqfile->end;
+}
+
+
+static int
+block_read
+(
+ block_t    * b,
+ seeqfile_t * sqfile,
+ char      ** carry,
+ size_t     * carrysz,
+ int        * eof
+)
+// SYNOPSIS:                                                              
+//   Reads the next block of a stream (stdin or a pipe) to 'b->data'. The
+//   block starts with the bytes after the last newline of the previous one
+//   ('carry') and ends at the last newline, after the first BLOCK_SIZE bytes
+//   read. The bytes after it are copied to 'carry'.
+//
+// RETURN:                                                                
+//   Returns 0 on success, or -1 in case of error and seeqerr is set.
+{
+   size_t size = *carrysz, cut = 0;
+   if (size > 0) {
+      if (b->bufsz < size) {
+         char * buf = realloc(b->data, size);
+         if (buf == NULL) {
+            seeqerr = 0;
+            return -1;
+         }
+         b->data = buf;
+         b->bufsz = size;
+      }
+      memcpy(b->data, *carry, size);
+   }
+   while (!*eof && cut == 0) {
+      if (b->bufsz < size + BLOCK_SIZE) {
+         char * buf = realloc(b->data, size + BLOCK_SIZE);
+         if (buf == NULL) {
+            seeqerr = 0;
+            return -1;
+         }
+         b->data = buf;
+         b->bufsz = size + BLOCK_SIZE;
+      }
+      ssize_t readsz = file_read(sqfile, b->data + size, BLOCK_SIZE);
+      if (readsz < 0) return -1;
+      char * nl = memrchr(b->data + size, '\n', (size_t) readsz);
+      size += (size_t) readsz;
+      if (readsz < BLOCK_SIZE) {
+         *eof = 1;
+         cut = size;
+      } else if (nl != NULL) {
+         cut = (size_t) (nl - b->data) + 1;
+      }
+   }
+   if (size - cut > *carrysz) {
+      char * buf = realloc(*carry, size - cut);
+      if (buf == NULL) {
+         seeqerr = 0;
+         return -1;
+      }
+      *carry = buf;
+   }
+   *carrysz = size - cut;
+   if (*carrysz > 0) memcpy(*carry, b->data + cut, *carrysz);
+   b->text = b->data;
+   b->size = cut;
+   return 0;
+}
+
+
+static int
+pipe_read
+(
+ pipe_t     * p,
+ seeqfile_t * sqfile
+)
+// SYNOPSIS:                                                              
+//   Reader of 'seeqThreads'. Cuts the input in blocks that end at a newline
+//   (a longer line makes a larger block), numbers their lines and passes
+//   them to the matchers. The blocks of mapped files are ranges of the
+//   mapping (see 'block_map'), only streams are copied (see 'block_read').
+//
+// RETURN:                                                                
+//   Returns 0 on success, or -1 in case of error and seeqerr is set.
+{
+   char * carry = NULL;    // Bytes after the last newline of a block.
+   size_t carrysz = 0;
+   char * info = NULL;     // Last FASTA header.
+   size_t infolen = 0;
+   size_t line = 0;
+   int eof = 0, retval = 0;
+
+   while (!eof) {
+      pthread_mutex_lock(&p->lock);
+      while (p->free == NULL && p->err == -1) pthread_cond_wait(&p->cond, &p->lock);
+      block_t * b = p->free;
+      if (p->err != -1) b = NULL;
+      else p->free = b->next;
+      pthread_mutex_unlock(&p->lock);
+      if (b == NULL) break;
+
+      if (sqfile->mapped) {
+         block_map(b, sqfile, &eof);
+      } else if (block_read(b, sqfile, &carry, &carrysz, &eof) == -1) {
+         retval = -1;
+         break;
+      }
+
+      // Header and number of the line before the block.
+      if (b->infosz < infolen + 1) {
+         char * buf = realloc(b->info, infolen + 1);
+         if (buf == NULL) {
+            seeqerr = 0;
+            retval = -1;
+            break;
+         }
+         b->info = buf;
+         b->infosz = infolen + 1;
+      }
+      if (infolen > 0) memcpy(b->info, info, infolen);
+      b->info[infolen] = 0;
+      b->line = line;
+
+      // Lines of the block (a FASTA header is copied when its record ends
+      // in another block).
+      const char * header = NULL;
+      size_t headerlen = 0;
+      const char * end = b->text + b->size;
+      for (const char * s = b->text; s < end; ) {
+         const char * nl = memchr(s, '\n', (size_t) (end - s));
+         size_t len = nl != NULL ? (size_t) (nl - s) : (size_t) (end - s);
+         if (p->fasta && s[0] == '>') {
+            header = s;
+            headerlen = len;
+         } else {
+            line++;
+         }
+         s += len + 1;
+      }
+      if (header != NULL) {
+         char * buf = realloc(info, headerlen + 1);
+         if (buf == NULL) {
+            seeqerr = 0;
+            retval = -1;
+            break;
+         }
+         info = buf;
+         infolen = headerlen;
+         memcpy(info, header, headerlen);
+      }
+
+      pthread_mutex_lock(&p->lock);
+      if (b->size > 0) {
+         b->seq = p->nread++;
+         b->next = NULL;
+         *p->last = b;
+         p->last = &b->next;
+      } else {
+         b->next = p->free;
+         p->free = b;
+      }
+      pthread_cond_broadcast(&p->cond);
+      pthread_mutex_unlock(&p->lock);
+   }
+
+   pthread_mutex_lock(&p->lock);
+   if (retval == -1 && p->err == -1) {
+      p->err = 0;
+      p->errnum = errno;
+   }
+   p->eof = 1;
+   pthread_cond_broadcast(&p->cond);
+   pthread_mutex_unlock(&p->lock);
+
+   free(carry);
+   free(info);
+   return retval;
+}
+
+
+long
+seeqThreads
+(
+ seeqfile_t       * sqfile,
+ seeq_t           * sq,
+ struct seeqarg_t   args,
+ int                match_opt
+)
+// SYNOPSIS:                                                              
+//   Matches the lines of 'sqfile' with 'args.threads' matching threads and
+//   prints the output of 'seeq', the same as if it was printed by one
+//   thread. The reader (the calling thread) cuts the input in blocks of
+//   lines, each matcher matches a block at a time with its own context (see
+//   'seeqCtxNew') and prints it to memory, and the writer thread writes the
+//   output of the blocks in input order. With 'args.unordered' the blocks
+//   are written as they are matched, so that a slow block does not hold the
+//   next ones.
+//                                                                        
+// PARAMETERS:                                                            
+//   sqfile    : pointer to a seeqfile_t structure obtained with 'seeqOpen'.
+//   sq        : pointer to a seeq_t structure, with shared or complete DFAs
+//               (see SQ_SHARED).
+//   args      : seeq arguments (see 'seeq').
+//   match_opt : matching options (see 'seeqStringMatch').
+//
+// RETURN:                                                                
+//   Returns the number of matching lines with 'args.count' (not printed),
+//   0 otherwise, or -1 in case of error and seeqerr is set appropriately.
+//   The output printed before the error is written.
+//
+// SIDE EFFECTS:
+//   The statistics of the contexts are added to the statistics of 'sq'.
+{
+   // Set error to 0.
+   seeqerr = 0;
+
+   if (sqfile->fdi == NULL) {
+      seeqerr = 10;
+      return -1;
+   }
+   if (args.count) match_opt = (match_opt & ~MASK_MATCH) | SQ_FIRST;
+
+   pipe_t p = {
+      .err     = -1,
+      .sq      = sq,
+      .args    = args,
+      .options = match_opt,
+      .fasta   = sqfile->flags & 0x1,
+      .color   = COLOR_TERMINAL && isatty(fileno(stdout))
+   };
+   p.last   = &p.todo;
+   p.header = p.fasta && !args.split && !args.showline && !args.showpos && !args.showdist;
+
+   // Blocks in the matchers, waiting for them or for the writer.
+   int nthreads = args.threads;
+   size_t nblocks = 2 * (size_t) nthreads + 2;
+   block_t  * blocks  = calloc(nblocks, sizeof(block_t));
+   worker_t * workers = calloc((size_t) nthreads, sizeof(worker_t));
+   if (blocks == NULL || workers == NULL) {
+      free(blocks);
+      free(workers);
+      return -1;
+   }
+   for (size_t k = 0; k < nblocks; k++) {
+      blocks[k].next = p.free;
+      p.free = blocks + k;
+   }
+
+   int started = 0;
+   long retval = 0;
+   pthread_t writer;
+   if (pthread_mutex_init(&p.lock, NULL) || pthread_cond_init(&p.cond, NULL)) {
+      free(blocks);
+      free(workers);
+      return -1;
+   }
+   int writing = pthread_create(&writer, NULL, pipe_write, &p) == 0;
+   for (; writing && started < nthreads; started++) {
+      workers[started].pipe = &p;
+      workers[started].ctx  = seeqCtxNew(sq);
+      if (workers[started].ctx == NULL) break;
+      if (pthread_create(&workers[started].thread, NULL, pipe_match, workers + started)) {
+         seeqCtxFree(workers[started].ctx);
+         break;
+      }
+   }
+
+   if (writing && started == nthreads) {
+      retval = pipe_read(&p, sqfile);
+   } else {
+      pthread_mutex_lock(&p.lock);
+      p.err = seeqerr;
+      p.errnum = errno;
+      p.eof = 1;
+      pthread_cond_broadcast(&p.cond);
+      pthread_mutex_unlock(&p.lock);
+   }
+
+   for (int k = 0; k < started; k++) {
+      pthread_join(workers[k].thread, NULL);
+      seeqCtxFree(workers[k].ctx);
+   }
+   if (writing) pthread_join(writer, NULL);
+
+   sq->ctx.stats.texts    += p.stats.texts;
+   sq->ctx.stats.rejected += p.stats.rejected;
+   sq->ctx.stats.bases    += p.stats.bases;
+   sq->ctx.stats.skipped  += p.stats.skipped;
+   sq->ctx.stats.checked  += p.stats.checked;
+   sq->ctx.stats.excluded += p.stats.excluded;
+
+   for (size_t k = 0; k < nblocks; k++) {
+      free(blocks[k].info);
+      free(blocks[k].data);
+      free(blocks[k].out);
+   }
+   free(blocks);
+   free(workers);
+   pthread_cond_destroy(&p.cond);
+   pthread_mutex_destroy(&p.lock);
+
+   if (p.err != -1) {
+      seeqerr = p.err;
+      errno = p.errnum;
+      retval = -1;
+   }
+   return retval == 0 && args.count ? p.count : retval;
+}
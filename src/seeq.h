@@ -24,10 +24,13 @@
 #define _SEEQ_H_
 
 #define SEEQ_VERSION "seeq-1.2"
+// Memory limit of -w without -y (in MB), precompiling may not end otherwise.
+#define PRECOMPILE_MEMORY 64
 
 #include "libseeq.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 
 typedef struct seeqfile_t seeqfile_t;
 
@@ -49,14 +52,34 @@ struct seeqarg_t {
    int best;
    int non_dna;
    int all;
+   int precompile;
+   int hamming;
+   int strands;
+   int twobit;
+   int composition;
+   int threads;
+   int unordered;
    size_t memory;
+   char * cachedir;
 };
 
 struct seeqfile_t {
-   int     flags;
-   size_t  line;
-   char  * info;
-   FILE  * fdi;
+   int        flags;
+   size_t     line;
+   char     * info;
+   size_t     infosz;
+   FILE     * fdi;
+   // Input read in blocks from 'fdi', or the whole mapped file.
+   char     * buf;
+   size_t     bufsz;
+   size_t     pos;     // Start of the next line.
+   size_t     end;     // End of the data read.
+   int        mapped;
+   int        eof;     // All the input is in 'buf'.
+   // Newline scan (see 'file_line').
+   size_t     win;     // Start of the window in 'mask'.
+   size_t     scanned; // End of the window.
+   uint64_t   mask;    // Newlines of the window not yet passed.
 };
 
 
@@ -71,5 +94,8 @@ int          seeq            (char *, char *, struct seeqarg_t);
 long         seeqFileMatch   (seeqfile_t *, seeq_t *, int, int);
 seeqfile_t * seeqOpen        (const char *);
 int          seeqClose       (seeqfile_t *);
+char       * seeqCacheFile   (const char *, seeq_t *, int);
+int          seeqTwoBit      (const char *, seeq_t *, struct seeqarg_t);
+long         seeqThreads     (seeqfile_t *, seeq_t *, struct seeqarg_t, int);
 
 #endif
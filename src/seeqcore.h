@@ -27,6 +27,20 @@
 #include <string.h>
 #include <errno.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <limits.h>
+
+// SSSE3 text translation (see 'text_translate') and AVX2/AVX-512 batch
+// scan (see 'batch_gather'), selected at run time.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEEQ_SSSE3
+#define SEEQ_GATHER
+#include <immintrin.h>
+#endif
 
 #define ABS_MAX_POS        0xFFFFFFFE
 #define U32T_ERROR         0xFFFFFFFF
@@ -40,20 +54,63 @@
 #define DFA_FORWARD        1
 #define DFA_REVERSE        0
 #define DFA_COMPUTE        0xFFFFFFFF
+#define DFA_LEVENSHTEIN    0
+#define DFA_HAMMING        1
+#define DFA_STARTS         2 // Levenshtein rows with the alignment lengths (see 'start_row').
 #define NBASES             5 // Should never be set larger than 32.
 #define TRIE_CHILDREN      3
+#define BITPAR_MAX_PLEN    64 // Longest pattern for the bit-parallel kernel.
+#define DFA_SWEEP_PERIOD   4  // Cache mode steps per state between evictions.
+#define DFA_STATE_SIZE     32 // Vertex stride, no vertex crosses a cache line.
+#define DFA_NARROW_SIZE    16 // Narrow vertex stride (see 'vertex16_t').
+#define DFA_NARROW_COMPUTE 0xFFFF
+#define DFA_STRIDE_STATES  (1 << 16) // States with 2-base transitions (see 'dfa_stride').
+#define SEED_MIN_LEN       5  // Shortest piece of the exact-seed prefilter (see 'seed_new').
+#define BATCH_LANES        8  // Texts stepped in turns by 'batch_scan'.
+#define BATCH_GROUP        64 // Texts read by 'batch_scan' at a time.
+
+// The states and the trie nodes of a DFA are stored in slabs that never
+// move (see 'dfa_grow', 'trie_grow'). The first slab grows in place up
+// to its size, then a new slab is added to a directory each time.
+#define DFA_SLAB_SHIFT     16
+#define DFA_SLAB_STATES    (((size_t)1) << DFA_SLAB_SHIFT)
+#define TRIE_SLAB_SHIFT    16
+#define TRIE_SLAB_NODES    (((size_t)1) << TRIE_SLAB_SHIFT)
+
+#define DFA_FILE_MAGIC     "SEEQDFA"
+#define DFA_FILE_VERSION   5
+#define DFA_FILE_BYTEORDER 0x01020304
+#define DFA_FILE_ALIGN     64
 
 #define min(a,b) (((a) < (b)) ? (a) : (b))
 #define type_msb(a) (((size_t)1)<<(sizeof(a)*8-1))
 #define set_mintomatch(a) (((uint32_t)(a)) << 16)
 #define get_mintomatch(a) (int)((((uint32_t)(a)) >> 16)&0xFFFF)
 #define get_match(a) (int)((uint32_t)(a) &0xFFFF)
+#define state_code(dfa,s) ((size_t)(s) < (dfa)->nflat ? (dfa)->codes + (size_t)(s) * (dfa)->code_size : \
+   (dfa)->slab[(size_t)(s) >> DFA_SLAB_SHIFT].codes + ((size_t)(s) & (DFA_SLAB_STATES-1)) * (dfa)->code_size)
+#define trie_node(trie,id) ((size_t)(id) < TRIE_SLAB_NODES ? (trie)->nodes + (size_t)(id) : \
+   (trie)->slab[(size_t)(id) >> TRIE_SLAB_SHIFT] + ((size_t)(id) & (TRIE_SLAB_NODES-1)))
 
 typedef struct dfa_t    dfa_t;
 typedef struct vertex_t vertex_t;
+typedef struct vertex16_t vertex16_t;
 typedef struct edge_t   edge_t;
 typedef struct trie_t   trie_t;
 typedef struct node_t   node_t;
+typedef struct dfaslab_t dfaslab_t;
+typedef struct dfahdr_t dfahdr_t;
+typedef struct dfasec_t dfasec_t;
+typedef struct scratch_t scratch_t;
+typedef struct segment_t segment_t;
+typedef struct pattern_t pattern_t;
+typedef struct patset_t  patset_t;
+typedef struct text_t    text_t;
+typedef struct seed_t    seed_t;
+typedef struct comp_t    comp_t;
+typedef struct comppat_t comppat_t;
+typedef struct filter_t  filter_t;
+typedef struct scan_t    scan_t;
 
 struct node_t {
    uint32_t flags;
@@ -61,16 +118,68 @@ struct node_t {
 };
 
 struct trie_t {
-   size_t  pos;
-   size_t  size;
-   size_t  height;
-   node_t  nodes[];
+   size_t    pos;
+   size_t    size;
+   size_t    height;
+   size_t    mapsize;   // Size of the first slab.
+   node_t  * nodes;     // First slab.
+   node_t ** slab;      // Directory of the slabs, NULL while there is one.
+   int       hugepages;
 };
 
+// The vertices only hold what is read while matching. The alignment rows
+// of the states (base-3 codes) are stored apart, see 'state_code'.
 struct vertex_t {
    uint32_t  match;
    uint32_t  next[NBASES];
-   uint8_t   code[];
+};
+
+// Narrow vertex, used for patterns shorter than 255 while the DFA has less
+// than DFA_NARROW_COMPUTE states (see 'dfa_widen'). The match value packs
+// the distance in the low byte and the min-to-match in the high byte.
+struct vertex16_t {
+   uint16_t  match;
+   uint16_t  next[NBASES];
+};
+
+// DFA file format. The file starts with a header followed by one section
+// descriptor per DFA. All the offsets are relative to the beginning of the
+// file and aligned to DFA_FILE_ALIGN bytes. States, codes and trie nodes are
+// stored as in memory (they only contain indices). Integers are stored in native
+// byte order, files with a different byte order are rejected. The checksum
+// only covers the header and the section descriptors, so that the sections
+// of complete DFAs are not read when they are mapped (see 'seeqLoadOpt').
+struct dfahdr_t {
+   char     magic[8];   // DFA_FILE_MAGIC.
+   uint32_t version;    // DFA_FILE_VERSION.
+   uint32_t byteorder;  // DFA_FILE_BYTEORDER.
+   uint32_t wlen;       // Pattern length.
+   uint32_t tau;        // Distance threshold.
+   uint32_t ndfa;       // Number of DFA sections.
+   uint32_t metric;     // DFA_LEVENSHTEIN, DFA_HAMMING or DFA_STARTS.
+   uint64_t keys;       // Offset of the pattern keys (wlen bytes).
+   uint64_t size;       // File size.
+   uint64_t checksum;   // Of the header and the section descriptors (see 'dfa_checksum').
+};
+
+struct dfasec_t {
+   uint32_t direction;  // DFA_FORWARD or DFA_REVERSE.
+   uint32_t complete;   // All transitions computed.
+   uint64_t state_size;
+   uint64_t code_size;
+   uint64_t nstates;
+   uint64_t states;     // Offset of the states.
+   uint64_t codes;      // Offset of the state codes.
+   uint64_t nnodes;
+   uint64_t height;
+   uint64_t nodes;      // Offset of the trie nodes.
+};
+
+// Slab of DFA states (see 'dfa_grow'). Each slab holds DFA_SLAB_STATES
+// wide vertices followed by their codes.
+struct dfaslab_t {
+   uint8_t  * states;
+   uint8_t  * codes;
 };
 
 struct dfa_t {
@@ -79,8 +188,112 @@ struct dfa_t {
    size_t     maxmemory;
    size_t     state_size;
    trie_t   * trie;
-   int      * align_cache;
-   uint8_t    states[];
+   uint8_t  * path_cache;
+   size_t     code_size;
+   size_t     capacity;
+   int        complete;
+   int        shared;
+   int        refs;
+   uint8_t  * used;
+   size_t     sweep;
+   void     * map;      // First slab, or file mapping (see 'dfa_map').
+   size_t     mapsize;
+   uint8_t  * states;
+   uint8_t  * codes;
+   size_t     nflat;    // States read from 'states' and 'codes'.
+   dfaslab_t * slab;    // Directory of the slabs, NULL while there is one.
+   int        hugepages;
+   pthread_mutex_t lock;
+   size_t     nseg;
+   segment_t * seg;
+   int        metric;   // DFA_LEVENSHTEIN, DFA_HAMMING or DFA_STARTS (see 'ham_row', 'start_row').
+   uint64_t * pairs;    // 2-base transitions, or NULL (see 'dfa_stride').
+   size_t     npairs;
+};
+
+// Pattern of a DFA of a pattern set (see 'seeqNewMulti'). The alignment
+// rows of the patterns are concatenated in the states of the DFA and each
+// one is capped at its own distance.
+struct segment_t {
+   int  wlen;
+   int  tau;
+};
+
+// Pattern set of a seeq_t. Each pattern has its own reverse DFA to find
+// the start of its matches (Levenshtein DFAs only).
+struct pattern_t {
+   int       wlen;
+   int       tau;
+   char    * rkeys;
+   dfa_t   * rdfa;
+};
+
+struct patset_t {
+   int         npat;
+   int         strands; // The patterns are both strands of one (see SQ_BOTHSTRANDS).
+   pattern_t   pat[];
+};
+
+// Text of the matching loop: the codes of a string (see 'text_translate')
+// or a sequence of 2-bit packed bases (see 'seeqPackedMatch').
+struct text_t {
+   const uint8_t * codes;   // NULL for packed bases.
+   const uint8_t * packed;
+   const uint8_t * nmask;   // Bases read as 'N', or NULL.
+   const uint8_t * order;   // Codes of the 2-bit values.
+   size_t          len;
+};
+
+// Exact-seed prefilter (see 'seed_new'). The pieces of the patterns are
+// concatenated in the bits of a Shift-And automaton.
+struct seed_t {
+   uint64_t  mask[NBASES]; // Piece positions that accept each base.
+   uint64_t  first;        // First bit of each piece.
+   uint64_t  last;         // Last bit of each piece.
+   size_t    span;         // Longest match (pattern length plus distance).
+};
+
+// Composition filter (see 'comp_new'). The bases of the text are counted
+// in a sliding window that holds the longest match.
+struct comppat_t {
+   int       tau;
+   int       need[4];      // Bases A, C, G and T of the pattern.
+};
+
+struct comp_t {
+   int       npat;
+   size_t    span;         // Longest match (pattern length plus distance).
+   size_t    lo;           // Counted window.
+   size_t    hi;
+   uint64_t  count;        // Bases A, C, G and T in the window, 16 bits each.
+   comppat_t pat[];
+};
+
+// Prefilters of the matching loop (see 'filter_next').
+struct filter_t {
+   const seed_t * seeds;
+   comp_t       * comp;
+   size_t         span;
+   uint64_t       reg;     // State of the Shift-And automaton.
+   size_t         pos;     // Next position of the Shift-And automaton.
+   size_t         lo;      // Match ends around the last occurrence of a piece.
+   size_t         hi;
+   seeqstats_t  * stats;
+};
+
+// Where the interleaved scan of a text stopped (see 'batch_scan').
+struct scan_t {
+   size_t   pos;
+   uint32_t state;   // State before 'pos', or 0 if the text cannot match.
+};
+
+// Construction scratch of a shared DFA. Each handle (see 'seeqClone') has
+// its own, so that the rows and the state 0 (cache mode) are not shared
+// between threads. The owner of the DFA uses 'path_cache' and the state 0
+// of the DFA instead.
+struct scratch_t {
+   vertex_t * s0;     // Private state 0.
+   uint8_t  * path;   // Current row (cache mode) and updated row.
 };
 
 //   [0 ... 255] = 6,
@@ -112,16 +325,197 @@ static const int translate_convert[256] = {
 
 static const char bases[NBASES] = "ACGTN";
 
+// NW row update table, indexed as [h][d][mismatch], where:
+//   h: horizontal differential of the previous cell (new row - old row) + 1.
+//   d: vertical differential of the old row at the current cell (path symbol).
+//   mismatch: 1 if the text base does not match the pattern key.
+// Each entry packs the vertical differential of the updated row (+1) in bits
+// 0-1 and the next horizontal differential (+1) in bits 2-3. The updated row is
+// computed uncapped; the tau+1 cap is applied afterwards (see 'dfa_step').
+static const uint8_t nw_update[3][3][2] = {
+   {{10,10},{6,6},{2,2}},
+   {{ 9, 9},{5,10},{1,6}},
+   {{ 8, 8},{4,9},{0,5}}
+};
+
+// Bit-parallel decoding of the path code bytes (see 'path_encode'). For each
+// byte value, the low 8 bits hold the positions (0-4) of the symbols '2'
+// (vertical differential +1) and the high 8 bits hold the positions of the
+// symbols '0' (vertical differential -1).
+static const uint16_t code_bits[243] = {
+   0x1F00,0x0F00,0x0F10,0x1700,0x0700,0x0710,0x1708,0x0708,0x0718,0x1B00,
+   0x0B00,0x0B10,0x1300,0x0300,0x0310,0x1308,0x0308,0x0318,0x1B04,0x0B04,
+   0x0B14,0x1304,0x0304,0x0314,0x130C,0x030C,0x031C,0x1D00,0x0D00,0x0D10,
+   0x1500,0x0500,0x0510,0x1508,0x0508,0x0518,0x1900,0x0900,0x0910,0x1100,
+   0x0100,0x0110,0x1108,0x0108,0x0118,0x1904,0x0904,0x0914,0x1104,0x0104,
+   0x0114,0x110C,0x010C,0x011C,0x1D02,0x0D02,0x0D12,0x1502,0x0502,0x0512,
+   0x150A,0x050A,0x051A,0x1902,0x0902,0x0912,0x1102,0x0102,0x0112,0x110A,
+   0x010A,0x011A,0x1906,0x0906,0x0916,0x1106,0x0106,0x0116,0x110E,0x010E,
+   0x011E,0x1E00,0x0E00,0x0E10,0x1600,0x0600,0x0610,0x1608,0x0608,0x0618,
+   0x1A00,0x0A00,0x0A10,0x1200,0x0200,0x0210,0x1208,0x0208,0x0218,0x1A04,
+   0x0A04,0x0A14,0x1204,0x0204,0x0214,0x120C,0x020C,0x021C,0x1C00,0x0C00,
+   0x0C10,0x1400,0x0400,0x0410,0x1408,0x0408,0x0418,0x1800,0x0800,0x0810,
+   0x1000,0x0000,0x0010,0x1008,0x0008,0x0018,0x1804,0x0804,0x0814,0x1004,
+   0x0004,0x0014,0x100C,0x000C,0x001C,0x1C02,0x0C02,0x0C12,0x1402,0x0402,
+   0x0412,0x140A,0x040A,0x041A,0x1802,0x0802,0x0812,0x1002,0x0002,0x0012,
+   0x100A,0x000A,0x001A,0x1806,0x0806,0x0816,0x1006,0x0006,0x0016,0x100E,
+   0x000E,0x001E,0x1E01,0x0E01,0x0E11,0x1601,0x0601,0x0611,0x1609,0x0609,
+   0x0619,0x1A01,0x0A01,0x0A11,0x1201,0x0201,0x0211,0x1209,0x0209,0x0219,
+   0x1A05,0x0A05,0x0A15,0x1205,0x0205,0x0215,0x120D,0x020D,0x021D,0x1C01,
+   0x0C01,0x0C11,0x1401,0x0401,0x0411,0x1409,0x0409,0x0419,0x1801,0x0801,
+   0x0811,0x1001,0x0001,0x0011,0x1009,0x0009,0x0019,0x1805,0x0805,0x0815,
+   0x1005,0x0005,0x0015,0x100D,0x000D,0x001D,0x1C03,0x0C03,0x0C13,0x1403,
+   0x0403,0x0413,0x140B,0x040B,0x041B,0x1803,0x0803,0x0813,0x1003,0x0003,
+   0x0013,0x100B,0x000B,0x001B,0x1807,0x0807,0x0817,0x1007,0x0007,0x0017,
+   0x100F,0x000F,0x001F
+};
+
+// Vertex access for both vertex sizes. The transitions of shared DFAs are
+// read with acquire semantics (see 'dfa_link'), the other DFAs are only
+// modified by the thread that reads them. The states below 'nflat' are
+// read from 'states', the matching loop keeps both and the state size in
+// locals (see 'text_match').
+#define dfa_narrow(dfa) ((dfa)->state_size == DFA_NARROW_SIZE)
+#define slab_vertex(dfa,flat,nflat,size,s) ((size_t)(s) < (nflat) ? (flat) + (size_t)(s) * (size) : \
+   (dfa)->slab[(size_t)(s) >> DFA_SLAB_SHIFT].states + ((size_t)(s) & (DFA_SLAB_STATES-1)) * (size))
+#define state_vertex(dfa,s) slab_vertex(dfa, (dfa)->states, (dfa)->nflat, (dfa)->state_size, s)
+
+static inline uint32_t
+vertex_next
+(
+ const uint8_t * vertex,
+ int             narrow,
+ int             shared,
+ int             base
+)
+{
+   // Shared DFAs are widened, unless they are complete (see 'dfa_share').
+   if (narrow) {
+      uint16_t next = ((const vertex16_t *) vertex)->next[base];
+      return next == DFA_NARROW_COMPUTE ? DFA_COMPUTE : next;
+   }
+   if (shared) return __atomic_load_n(((const vertex_t *) vertex)->next + base, __ATOMIC_ACQUIRE);
+   return ((const vertex_t *) vertex)->next[base];
+}
+
+static inline uint32_t
+vertex_match
+(
+ const uint8_t * vertex,
+ int             narrow
+)
+{
+   if (narrow) {
+      uint16_t match = ((const vertex16_t *) vertex)->match;
+      if (match == DFA_NARROW_COMPUTE) return DFA_COMPUTE;
+      return set_mintomatch(match >> 8) | (match & 0xFF);
+   }
+   return ((const vertex_t *) vertex)->match;
+}
+
+static inline uint32_t
+state_next
+(
+ const dfa_t * dfa,
+ uint32_t      state,
+ int           base
+)
+{
+   return vertex_next(state_vertex(dfa, state), dfa_narrow(dfa), dfa->shared, base);
+}
+
+static inline uint32_t
+state_match
+(
+ const dfa_t * dfa,
+ uint32_t      state
+)
+{
+   return vertex_match(state_vertex(dfa, state), dfa_narrow(dfa));
+}
+
+static inline int
+text_code
+(
+ const text_t * text,
+ size_t         i
+)
+{
+   if (text->codes != NULL) return text->codes[i];
+   // The end of a packed sequence reads as the end of a string.
+   if (i >= text->len) return 5;
+   if (text->nmask != NULL && ((text->nmask[i >> 3] >> (i & 7)) & 1)) return 4;
+   return text->order[(text->packed[i >> 2] >> (6 - 2*(i & 3))) & 3];
+}
+
+static inline int
+start_cell
+(
+ int   v,
+ int   len,
+ int   tau,
+ int * alen
+)
+// Distance and alignment length of a cell of a DFA_STARTS row, for the
+// first 'len' bases of the pattern (see 'start_row').
+{
+   if (v == 0) return tau + 1;
+   *alen = (v - 1) % (2*tau + 1) - tau + len;
+   return (v - 1) / (2*tau + 1);
+}
+
 int         parse         (const char *, char *);
 dfa_t     * dfa_new       (int, int, size_t, size_t, size_t);
+dfa_t     * dfa_newmulti  (const segment_t *, size_t, int, size_t, size_t, size_t);
 uint32_t    dfa_newvertex (dfa_t **);
-int         dfa_newstate  (dfa_t **, uint8_t *, int, size_t); 
-int         dfa_step      (uint32_t, int, int, int, dfa_t **, char *, uint32_t *);
+int         dfa_newstate  (dfa_t **, uint8_t *, uint32_t, int, size_t);
+int         dfa_step      (uint32_t, int, int, int, dfa_t **, char *, scratch_t *, uint32_t *);
+int         nw_row        (const uint8_t *, uint8_t *, uint8_t *, const char *, int, int, int, int *);
+int         ham_row       (const uint8_t *, uint8_t *, const char *, int, int, int, int *);
+int         ham_width     (int);
+int         start_row     (const uint8_t *, uint8_t *, const char *, int, int, int, int *);
+int         start_width   (int);
+int         state_start   (const dfa_t *, uint32_t, const scratch_t *, int, int);
+void        state_row     (dfa_t *, uint32_t, const scratch_t *, uint8_t *);
+int         ctx_addmatch  (seeq_ctx_t *, match_t);
+void        batch_scan    (const dfa_t *, int, const char * const *, const size_t *, size_t, int, scan_t *);
+int         batch_gather  (const dfa_t *, int, const char * const *, const size_t *, size_t, int, seeq_ctx_t *, scan_t *);
+int         patset_match  (const seeq_t *, seeq_ctx_t *, const text_t *, int64_t, int, uint32_t, int, int);
+int         match_start   (const text_t *, int64_t, int, int, int, dfa_t **, char *, scratch_t *, size_t *);
+size_t      ham_start     (const text_t *, int64_t, int);
+size_t      text_translate(const char *, uint8_t *, size_t, int);
+seeq_t    * patset_new    (char *, const segment_t *, int, size_t, int);
+seed_t    * seed_new      (const char *, const segment_t *, int);
+comp_t    * comp_new      (const seeq_t *);
+void        dfa_hugepages (dfa_t *);
+int         dfa_stride    (dfa_t *);
+int         dfa_precompile(dfa_t **, int, int, char *);
+int         dfa_share     (dfa_t *);
+int         dfa_reserve   (dfa_t *, size_t, size_t);
+int         dfa_grow      (dfa_t *, size_t);
+int         dfa_flatten   (dfa_t *);
+int         dfa_evictable (dfa_t *);
+int         dfa_evict     (dfa_t *);
+uint32_t    dfa_link      (dfa_t *, uint32_t, int, uint32_t);
+void        dfa_setmatch  (dfa_t *, uint32_t, uint32_t);
+void        dfa_setnext   (dfa_t *, uint32_t, int, uint32_t);
+int         dfa_widen     (dfa_t *);
 void        dfa_free      (dfa_t *);
+void        dfa_release   (dfa_t *);
+scratch_t * scratch_new   (int);
+void        scratch_free  (scratch_t *);
+void        patset_free   (patset_t *);
+dfa_t     * dfa_map       (int, size_t, const dfasec_t *, size_t, int);
+int         dfa_check     (const uint8_t *, const dfasec_t *);
+uint64_t    dfa_checksum  (const dfahdr_t *, const dfasec_t *);
 trie_t    * trie_new      (size_t, size_t);
 int         trie_search   (dfa_t *, uint8_t *, uint32_t*, size_t);
 int         trie_insert   (dfa_t *, uint8_t *, uint32_t);
 uint32_t    trie_newnode  (trie_t **);
+int         trie_grow     (trie_t *, size_t);
+void        trie_free     (trie_t *);
+void      * mem_reserve   (size_t);
+int         mem_commit    (void *, size_t);
 void        path_to_align (const unsigned char *, int *, size_t);
 void        path_encode   (const uint8_t *, uint8_t *, size_t);
 void        path_decode   (const uint8_t *, uint8_t *, size_t);
@@ -48,6 +48,7 @@ typedef struct {
    // class methods to format the match.
    PyObject   * stringObj;
    const char * string;
+   Py_ssize_t   slen;
 } SeeqMatch;
 
 // SeeqObject struct.
@@ -68,8 +69,9 @@ typedef struct {
    SeeqObject * sqObj;
    PyObject   * strObj;
    const char * string;
+   Py_ssize_t   slen;
    int          match_iter;
-   int          last;
+   Py_ssize_t   last;
 } SeeqIter;
 
 
@@ -109,11 +111,13 @@ SeeqIter_new
       return NULL;
    }
 
-   const char * string = PyUnicode_AsUTF8(strObj);
+   // The UTF-8 buffer of the string is matched in place.
+   Py_ssize_t slen;
+   const char * string = PyUnicode_AsUTF8AndSize(strObj, &slen);
    if (string == NULL) return NULL;
 
    seeq_t * sq = sqObj->sq;
-   if (seeqStringMatch(string, sq, SQ_ALL | sqObj->options) == -1) {
+   if (seeqMatchN(string, (size_t) slen, sq, SQ_ALL | sqObj->options) == -1) {
       PyErr_SetString(LibSeeqException, seeqPrintError());
       return NULL;
    }
@@ -123,6 +127,7 @@ SeeqIter_new
    self->sqObj = sqObj;
    self->strObj = strObj;
    self->string = string;
+   self->slen = slen;
    self->match_iter = match_iter;
    self->last = 0;
 
@@ -152,35 +157,20 @@ SeeqIter_iternext
    // StopIteration exception
 
    if (match) {
-      int start = match->start;
-      int end   = match->end;
-      int last  = self->last;
+      Py_ssize_t start = (Py_ssize_t) match->start;
+      Py_ssize_t end   = (Py_ssize_t) match->end;
+      Py_ssize_t last  = self->last;
       self->last = end;
       
       // Return match.
       if (self->match_iter == 1) {
-         int toklen = end - start;
-         char * new_string = malloc(toklen + 1);
-         if (new_string == NULL) return PyErr_NoMemory();
-         memcpy(new_string, self->string + start, toklen);
-         new_string[toklen] = 0;
-         PyObject * new_strObj = PyUnicode_FromString(new_string);
-         free(new_string);
-         if (new_strObj == NULL) return NULL;
-         return new_strObj;
+         return PyUnicode_FromStringAndSize(self->string + start, end - start);
       }
       // Return prefix.
       else {
-         int toklen = start - last;
+         Py_ssize_t toklen = start - last;
          if (toklen > 0) {
-            char * new_string = malloc(toklen + 1);
-            if (new_string == NULL) return PyErr_NoMemory();
-            memcpy(new_string, self->string + last, toklen);
-            new_string[toklen] = 0;
-            PyObject * new_strObj = PyUnicode_FromString(new_string);
-            free(new_string);
-            if (new_strObj == NULL) return NULL;
-            return new_strObj;
+            return PyUnicode_FromStringAndSize(self->string + last, toklen);
          }
          // It may happen that we have a zero-length prefix. Iterate again.
          else return SeeqIter_iternext((PyObject *)self);
@@ -194,16 +184,9 @@ SeeqIter_iternext
          return NULL;
       } else {
          // Return last suffix (if any).
-         int toklen = strlen(self->string) - self->last;
+         Py_ssize_t toklen = self->slen - self->last;
          if (toklen > 0) {
-            char * new_string = malloc(toklen + 1);
-            if (new_string == NULL) return PyErr_NoMemory();
-            memcpy(new_string, self->string + self->last, toklen);
-            new_string[toklen] = 0;
-            PyObject * new_strObj = PyUnicode_FromString(new_string);
-            free(new_string);
-            if (new_strObj == NULL) return NULL;
-            else return new_strObj;
+            return PyUnicode_FromStringAndSize(self->string + self->last, toklen);
          } else {
             // There was no suffix, stop iteration.
             PyErr_SetNone(PyExc_StopIteration);
@@ -284,12 +267,13 @@ SeeqMatch_new
 (
  PyObject   * stringObj,
  const char * string,
+ Py_ssize_t   slen,
  Py_ssize_t   nmatches
 )
 // This is a C function only, it will not be passed as a class method.
 // So SeeqMatch instances will be only created in C from 'SeeqObject.match'.
 {
-   if (string == NULL || strlen(string) < 1) {
+   if (string == NULL || slen < 1) {
       PyErr_SetString(SeeqException, "Empty string");
       Py_DECREF(stringObj);
       return NULL;
@@ -316,6 +300,7 @@ SeeqMatch_new
 
    self->stringObj = stringObj;
    self->string = string;
+   self->slen = slen;
 
    // return the SeeqMatch instance.
    return self;
@@ -330,7 +315,7 @@ SeeqMatch_add
 )
 // This functions add a new match to the SeeqMatch list of matches.
 {
-   size_t slen = strlen(self->string);
+   size_t slen = (size_t) self->slen;
    size_t start = match->start;
    size_t end   = match->end;
    size_t dist  = match->dist;
@@ -364,7 +349,7 @@ SeeqMatch_tokenize
 {
    const char * string = self->string;
    Py_ssize_t nmatches = PyList_Size(self->matches);
-   if (string == NULL || strlen(string) == 0 || nmatches == 0) {
+   if (string == NULL || self->slen == 0 || nmatches == 0) {
       Py_INCREF(Py_None);
       return Py_None;
    }
@@ -413,7 +398,7 @@ SeeqMatch_tokenize
    }
 
    // String suffix.
-   int slen = strlen(string);
+   Py_ssize_t slen = self->slen;
    if (slen - tstart >= 0) {
          int tokenlen = slen - tstart;
          char * token = malloc(tokenlen + 1);
@@ -461,7 +446,7 @@ SeeqMatch_split
 {
    const char * string = self->string;
    Py_ssize_t nmatches = PyList_Size(self->matches);
-   if (string == NULL || strlen(string) == 0 || nmatches == 0) {
+   if (string == NULL || self->slen == 0 || nmatches == 0) {
       Py_INCREF(Py_None);
       return Py_None;
    }
@@ -498,7 +483,7 @@ SeeqMatch_split
    }
 
    // String suffix.
-   int slen = strlen(string);
+   Py_ssize_t slen = self->slen;
    if (slen - tstart > 0) {
          int tokenlen = slen - tstart;
          char * token = malloc(tokenlen + 1);
@@ -546,7 +531,7 @@ SeeqMatch_matches
 {
    const char * string = self->string;
    Py_ssize_t nmatches = PyList_Size(self->matches);
-   if (string == NULL || strlen(string) == 0 || nmatches == 0) {
+   if (string == NULL || self->slen == 0 || nmatches == 0) {
       Py_INCREF(Py_None);
       return Py_None;
    }
@@ -744,9 +729,13 @@ SeeqObject_matchSuffix
 // SeeqMatch object instance or Py_None if nothing was found.
 {
    PyObject   * include_match = NULL;
-   const char * string;
+   PyObject   * stringObj;
 
-   if (!PyArg_ParseTuple(args,"s|O:match", &string, &include_match))
+   if (!PyArg_ParseTuple(args,"U|O:match", &stringObj, &include_match))
+      return NULL;
+   Py_ssize_t slen;
+   const char * string = PyUnicode_AsUTF8AndSize(stringObj, &slen);
+   if (string == NULL)
       return NULL;
 
    // Read include match option. (Default = True).
@@ -758,7 +747,7 @@ SeeqObject_matchSuffix
          return NULL;
    }
 
-   int rval = seeqStringMatch(string, self->sq, SQ_BEST | self->options);
+   int rval = seeqMatchN(string, (size_t) slen, self->sq, SQ_BEST | self->options);
 
    // Error.
    if (rval < 0) {
@@ -772,16 +761,8 @@ SeeqObject_matchSuffix
    }
    // Pattern found (return SeeqMatch instance).
    else {
-      char * dup = strdup(string);
-      char * suffix;
-      if (inc_match) {
-         suffix = dup + self->sq->match[0].start; 
-      } else {
-         suffix = dup + self->sq->match[0].end;
-      }
-      PyObject * retObj = PyUnicode_FromString(suffix);
-      free(dup);
-      return retObj;
+      Py_ssize_t start = (Py_ssize_t) (inc_match ? self->sq->ctx.match[0].start : self->sq->ctx.match[0].end);
+      return PyUnicode_FromStringAndSize(string + start, slen - start);
    }
 }
 
@@ -796,9 +777,13 @@ SeeqObject_matchPrefix
 // SeeqMatch object instance or Py_None if nothing was found.
 {
    PyObject   * include_match = NULL;
-   const char * string;
+   PyObject   * stringObj;
 
-   if (!PyArg_ParseTuple(args,"s|O:match", &string, &include_match))
+   if (!PyArg_ParseTuple(args,"U|O:match", &stringObj, &include_match))
+      return NULL;
+   Py_ssize_t slen;
+   const char * string = PyUnicode_AsUTF8AndSize(stringObj, &slen);
+   if (string == NULL)
       return NULL;
    int inc_match;
    if (include_match == NULL) inc_match = 1;
@@ -808,7 +793,7 @@ SeeqObject_matchPrefix
          return NULL;
    }
 
-   int rval = seeqStringMatch(string, self->sq, SQ_BEST | self->options);
+   int rval = seeqMatchN(string, (size_t) slen, self->sq, SQ_BEST | self->options);
 
    // Error.
    if (rval < 0) {
@@ -822,15 +807,8 @@ SeeqObject_matchPrefix
    }
    // Pattern found (return SeeqMatch instance).
    else {
-      char * prefix = strdup(string);
-      if (inc_match) {
-         prefix[self->sq->match[0].end] = 0;
-      } else {
-         prefix[self->sq->match[0].start] = 0;
-      }
-      PyObject * retObj = PyUnicode_FromString(prefix);
-      free(prefix);
-      return retObj;
+      size_t end = inc_match ? self->sq->ctx.match[0].end : self->sq->ctx.match[0].start;
+      return PyUnicode_FromStringAndSize(string, (Py_ssize_t) end);
    }
 }
 
@@ -853,9 +831,12 @@ SeeqObject_seeqmatch
    if (!PyUnicode_Check(stringObj))
       return NULL;
 
-   string = PyUnicode_AsUTF8(stringObj);
+   Py_ssize_t slen;
+   string = PyUnicode_AsUTF8AndSize(stringObj, &slen);
+   if (string == NULL)
+      return NULL;
 
-   int rval = seeqStringMatch(string, self->sq, MATCH_OPTIONS | self->options);
+   int rval = seeqMatchN(string, (size_t) slen, self->sq, MATCH_OPTIONS | self->options);
 
    // Error.
    if (rval < 0) {
@@ -872,7 +853,7 @@ SeeqObject_seeqmatch
       // Will keep a copy of the string PyObject.
       Py_INCREF(stringObj);
       // Create new SeeqMatch instance. (Steals stringObj reference)
-      SeeqMatch * match = SeeqMatch_new(stringObj, string, rval);
+      SeeqMatch * match = SeeqMatch_new(stringObj, string, slen, rval);
       if (match == NULL) {
          return NULL;
       }
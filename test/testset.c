@@ -7,9 +7,11 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <execinfo.h>
 #include <unistd.h>
+#include <pthread.h>
 
 void SIGSEGV_handler(int sig) {
    void *array[10];
@@ -132,7 +134,7 @@ test_trie_new
       for (int k = 0; k < TRIE_CHILDREN; k++)
          g_assert_cmpint(trie->nodes[0].child[k], ==, 0);
       g_assert_cmpint(trie->nodes[0].flags, ==, 0);
-      free(trie);
+      trie_free(trie);
    }
    }
 
@@ -144,7 +146,7 @@ test_trie_new
    for (int k = 0; k < TRIE_CHILDREN; k++)
       g_assert_cmpint(trie->nodes[0].child[k], ==, 0);
    g_assert_cmpint(trie->nodes[0].flags, ==, 0);
-   free(trie);
+   trie_free(trie);
 
    // Alloc test.
    mute_stderr();
@@ -182,8 +184,7 @@ test_trie_insert
 
    // Insert path references.
    for (int i = 0; i < 8; i++) {
-      vertex_t * vertex = (vertex_t *) (dfa->states + (i+1) * dfa->state_size);
-      path_encode(test_path[i], vertex->code, trie_height);
+      path_encode(test_path[i], state_code(dfa, i+1), trie_height);
    }
 
    // Trie contains path 2,1,1,1,1,1...
@@ -308,8 +309,7 @@ test_trie_insert
 
    // Insert path references.
    for (int i = 0; i < 3; i++) {
-      vertex_t * vertex = (vertex_t *) (lowdfa->states + (i+1) * lowdfa->state_size);
-      path_encode(test_path2[i], vertex->code, trie_height);
+      path_encode(test_path2[i], state_code(lowdfa, i+1), trie_height);
    }
 
 
@@ -370,8 +370,7 @@ test_trie_search
 
    // Insert path references.
    for (int i = 0; i < 7; i++) {
-      vertex_t * vertex = (vertex_t *) (dfa->states + (i+2) * dfa->state_size);
-      path_encode(test_path[i], vertex->code, trie_height);
+      path_encode(test_path[i], state_code(dfa, i+2), trie_height);
       g_assert(trie_insert(dfa, test_path[i], i+2) == 0);
    }
 
@@ -390,6 +389,7 @@ test_trie_search
    g_assert_cmpint(trie_search(dfa,search_path[10], NULL, 1), ==, -1);
    g_assert_cmpint(seeqerr, ==, 6);
 
+   trie_free(trie);
    dfa_free(dfa);
 
    return;
@@ -470,21 +470,89 @@ test_dfa_newvertex
    for (int i = 1; i < 1023; i++) {
       uint32_t new = dfa_newvertex(&dfa);
       g_assert_cmpint(dfa->pos, ==, i+2);
-      vertex_t * vertex = (vertex_t *) (dfa->states + new * dfa->state_size);
-      g_assert_cmpint(vertex->match, ==, DFA_COMPUTE);
+      g_assert_cmpint(state_match(dfa, new), ==, DFA_COMPUTE);
       for (int j = 0; j < NBASES; j++) {
-         g_assert_cmpint(vertex->next[j], ==, DFA_COMPUTE);
+         g_assert_cmpint(state_next(dfa, new, j), ==, DFA_COMPUTE);
       }
    }
    g_assert_cmpint(dfa->size, ==, 1024);
 
-   // Alloc test.
-   mute_stderr();
-   set_alloc_failure_rate_to(1.1);
-   int ret = dfa_newvertex(&dfa);
-   reset_alloc();
-   unmute_stderr();
-   g_assert_cmpint(ret, ==, -1);
+   // States are not moved when the DFA grows.
+   uint8_t * states = dfa->states;
+   uint8_t * root = state_vertex(dfa, 1);
+   dfa_setnext(dfa, 1, 0, 2);
+   for (int i = 0; i < 4096; i++) {
+      g_assert(dfa_newvertex(&dfa) != U32T_ERROR);
+   }
+   g_assert(dfa->states == states);
+   g_assert(state_vertex(dfa, 1) == root);
+   g_assert_cmpint(state_next(dfa, 1, 0), ==, 2);
+   g_assert_cmpint(dfa->size, ==, 8192);
+
+   // Only the first slab is reserved, the next states are in new slabs.
+   g_assert_cmpint(dfa->mapsize, <=, DFA_SLAB_STATES * (DFA_STATE_SIZE + dfa->code_size));
+   while (dfa->pos < 3 * DFA_SLAB_STATES) g_assert(dfa_newvertex(&dfa) != U32T_ERROR);
+   g_assert(dfa->slab != NULL);
+   g_assert_cmpint(dfa->size, ==, 3 * DFA_SLAB_STATES);
+   uint32_t last = (uint32_t) dfa->pos - 1;
+   uint8_t * vertex = state_vertex(dfa, last);
+   dfa_setnext(dfa, last, 3, 1);
+   g_assert(dfa_newvertex(&dfa) != U32T_ERROR);
+   g_assert(state_vertex(dfa, last) == vertex);
+   g_assert_cmpint(state_next(dfa, last, 3), ==, 1);
+   g_assert_cmpint(state_next(dfa, 1, 0), ==, 2);
+   g_assert_cmpint(state_match(dfa, last), ==, DFA_COMPUTE);
+
+   dfa_free(dfa);
+
+}
+
+
+void
+test_dfa_widen
+(void)
+{
+   // Small patterns start with narrow vertices.
+   dfa_t * dfa = dfa_new(10, 3, 1, 1, 0);
+   g_assert(dfa != NULL);
+   g_assert(dfa_narrow(dfa));
+   g_assert_cmpint(dfa->state_size, ==, DFA_NARROW_SIZE);
+   dfa_setnext(dfa, 1, 2, 1);
+   g_assert_cmpint(state_next(dfa, 1, 0), ==, DFA_COMPUTE);
+   g_assert_cmpint(state_next(dfa, 1, 2), ==, 1);
+   g_assert_cmpint(get_match(state_match(dfa, 1)), ==, 4);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, 1)), ==, 7);
+
+   // The vertices are widened when the ids do not fit in 16 bits.
+   while (dfa->pos < DFA_NARROW_COMPUTE) {
+      uint32_t new = dfa_newvertex(&dfa);
+      g_assert(new != U32T_ERROR);
+      dfa_setmatch(dfa, new, set_mintomatch(new % 11) | (new % 5));
+      dfa_setnext(dfa, new, new % NBASES, new - 1);
+   }
+   g_assert(dfa_narrow(dfa));
+   uint32_t new = dfa_newvertex(&dfa);
+   g_assert_cmpint(new, ==, DFA_NARROW_COMPUTE);
+   g_assert(!dfa_narrow(dfa));
+   g_assert_cmpint(dfa->state_size, ==, DFA_STATE_SIZE);
+   g_assert_cmpint(state_match(dfa, new), ==, DFA_COMPUTE);
+   g_assert_cmpint(state_next(dfa, 1, 0), ==, DFA_COMPUTE);
+   g_assert_cmpint(state_next(dfa, 1, 2), ==, 1);
+   g_assert_cmpint(get_match(state_match(dfa, 1)), ==, 4);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, 1)), ==, 7);
+   for (uint32_t i = 2; i < DFA_NARROW_COMPUTE; i++) {
+      g_assert_cmpint(state_match(dfa, i), ==, set_mintomatch(i % 11) | (i % 5));
+      for (int j = 0; j < NBASES; j++)
+         g_assert_cmpint(state_next(dfa, i, j), ==, j == i % NBASES ? i - 1 : DFA_COMPUTE);
+   }
+
+   dfa_free(dfa);
+
+   // Long patterns use wide vertices.
+   dfa = dfa_new(300, 3, 1, 1, 0);
+   g_assert(dfa != NULL);
+   g_assert(!dfa_narrow(dfa));
+   dfa_free(dfa);
 
 }
 
@@ -502,14 +570,12 @@ test_dfa_newstate
    g_assert_cmpint(dfa->trie->pos, ==, 1);
 
    uint8_t path[5] = {2,2,2,1,1};
-   vertex_t * vertex = (vertex_t *) (dfa->states + 1 * dfa->state_size);
-   g_assert_cmpint(path_compare(path, vertex->code, 5), ==, 1);
+   g_assert_cmpint(path_compare(path, state_code(dfa, 1), 5), ==, 1);
 
    // Insert states.
    uint8_t new_path[5] = {1,2,2,2,1};
-   g_assert(dfa_newstate(&dfa, new_path, 3, 1) == 0);
-   vertex = (vertex_t *) (dfa->states + 1 * dfa->state_size);
-   g_assert_cmpint(vertex->next[3], ==, 2);
+   g_assert(dfa_newstate(&dfa, new_path, set_mintomatch(1) | 2, 3, 1) == 0);
+   g_assert_cmpint(state_next(dfa, 1, 3), ==, 2);
    g_assert_cmpint(dfa->size, ==, 4);
    g_assert_cmpint(dfa->pos, ==, 3);
    g_assert_cmpint(dfa->trie->pos, ==, 1);
@@ -517,13 +583,13 @@ test_dfa_newstate
    g_assert_cmpint(dfa->trie->nodes[0].child[1], ==, 2);
    g_assert_cmpint(dfa->trie->nodes[0].child[2], ==, 1);
    g_assert_cmpint(dfa->trie->nodes[0].flags, ==, 0b0110);
-   vertex = (vertex_t *) (dfa->states + 2 * dfa->state_size);
-   g_assert_cmpint(path_compare(new_path, vertex->code, 5), ==, 1);
+   g_assert_cmpint(path_compare(new_path, state_code(dfa, 2), 5), ==, 1);
+   g_assert_cmpint(state_match(dfa, 2), ==, set_mintomatch(1) | 2);
 
    // Wrong code.
    new_path[3] = 3;
    size_t pos = dfa->pos;
-   g_assert(dfa_newstate(&dfa, new_path, 0, 1) == -1);
+   g_assert(dfa_newstate(&dfa, new_path, 0, 0, 1) == -1);
    g_assert_cmpint(dfa->pos, ==, pos);
 
    // Alloc error when extending dfa.
@@ -531,7 +597,7 @@ test_dfa_newstate
    new_path[2] = 1; new_path[3] = 2; new_path[4] = 2;
    set_alloc_failure_rate_to(1.1);
    pos = dfa->pos;
-   int ret = dfa_newstate(&dfa, new_path, 0, 1);
+   int ret = dfa_newstate(&dfa, new_path, 0, 0, 1);
    g_assert_cmpint(dfa->pos, ==, pos);
    reset_alloc();
    unmute_stderr();
@@ -555,75 +621,64 @@ test_dfa_step
 
    uint32_t state = DFA_ROOT_STATE;
    // text[0] A
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[0]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[0]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 2);
-   vertex_t * vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 2);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 2);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 2);
    // text[1] T
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[1]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[1]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 3);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 2);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 1);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 1);
    // text[2] C
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[2]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[2]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 4);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 2);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 2);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 2);
    // text[3] C
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[3]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[3]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 4);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 2);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 2);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 2);
    // text[4] T
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[4]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[4]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 5);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 2);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 1);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 1);
    // text[5] C
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[5]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[5]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 4);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 2);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 2);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 2);
    // text[6] A
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[6]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[6]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 6);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 2);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 1);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 1);
    // text[7] T
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[7]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[7]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 7);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 1);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 0);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 1);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 0);
    // text[8] G
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[8]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[8]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 8);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 0);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 0);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 0);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 0);
    // text[9] A
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[9]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[9]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 9);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 1);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 0);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 1);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 0);
    // recover existing step.
-   g_assert(0 == dfa_step(1, translate_ignore[(int)text[0]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(1, translate_ignore[(int)text[0]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 2);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 2);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 2);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 2);
 
    dfa_free(dfa);
 
-   // Try the same with memory limit to 50 bytes (only root node).
+   // Try the same with memory limit to 49 bytes (only root node).
    // The first 2 dfa states and the trie node will fit, but nothing else.
    pattern = "AAAA";
    text = "ATTAAAT";
@@ -631,61 +686,80 @@ test_dfa_step
    plen = parse(pattern, exp);
    g_assert_cmpint(plen, ==, 4);
 
-   dfa = dfa_new(plen, tau, 1, 1, 50);
+   dfa = dfa_new(plen, tau, 1, 1, 49);
    g_assert(dfa != NULL);
 
    state = DFA_ROOT_STATE;
    // text[0] A
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[0]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[0]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 0);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 2);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 2);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 2);
 
    // text[1] T
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[1]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[1]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 0);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 2);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 2);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 2);
 
    // text[2] T
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[2]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[2]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 1);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 2);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 3);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 3);
 
    // text[3] A
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[3]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[3]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 0);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 2);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 2);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 2);
 
    // text[4] A
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[4]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[4]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 0);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 2);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 1);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 1);
 
    // text[5] A
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[5]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[5]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 0);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 1);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 0);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 1);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 0);
 
    // text[6] T
-   g_assert(0 == dfa_step(state, translate_ignore[(int)text[6]], plen, tau, &dfa, exp, &state));
+   g_assert(0 == dfa_step(state, translate_ignore[(int)text[6]], plen, tau, &dfa, exp, NULL, &state));
    g_assert_cmpint(state, ==, 0);
-   vertex = (vertex_t *) (dfa->states + state * dfa->state_size);
-   g_assert_cmpint(get_match(vertex->match), ==, 1);
-   g_assert_cmpint(get_mintomatch(vertex->match), ==, 0);
+   g_assert_cmpint(get_match(state_match(dfa, state)), ==, 1);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 0);
 
    dfa_free(dfa);
-   
+
+   // Patterns on both sides of the bit-parallel kernel limit (64 and 70 bases).
+   char * longpat = "GATCGGAAGAGCACACGTCTGAACTCCAGTCACGATCGGAAGAGCACACGTCTGAACTCCAGTCACATCTCG";
+   char   longexp[strlen(longpat)];
+   for (int len = BITPAR_MAX_PLEN; len <= 70; len += 6) {
+      char subpat[len+1];
+      strncpy(subpat, longpat, len);
+      subpat[len] = 0;
+      tau = 3;
+      plen = parse(subpat, longexp);
+      g_assert_cmpint(plen, ==, len);
+      dfa = dfa_new(plen, tau, 1, 1, 0);
+      g_assert(dfa != NULL);
+      // Exact match, with two substitutions and one deletion.
+      for (int k = 0; k < 2; k++) {
+         state = DFA_ROOT_STATE;
+         for (int i = 0; i < len; i++) {
+            int base = translate_ignore[(int)subpat[i]];
+            if (k == 1 && (i == 10 || i == 30)) base = (base + 1) % 4;
+            if (k == 1 && i == 50) continue;
+            g_assert(0 == dfa_step(state, base, plen, tau, &dfa, longexp, NULL, &state));
+         }
+         g_assert_cmpint(get_match(state_match(dfa, state)), ==, 3*k);
+         g_assert_cmpint(get_mintomatch(state_match(dfa, state)), ==, 0);
+      }
+      dfa_free(dfa);
+   }
 
    // Alloc exhaustive test.
    /*
@@ -699,7 +773,7 @@ test_dfa_step
    transition.state = 0;
    for (int i = 0; i < 1000; i++) {
       int base = lrand48() % NBASES;
-      if (dfa_step(transition.state, base, plen, tau, &dfa, exp2, &transition) == -1) {
+      if (dfa_step(transition.state, base, plen, tau, &dfa, exp2, NULL, &transition) == -1) {
          dfa = dfa_new(plen, tau, 1, 1);
          transition.state = 0;
       }
@@ -710,6 +784,62 @@ test_dfa_step
    return;
 }
 
+void
+test_dfa_evict
+(void)
+{
+   char   * pattern = "CATG";
+   char   * text = "ATCCTCATGA";
+   uint     tau = 1;
+   char     exp[strlen(pattern)];
+   uint     plen = parse(pattern, exp);
+
+   // No eviction without memory limit.
+   dfa_t  * dfa = dfa_new(plen, tau, 1, 1, 0);
+   g_assert(dfa != NULL);
+   g_assert_cmpint(dfa_evictable(dfa), ==, 0);
+   g_assert(dfa->used == NULL);
+   dfa_free(dfa);
+
+   dfa = dfa_new(plen, tau, 1, 1, 4096);
+   g_assert(dfa != NULL);
+   g_assert_cmpint(dfa_evictable(dfa), ==, 0);
+   g_assert(dfa->used != NULL);
+
+   // States 2 to 7 (see test_dfa_step).
+   uint32_t state = DFA_ROOT_STATE;
+   for (int i = 0; i < 8; i++)
+      g_assert(0 == dfa_step(state, translate_ignore[(int)text[i]], plen, tau, &dfa, exp, NULL, &state));
+   g_assert_cmpint(dfa->pos, ==, 8);
+   uint8_t path[4];
+   path_decode(state_code(dfa, 6), path, 4);
+
+   // Not enough unused states.
+   for (int i = 2; i < 7; i++) dfa->used[i] = 1;
+   g_assert_cmpint(dfa_evict(dfa), ==, 0);
+   g_assert_cmpint(dfa->pos, ==, 8);
+   g_assert_cmpint(dfa->used[2], ==, 0);
+
+   // Keep states 4 and 6.
+   dfa->used[4] = dfa->used[6] = 1;
+   g_assert_cmpint(dfa_evict(dfa), ==, 0);
+   g_assert_cmpint(dfa->pos, ==, 4);
+   g_assert_cmpint(state_next(dfa, 1, 0), ==, DFA_COMPUTE);
+   g_assert_cmpint(get_match(state_match(dfa, 2)), ==, 2);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, 2)), ==, 2);
+   g_assert_cmpint(state_next(dfa, 2, 1), ==, 2);
+   g_assert_cmpint(state_next(dfa, 2, 0), ==, 3);
+   uint32_t found;
+   g_assert_cmpint(trie_search(dfa, path, &found, 4), ==, 1);
+   g_assert_cmpint(found, ==, 3);
+
+   // Evicted states are computed again.
+   g_assert(0 == dfa_step(DFA_ROOT_STATE, translate_ignore[(int)text[0]], plen, tau, &dfa, exp, NULL, &state));
+   g_assert_cmpint(state, ==, 4);
+
+   dfa_free(dfa);
+}
+
 void
 test_parse
 (void)
@@ -760,6 +890,41 @@ test_parse
 
 }
 
+void
+test_text_translate
+(void)
+{
+   // All the characters, in all the positions of a vector block.
+   char text[300];
+   uint8_t codes[301];
+   const int opts[6] = {SQ_FAIL, SQ_IGNORE, SQ_CONVERT, SQ_FAIL|SQ_STREAM,
+                        SQ_IGNORE|SQ_STREAM, SQ_CONVERT|SQ_STREAM};
+   for (int k = 0; k < 6; k++) {
+      const int * translate = (opts[k] & MASK_NONDNA) == SQ_CONVERT ? translate_convert : translate_ignore;
+      for (int c = 1; c < 256; c++) {
+         for (int pos = 0; pos < 40; pos++) {
+            for (int i = 0; i < 299; i++) text[i] = "ACGTUNacgtun"[i % 12];
+            text[pos] = (char) c;
+            text[299] = 0;
+            size_t n = text_translate(text, codes, 299, opts[k]);
+            g_assert_cmpint(n, <=, 300);
+            // The codes are written up to the first one that ends the search.
+            g_assert_cmpint(codes[pos], ==, translate[c]);
+            for (size_t i = 0; i < n; i++) g_assert_cmpint(codes[i], ==, translate[(uint8_t) text[i]]);
+            if (n == 300) g_assert_cmpint(codes[299], ==, 5);
+            else g_assert_cmpint(n, ==, pos + 1);
+         }
+      }
+   }
+   // Short strings.
+   g_assert_cmpint(text_translate("", codes, 0, 0), ==, 1);
+   g_assert_cmpint(codes[0], ==, 5);
+   g_assert_cmpint(text_translate("ACGT\nACGT", codes, 9, SQ_LINES), ==, 5);
+   g_assert_cmpint(codes[4], ==, 6);
+   g_assert_cmpint(text_translate("ACGT\nACGT", codes, 9, SQ_STREAM), ==, 10);
+   g_assert_cmpint(codes[9], ==, 5);
+}
+
 void
 test_seeqNew
 (void)
@@ -769,8 +934,8 @@ test_seeqNew
    g_assert(sq != NULL);
 
    // seeq_t
-   g_assert_cmpint(sq->hits, ==, 0);
-   g_assert_cmpint(sq->stacksize, ==, INITIAL_MATCH_STACK_SIZE);
+   g_assert_cmpint(sq->ctx.hits, ==, 0);
+   g_assert_cmpint(sq->ctx.stacksize, ==, INITIAL_MATCH_STACK_SIZE);
    g_assert_cmpint(sq->tau, ==, 2);
    g_assert_cmpint(sq->wlen, ==, 5);
    g_assert_cmpint(sq->keys[0], ==, 1);
@@ -780,15 +945,15 @@ test_seeqNew
    g_assert_cmpint(sq->keys[4], ==, 1);
    g_assert(sq->dfa  != NULL);
    g_assert(sq->rdfa != NULL);
-   g_assert(sq->match != NULL);
+   g_assert(sq->ctx.match != NULL);
    g_assert(sq->string == NULL);
    seeqFree(sq);
    
    // Open stdin.
    sq = seeqNew("ACG[AT]", 1, 0);
    g_assert(sq != NULL);
-   g_assert_cmpint(sq->hits, ==, 0);
-   g_assert_cmpint(sq->stacksize, ==, INITIAL_MATCH_STACK_SIZE);
+   g_assert_cmpint(sq->ctx.hits, ==, 0);
+   g_assert_cmpint(sq->ctx.stacksize, ==, INITIAL_MATCH_STACK_SIZE);
    g_assert_cmpint(sq->tau, ==, 1);
    g_assert_cmpint(sq->wlen, ==, 4);
    g_assert_cmpint(sq->keys[0], ==, 1);
@@ -797,7 +962,7 @@ test_seeqNew
    g_assert_cmpint(sq->keys[3], ==, 9);
    g_assert(sq->dfa  != NULL);
    g_assert(sq->rdfa != NULL);
-   g_assert(sq->match != NULL);
+   g_assert(sq->ctx.match != NULL);
    g_assert(sq->string == NULL);
    seeqFree(sq);
 
@@ -824,6 +989,42 @@ test_seeqNew
    sq = seeqNew("ACT[AG]A[TG", 1, 0);
    g_assert(sq == NULL);
    g_assert_cmpint(seeqerr, ==, 5);
+
+   // Precompiled DFAs.
+   sq = seeqNewOpt("ACG[AT]", 1, 0, SQ_PRECOMPILE);
+   g_assert(sq != NULL);
+   dfa_t * dfa = (dfa_t *) sq->dfa;
+   g_assert_cmpint(dfa->complete, ==, 1);
+   g_assert_cmpint(((dfa_t *) sq->rdfa)->complete, ==, 1);
+   for (size_t i = DFA_ROOT_STATE; i < dfa->pos; i++) {
+      for (int j = 0; j < NBASES; j++) {
+         g_assert(state_next(dfa, i, j) != DFA_COMPUTE);
+         g_assert_cmpint(state_next(dfa, i, j), <, dfa->pos);
+      }
+   }
+   size_t pos = dfa->pos;
+   g_assert_cmpint(seeqStringMatch("TTACCTTTACGAGG", sq, SQ_ALL), ==, 2);
+   g_assert_cmpint(dfa->pos, ==, pos);
+   match_t * match = seeqMatchIter(sq);
+   g_assert_cmpint(match->start, ==, 2);
+   g_assert_cmpint(match->end, ==, 6);
+   g_assert_cmpint(match->dist, ==, 1);
+   match = seeqMatchIter(sq);
+   g_assert_cmpint(match->start, ==, 8);
+   g_assert_cmpint(match->end, ==, 12);
+   g_assert_cmpint(match->dist, ==, 0);
+   seeqFree(sq);
+
+   // Precompile with memory limit (falls back to lazy DFA).
+   sq = seeqNewOpt("ACGTACGTAC", 3, 500, SQ_PRECOMPILE);
+   g_assert(sq != NULL);
+   g_assert_cmpint(((dfa_t *) sq->dfa)->complete, ==, 0);
+   g_assert_cmpint(seeqStringMatch("TTACGTACCTACTT", sq, SQ_BEST), ==, 1);
+   match = seeqMatchIter(sq);
+   g_assert_cmpint(match->start, ==, 2);
+   g_assert_cmpint(match->end, ==, 12);
+   g_assert_cmpint(match->dist, ==, 1);
+   seeqFree(sq);
 }
 
 void
@@ -835,7 +1036,7 @@ test_seeqFileMatch
    seeq_t * sq = seeqNew("ATCG", 1, 0);
    g_assert(sq != NULL);
    g_assert_cmpint(seeqFileMatch(sqfile, sq, SQ_FIRST, SQ_MATCH), ==, 1);
-   g_assert_cmpint(sq->hits, ==, 1);
+   g_assert_cmpint(sq->ctx.hits, ==, 1);
    match_t * match = seeqMatchIter(sq);
    g_assert(match != NULL);
    g_assert(seeqMatchIter(sq) == NULL);
@@ -846,7 +1047,7 @@ test_seeqFileMatch
    g_assert_cmpstr(seeqGetString(sq), ==, "GTATGTACCACAGATGTCGATCGAC");
 
    g_assert_cmpint(seeqFileMatch(sqfile, sq, SQ_FIRST, SQ_MATCH), ==, 1);
-   g_assert_cmpint(sq->hits, ==, 1);
+   g_assert_cmpint(sq->ctx.hits, ==, 1);
    match = seeqMatchIter(sq);
    g_assert_cmpint(match->start, ==, 3);
    g_assert_cmpint(match->end, ==, 7);
@@ -862,7 +1063,7 @@ test_seeqFileMatch
    sq = seeqNew("TGTC", 1, 0);
    g_assert(sq != NULL);
    g_assert_cmpint(seeqFileMatch(sqfile, sq, SQ_BEST, SQ_MATCH), ==, 1);
-   g_assert_cmpint(sq->hits, ==, 1);
+   g_assert_cmpint(sq->ctx.hits, ==, 1);
    match = seeqMatchIter(sq);
    g_assert_cmpint(match->start, ==, 14);
    g_assert_cmpint(match->end, ==, 18);
@@ -871,7 +1072,7 @@ test_seeqFileMatch
    g_assert_cmpstr(seeqGetString(sq), ==, "GTATGTACCACAGATGTCGATCGAC");
 
    g_assert_cmpint(seeqFileMatch(sqfile, sq, SQ_BEST, SQ_MATCH), ==, 1);
-   g_assert_cmpint(sq->hits, ==, 1);
+   g_assert_cmpint(sq->ctx.hits, ==, 1);
    match = seeqMatchIter(sq);
    g_assert_cmpint(match->start, ==, 2);
    g_assert_cmpint(match->end, ==, 6);
@@ -886,12 +1087,12 @@ test_seeqFileMatch
    sq = seeqNew("CACAGAT", 1, 0);
    g_assert(sq != NULL);
    g_assert_cmpint(seeqFileMatch(sqfile, sq, 0, SQ_NOMATCH), ==, 1);
-   g_assert_cmpint(sq->hits, ==, 0);
+   g_assert_cmpint(sq->ctx.hits, ==, 0);
    g_assert_cmpint(sqfile->line, ==, 2);
    g_assert_cmpstr(seeqGetString(sq), ==, "TCTATCATCCGTACTCTGATCTCAT");
 
    g_assert_cmpint(seeqFileMatch(sqfile, sq, 0, SQ_NOMATCH), ==, 1);
-   g_assert_cmpint(sq->hits, ==, 0);
+   g_assert_cmpint(sq->ctx.hits, ==, 0);
    g_assert_cmpint(sqfile->line, ==, 3);
    g_assert_cmpstr(seeqGetString(sq), ==, "RCACAGATCACAGATCACAGRATCAC");
 
@@ -901,7 +1102,7 @@ test_seeqFileMatch
    g_assert(sqfile != NULL);
    g_assert(sq != NULL);
    g_assert_cmpint(seeqFileMatch(sqfile, sq, SQ_BEST, SQ_ANY), ==, 1);
-   g_assert_cmpint(sq->hits, ==, 1);
+   g_assert_cmpint(sq->ctx.hits, ==, 1);
    match = seeqMatchIter(sq);
    g_assert_cmpint(match->start, ==, 8);
    g_assert_cmpint(match->end, ==, 15);
@@ -910,7 +1111,7 @@ test_seeqFileMatch
    g_assert_cmpstr(seeqGetString(sq), ==, "GTATGTACCACAGATGTCGATCGAC");
 
    g_assert_cmpint(seeqFileMatch(sqfile, sq, SQ_BEST, SQ_ANY), ==, 1);
-   g_assert_cmpint(sq->hits, ==, 0);
+   g_assert_cmpint(sq->ctx.hits, ==, 0);
    g_assert_cmpstr(seeqGetString(sq), ==, "TCTATCATCCGTACTCTGATCTCAT");
 
    g_assert_cmpint(seeqFileMatch(sqfile, sq, 0, SQ_MATCH), ==, 0);
@@ -930,6 +1131,47 @@ test_seeqFileMatch
    g_assert_cmpint(seeqFileMatch(sqfile, sq, 0, SQ_COUNTMATCH), ==, 4);
    seeqClose(sqfile);
 
+   // Lines longer than the read blocks and last line without newline,
+   // from a mapped file and from a pipe.
+   const char * fname = "testlines.fa";
+   const size_t longsz = 3000000;
+   FILE * f = fopen(fname, "w");
+   g_assert(f != NULL);
+   fprintf(f, ">h1\n");
+   for (size_t i = 0; i < longsz; i++) fputc(i >= 2000000 && i < 2000008 ? "ACGTTGCA"[i-2000000] : 'T', f);
+   fprintf(f, "\n\n>h2\nTTACGTTGCATT");
+   fclose(f);
+   seeq_t * lsq = seeqNew("ACGTTGCA", 0, 0);
+   g_assert(lsq != NULL);
+   for (int piped = 0; piped < 2; piped++) {
+      char path[64] = "testlines.fa";
+      FILE * cat = NULL;
+      if (piped) {
+         cat = popen("cat testlines.fa", "r");
+         g_assert(cat != NULL);
+         sprintf(path, "/dev/fd/%d", fileno(cat));
+      }
+      sqfile = seeqOpen(path);
+      g_assert(sqfile != NULL);
+      g_assert_cmpint(sqfile->mapped, ==, !piped);
+      g_assert_cmpint(seeqFileMatch(sqfile, lsq, SQ_FIRST, SQ_MATCH), ==, 1);
+      g_assert_cmpint(sqfile->line, ==, 1);
+      g_assert_cmpstr(sqfile->info, ==, ">h1");
+      g_assert_cmpint(strlen(seeqGetString(lsq)), ==, longsz);
+      match = seeqMatchIter(lsq);
+      g_assert(match != NULL);
+      g_assert_cmpint(match->start, ==, 2000000);
+      g_assert_cmpint(seeqFileMatch(sqfile, lsq, SQ_FIRST, SQ_MATCH), ==, 1);
+      g_assert_cmpint(sqfile->line, ==, 3);
+      g_assert_cmpstr(sqfile->info, ==, ">h2");
+      g_assert_cmpstr(seeqGetString(lsq), ==, "TTACGTTGCATT");
+      g_assert_cmpint(seeqFileMatch(sqfile, lsq, SQ_FIRST, SQ_MATCH), ==, 0);
+      seeqClose(sqfile);
+      if (cat != NULL) pclose(cat);
+   }
+   seeqFree(lsq);
+   unlink(fname);
+
    // Force error
    sqfile = seeqOpen(NULL);
    g_assert(sqfile != NULL);
@@ -941,7 +1183,7 @@ test_seeqFileMatch
    // String first match.
    sq = seeqNew("GATC", 1, 0);
    g_assert_cmpint(seeqStringMatch("TGACTGATGACGTAGTCTACGATCGATCAGTCA", sq, SQ_FIRST), == , 1);
-   g_assert_cmpint(sq->hits, ==, 1);
+   g_assert_cmpint(sq->ctx.hits, ==, 1);
    match = seeqMatchIter(sq);
    g_assert_cmpint(match->start, ==, 1);
    g_assert_cmpint(match->end, ==, 4);
@@ -949,7 +1191,7 @@ test_seeqFileMatch
 
    // String best match.
    g_assert_cmpint(seeqStringMatch("TGACTGATGACGTAGTCTACGATCGATCAGTCA", sq, SQ_BEST), == , 1);
-   g_assert_cmpint(sq->hits, ==, 1);
+   g_assert_cmpint(sq->ctx.hits, ==, 1);
    match = seeqMatchIter(sq);
    g_assert_cmpint(match->start, ==, 20);
    g_assert_cmpint(match->end, ==, 24);
@@ -957,77 +1199,1401 @@ test_seeqFileMatch
 
    // String all matches.
    g_assert_cmpint(seeqStringMatch("TGACTGATGACGTAGTCTACGATCGATCAGTCA", sq, SQ_ALL), == , 7);
-   g_assert_cmpint(sq->hits, ==, 7);
-   g_assert_cmpint(sq->match[6].start, ==, 1);
-   g_assert_cmpint(sq->match[6].end, ==, 4);
-   g_assert_cmpint(sq->match[6].dist, ==, 1);
+   g_assert_cmpint(sq->ctx.hits, ==, 7);
+   g_assert_cmpint(sq->ctx.match[6].start, ==, 1);
+   g_assert_cmpint(sq->ctx.match[6].end, ==, 4);
+   g_assert_cmpint(sq->ctx.match[6].dist, ==, 1);
 
-   g_assert_cmpint(sq->match[5].start, ==, 5);
-   g_assert_cmpint(sq->match[5].end, ==, 9);
-   g_assert_cmpint(sq->match[5].dist, ==, 1);
+   g_assert_cmpint(sq->ctx.match[5].start, ==, 5);
+   g_assert_cmpint(sq->ctx.match[5].end, ==, 9);
+   g_assert_cmpint(sq->ctx.match[5].dist, ==, 1);
 
-   g_assert_cmpint(sq->match[4].start, ==, 8);
-   g_assert_cmpint(sq->match[4].end, ==, 11);
-   g_assert_cmpint(sq->match[4].dist, ==, 1);
+   g_assert_cmpint(sq->ctx.match[4].start, ==, 8);
+   g_assert_cmpint(sq->ctx.match[4].end, ==, 11);
+   g_assert_cmpint(sq->ctx.match[4].dist, ==, 1);
 
-   g_assert_cmpint(sq->match[3].start, ==, 14);
-   g_assert_cmpint(sq->match[3].end, ==, 17);
-   g_assert_cmpint(sq->match[3].dist, ==, 1);
+   g_assert_cmpint(sq->ctx.match[3].start, ==, 14);
+   g_assert_cmpint(sq->ctx.match[3].end, ==, 17);
+   g_assert_cmpint(sq->ctx.match[3].dist, ==, 1);
 
-   g_assert_cmpint(sq->match[2].start, ==, 20);
-   g_assert_cmpint(sq->match[2].end, ==, 24);
-   g_assert_cmpint(sq->match[2].dist, ==, 0);
+   g_assert_cmpint(sq->ctx.match[2].start, ==, 20);
+   g_assert_cmpint(sq->ctx.match[2].end, ==, 24);
+   g_assert_cmpint(sq->ctx.match[2].dist, ==, 0);
 
-   g_assert_cmpint(sq->match[1].start, ==, 24);
-   g_assert_cmpint(sq->match[1].end, ==, 28);
-   g_assert_cmpint(sq->match[1].dist, ==, 0);
+   g_assert_cmpint(sq->ctx.match[1].start, ==, 24);
+   g_assert_cmpint(sq->ctx.match[1].end, ==, 28);
+   g_assert_cmpint(sq->ctx.match[1].dist, ==, 0);
 
-   g_assert_cmpint(sq->match[0].start, ==, 29);
-   g_assert_cmpint(sq->match[0].end, ==, 32);
-   g_assert_cmpint(sq->match[0].dist, ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 29);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 32);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 1);
 
    seeqFree(sq);
 
    // Overlapping matches.
    sq = seeqNew("GAAG", 0, 0);
    g_assert_cmpint(seeqStringMatch("GAAGAAG", sq, SQ_ALL), == , 2);
-   g_assert_cmpint(sq->hits, ==, 2);
-   g_assert_cmpint(sq->match[0].start, ==, 3);
-   g_assert_cmpint(sq->match[0].end, ==, 7);
-   g_assert_cmpint(sq->match[0].dist, ==, 0);
-   g_assert_cmpint(sq->match[1].start, ==, 0);
-   g_assert_cmpint(sq->match[1].end, ==, 4);
-   g_assert_cmpint(sq->match[1].dist, ==, 0);
+   g_assert_cmpint(sq->ctx.hits, ==, 2);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 3);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 7);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 0);
+   g_assert_cmpint(sq->ctx.match[1].start, ==, 0);
+   g_assert_cmpint(sq->ctx.match[1].end, ==, 4);
+   g_assert_cmpint(sq->ctx.match[1].dist, ==, 0);
 
    seeqFree(sq);
 
    // Overlapping matches.
    sq = seeqNew("GAAG", 1, 0);
    g_assert_cmpint(seeqStringMatch("GAAGAAG", sq, SQ_ALL), == , 2);
-   g_assert_cmpint(sq->hits, ==, 2);
-   g_assert_cmpint(sq->match[1].start, ==, 0);
-   g_assert_cmpint(sq->match[1].end, ==, 4);
-   g_assert_cmpint(sq->match[1].dist, ==, 0);
+   g_assert_cmpint(sq->ctx.hits, ==, 2);
+   g_assert_cmpint(sq->ctx.match[1].start, ==, 0);
+   g_assert_cmpint(sq->ctx.match[1].end, ==, 4);
+   g_assert_cmpint(sq->ctx.match[1].dist, ==, 0);
 
-   g_assert_cmpint(sq->match[0].start, ==, 3);
-   g_assert_cmpint(sq->match[0].end, ==, 7);
-   g_assert_cmpint(sq->match[0].dist, ==, 0);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 3);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 7);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 0);
 
    seeqFree(sq);
 
    // Overlapping matches.
    sq = seeqNew("GAAG", 1, 0);
    g_assert_cmpint(seeqStringMatch("GAAGACG", sq, SQ_ALL), == , 2);
-   g_assert_cmpint(sq->hits, ==, 2);
-   g_assert_cmpint(sq->match[0].start, ==, 3);
-   g_assert_cmpint(sq->match[0].end, ==, 7);
-   g_assert_cmpint(sq->match[0].dist, ==, 1);
+   g_assert_cmpint(sq->ctx.hits, ==, 2);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 3);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 7);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 1);
+
+   g_assert_cmpint(sq->ctx.match[1].start, ==, 0);
+   g_assert_cmpint(sq->ctx.match[1].end, ==, 4);
+   g_assert_cmpint(sq->ctx.match[1].dist, ==, 0);
+
+   seeqFree(sq);
+}
 
-   g_assert_cmpint(sq->match[1].start, ==, 0);
-   g_assert_cmpint(sq->match[1].end, ==, 4);
-   g_assert_cmpint(sq->match[1].dist, ==, 0);
+void
+test_seeqLoad
+(void)
+{
+   char * text = "TTACCTTTACGAGGACGTTTTACCTACGAAT";
+   const char * fname = "testdfa.sqdfa";
+
+   // Lazy DFA (copied to memory when loaded).
+   seeq_t * sq = seeqNew("ACG[AT]", 1, 0);
+   g_assert(sq != NULL);
+   g_assert_cmpint(seeqStringMatch(text, sq, SQ_ALL), ==, 6);
+   g_assert_cmpint(seeqSave(sq, fname), ==, 0);
+   seeq_t * lsq = seeqLoad(fname, 0);
+   g_assert(lsq != NULL);
+   g_assert_cmpint(lsq->wlen, ==, 4);
+   g_assert_cmpint(lsq->tau, ==, 1);
+   g_assert_cmpint(memcmp(lsq->keys, sq->keys, 4), ==, 0);
+   g_assert_cmpint(memcmp(lsq->rkeys, sq->rkeys, 4), ==, 0);
+   dfa_t * dfa = (dfa_t *) lsq->dfa;
+   g_assert(dfa->states == dfa->map);
+   g_assert_cmpint(dfa->complete, ==, 0);
+   g_assert_cmpint(dfa->pos, ==, ((dfa_t *) sq->dfa)->pos);
+   g_assert_cmpint(dfa->trie->pos, ==, ((dfa_t *) sq->dfa)->trie->pos);
+   g_assert_cmpint(memcmp(dfa->states, ((dfa_t *) sq->dfa)->states, dfa->pos * dfa->state_size), ==, 0);
+   g_assert_cmpint(seeqStringMatch(text, lsq, SQ_ALL), ==, 6);
+   for (size_t i = 0; i < sq->ctx.hits; i++) {
+      g_assert_cmpint(lsq->ctx.match[i].start, ==, sq->ctx.match[i].start);
+      g_assert_cmpint(lsq->ctx.match[i].end, ==, sq->ctx.match[i].end);
+      g_assert_cmpint(lsq->ctx.match[i].dist, ==, sq->ctx.match[i].dist);
+   }
+   // Loaded DFA keeps growing.
+   size_t pos = dfa->pos;
+   g_assert_cmpint(seeqStringMatch("GGGGTCCGANNACGN", lsq, SQ_ALL), ==, 2);
+   g_assert_cmpint(dfa->pos, >, pos);
+   seeqFree(lsq);
+
+   // Shared DFA, matched with contexts.
+   g_assert(seeqCtxNew(sq) == NULL);
+   lsq = seeqLoadOpt(fname, 0, SQ_SHARED | SQ_STRIDE2);
+   g_assert(lsq != NULL);
+   g_assert_cmpint(((dfa_t *) lsq->dfa)->shared, ==, 1);
+   g_assert_cmpint(((dfa_t *) lsq->rdfa)->shared, ==, 1);
+   g_assert(((dfa_t *) lsq->dfa)->pairs != NULL);
+   seeq_ctx_t * ctx = seeqCtxNew(lsq);
+   g_assert(ctx != NULL);
+   g_assert_cmpint(seeqCtxMatchN(text, strlen(text), lsq, ctx, SQ_ALL), ==, 6);
+   for (size_t i = 0; i < sq->ctx.hits; i++) {
+      g_assert_cmpint(ctx->match[i].start, ==, sq->ctx.match[i].start);
+      g_assert_cmpint(ctx->match[i].end, ==, sq->ctx.match[i].end);
+   }
+   seeqCtxFree(ctx);
+   seeqFree(lsq);
+   seeqFree(sq);
+
+   // Complete DFA (mapped).
+   sq = seeqNewOpt("ACG[AT]", 1, 0, SQ_PRECOMPILE);
+   g_assert(sq != NULL);
+   g_assert_cmpint(seeqSave(sq, fname), ==, 0);
+   lsq = seeqLoad(fname, 0);
+   g_assert(lsq != NULL);
+   dfa = (dfa_t *) lsq->dfa;
+   g_assert(dfa->map != NULL);
+   g_assert_cmpint(dfa->complete, ==, 1);
+   g_assert_cmpint(((dfa_t *) lsq->rdfa)->complete, ==, 1);
+   g_assert_cmpint(dfa->pos, ==, ((dfa_t *) sq->dfa)->pos);
+   g_assert_cmpint(seeqStringMatch(text, sq, SQ_ALL), ==, 6);
+   g_assert_cmpint(seeqStringMatch(text, lsq, SQ_ALL), ==, 6);
+   for (size_t i = 0; i < sq->ctx.hits; i++) {
+      g_assert_cmpint(lsq->ctx.match[i].start, ==, sq->ctx.match[i].start);
+      g_assert_cmpint(lsq->ctx.match[i].end, ==, sq->ctx.match[i].end);
+      g_assert_cmpint(lsq->ctx.match[i].dist, ==, sq->ctx.match[i].dist);
+   }
+   seeqFree(lsq);
+   seeqFree(sq);
+
+   // Missing file.
+   unlink(fname);
+   g_assert(seeqLoad(fname, 0) == NULL);
+   g_assert_cmpint(seeqerr, ==, 0);
+
+   // Bad format.
+   FILE * f = fopen(fname, "w");
+   g_assert(f != NULL);
+   fprintf(f, "ACGTACGTAC\nACGTAGCTAGCTGATCGATGCTAGCTGACTGACTGATCGATCGATCGATCGATCGATCGATCGATGCATGCA\n");
+   fclose(f);
+   g_assert(seeqLoad(fname, 0) == NULL);
+   g_assert_cmpint(seeqerr, ==, 12);
+
+   // Truncated file.
+   sq = seeqNew("ACGTAC", 2, 0);
+   g_assert(sq != NULL);
+   g_assert_cmpint(seeqSave(sq, fname), ==, 0);
+   seeqFree(sq);
+   g_assert_cmpint(truncate(fname, 200), ==, 0);
+   g_assert(seeqLoad(fname, 0) == NULL);
+   g_assert_cmpint(seeqerr, ==, 13);
+
+   // Corrupted transition, code and trie node.
+   for (int k = 0; k < 3; k++) {
+      sq = seeqNew("GATTACAGATTACA", 2, 0);
+      g_assert(sq != NULL);
+      g_assert_cmpint(seeqStringMatch("GATTACAGATTAAAT", sq, SQ_ALL), ==, 1);
+      g_assert_cmpint(seeqSave(sq, fname), ==, 0);
+      seeqFree(sq);
+      dfasec_t sec;
+      int fd = open(fname, O_RDWR);
+      g_assert(fd >= 0);
+      g_assert_cmpint(pread(fd, &sec, sizeof(dfasec_t), sizeof(dfahdr_t)), ==, sizeof(dfasec_t));
+      node_t node = {0, {(uint32_t) sec.nnodes, 0, 0}};
+      uint8_t junk[8];
+      memset(junk, k == 0 ? 0x7f : 0xff, 8);
+      if (k == 0) g_assert_cmpint(pwrite(fd, junk, 8, (off_t) (sec.states + sec.state_size)), ==, 8);
+      if (k == 1) g_assert_cmpint(pwrite(fd, junk, 1, (off_t) sec.codes), ==, 1);
+      if (k == 2) g_assert_cmpint(pwrite(fd, &node, sizeof(node_t), (off_t) sec.nodes), ==, sizeof(node_t));
+      close(fd);
+      g_assert(seeqLoad(fname, 0) == NULL);
+      g_assert_cmpint(seeqerr, ==, 13);
+   }
+
+   // Corrupted transition of a complete DFA, only checked with SQ_VERIFY.
+   sq = seeqNewOpt("GATTACA", 1, 0, SQ_PRECOMPILE);
+   g_assert(sq != NULL);
+   g_assert_cmpint(seeqSave(sq, fname), ==, 0);
+   seeqFree(sq);
+   dfasec_t sec;
+   int fd = open(fname, O_RDWR);
+   g_assert(fd >= 0);
+   g_assert_cmpint(pread(fd, &sec, sizeof(dfasec_t), sizeof(dfahdr_t)), ==, sizeof(dfasec_t));
+   g_assert_cmpint(sec.complete, ==, 1);
+   uint8_t junk[8];
+   memset(junk, 0x7f, 8);
+   g_assert_cmpint(pwrite(fd, junk, 8, (off_t) (sec.states + sec.state_size)), ==, 8);
+   close(fd);
+   lsq = seeqLoad(fname, 0);
+   g_assert(lsq != NULL);
+   seeqFree(lsq);
+   g_assert(seeqLoadOpt(fname, 0, SQ_VERIFY) == NULL);
+   g_assert_cmpint(seeqerr, ==, 13);
+
+   // Corrupted section descriptor (see 'dfa_checksum').
+   sq = seeqNew("GATTACA", 1, 0);
+   g_assert(sq != NULL);
+   g_assert_cmpint(seeqSave(sq, fname), ==, 0);
+   seeqFree(sq);
+   fd = open(fname, O_RDWR);
+   g_assert(fd >= 0);
+   g_assert_cmpint(pread(fd, &sec, sizeof(dfasec_t), sizeof(dfahdr_t)), ==, sizeof(dfasec_t));
+   sec.nnodes--;
+   g_assert_cmpint(pwrite(fd, &sec, sizeof(dfasec_t), sizeof(dfahdr_t)), ==, sizeof(dfasec_t));
+   close(fd);
+   g_assert(seeqLoad(fname, 0) == NULL);
+   g_assert_cmpint(seeqerr, ==, 13);
+   unlink(fname);
+
+   // Unwritable path.
+   sq = seeqNew("ACGTAC", 2, 0);
+   g_assert(sq != NULL);
+   g_assert_cmpint(seeqSave(sq, "nonexistent/testdfa.sqdfa"), ==, -1);
+   seeqFree(sq);
+}
+
+struct clonearg_t {
+   seeq_t  * sq;
+   char   ** lines;
+   int       nlines;
+   long    * hits;
+};
+
+void *
+clone_match
+(
+   void * data
+)
+{
+   struct clonearg_t * arg = data;
+   for (int i = 0; i < arg->nlines; i++) {
+      arg->hits[i] = seeqStringMatch(arg->lines[i], arg->sq, SQ_ALL);
+      if (arg->hits[i] > 0) {
+         match_t * match = seeqMatchIter(arg->sq);
+         arg->hits[i] = arg->hits[i] * 10000 + (long) match->start * 100 + (long) match->end;
+      }
+   }
+   return NULL;
+}
+
+void
+test_seeqClone
+(void)
+{
+   // Private DFAs cannot be shared.
+   seeq_t * sq = seeqNew("ACGTACGTAC", 2, 0);
+   g_assert(sq != NULL);
+   g_assert(seeqClone(sq) == NULL);
+   g_assert_cmpint(seeqerr, ==, 14);
+   seeqFree(sq);
+
+   // Random lines.
+   const int nlines = 2000;
+   char * lines[nlines];
+   srand48(4);
+   for (int i = 0; i < nlines; i++) {
+      lines[i] = malloc(101);
+      for (int j = 0; j < 100; j++) lines[i][j] = "ACGTN"[lrand48() % 5];
+      if (i % 3 == 0) memcpy(lines[i] + lrand48() % 90, "ACGAACGTAC", 10);
+      lines[i][100] = 0;
+   }
+
+   // Reference results.
+   long ref[nlines];
+   sq = seeqNew("ACGTACGTAC", 2, 0);
+   g_assert(sq != NULL);
+   struct clonearg_t refarg = {sq, lines, nlines, ref};
+   clone_match(&refarg);
+   seeqFree(sq);
 
+   // Many threads on a shared DFA, with and without memory limit.
+   const int nthreads = 8;
+   size_t memory[2] = {0, 4096};
+   for (int m = 0; m < 2; m++) {
+      sq = seeqNewOpt("ACGTACGTAC", 2, memory[m], SQ_SHARED);
+      g_assert(sq != NULL);
+      g_assert_cmpint(((dfa_t *) sq->dfa)->shared, ==, 1);
+      pthread_t thread[nthreads];
+      struct clonearg_t arg[nthreads];
+      long hits[nthreads][nlines];
+      for (int t = 0; t < nthreads; t++) {
+         arg[t] = (struct clonearg_t) {seeqClone(sq), lines, nlines, hits[t]};
+         g_assert(arg[t].sq != NULL);
+         g_assert(arg[t].sq->dfa == sq->dfa);
+      }
+      for (int t = 0; t < nthreads; t++)
+         g_assert_cmpint(pthread_create(thread + t, NULL, clone_match, arg + t), ==, 0);
+      for (int t = 0; t < nthreads; t++) {
+         pthread_join(thread[t], NULL);
+         for (int i = 0; i < nlines; i++) g_assert_cmpint(hits[t][i], ==, ref[i]);
+      }
+      // The DFAs outlive the original handle.
+      seeqFree(sq);
+      for (int t = 0; t < nthreads; t++) {
+         clone_match(arg + t);
+         seeqFree(arg[t].sq);
+      }
+   }
+
+   // Complete DFAs are read-only.
+   sq = seeqNewOpt("ACGTACGTAC", 2, 0, SQ_PRECOMPILE);
+   g_assert(sq != NULL);
+   seeq_t * clone = seeqClone(sq);
+   g_assert(clone != NULL);
+   g_assert(clone->ctx.cache == NULL);
+   long hits[nlines];
+   struct clonearg_t arg = {clone, lines, nlines, hits};
+   clone_match(&arg);
+   for (int i = 0; i < nlines; i++) g_assert_cmpint(hits[i], ==, ref[i]);
+   seeqFree(sq);
+   seeqFree(clone);
+
+   for (int i = 0; i < nlines; i++) free(lines[i]);
+}
+
+void
+test_seeqNewMulti
+(void)
+{
+   const char * patterns[4] = {"ACGTACGTAC", "GGGCCCTT", "TTAT[AC]CCGANT", "CAGT"};
+   int tau[4] = {2, 1, 1, 0};
+
+   // Wrong parameters.
+   g_assert(seeqNewMulti(patterns, tau, 0, 0) == NULL);
+   g_assert_cmpint(seeqerr, ==, 1);
+   int wrongtau[2] = {2, 8};
+   g_assert(seeqNewMulti(patterns, wrongtau, 2, 0) == NULL);
+   g_assert_cmpint(seeqerr, ==, 9);
+   const char * wrongpat[2] = {"ACGT", "AC[GT"};
+   g_assert(seeqNewMulti(wrongpat, tau + 2, 2, 0) == NULL);
+   g_assert_cmpint(seeqerr, ==, 5);
+
+   seeq_t * sq = seeqNewMulti(patterns, tau, 4, 0);
+   g_assert(sq != NULL);
+   g_assert_cmpint(sq->wlen, ==, 33);
+   g_assert_cmpint(sq->tau, ==, 2);
+   dfa_t * dfa = (dfa_t *) sq->dfa;
+   g_assert_cmpint(dfa->nseg, ==, 4);
+   g_assert_cmpint(get_match(state_match(dfa, DFA_ROOT_STATE)), ==, 3);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, DFA_ROOT_STATE)), ==, 4);
+
+   // Pattern sets are not cloned nor saved.
+   g_assert(seeqClone(sq) == NULL);
+   g_assert_cmpint(seeqerr, ==, 15);
+   g_assert_cmpint(seeqSave(sq, "testmulti.dfa"), ==, -1);
+   g_assert_cmpint(seeqerr, ==, 15);
+
+   // Tagged matches.
+   g_assert_cmpint(seeqStringMatch("TTTTGGGCCCTTAAAAA", sq, SQ_FIRST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].pattern, ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 4);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 12);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 0);
+   g_assert_cmpint(seeqStringMatch("ACGTTCGTACAATTATCCCGAGTAA", sq, SQ_ALL), ==, 2);
+   match_t * match = seeqMatchIter(sq);
+   g_assert_cmpint(match->pattern, ==, 0);
+   g_assert_cmpint(match->dist, ==, 1);
+   match = seeqMatchIter(sq);
+   g_assert_cmpint(match->pattern, ==, 2);
+   g_assert_cmpint(match->dist, ==, 0);
+   g_assert_cmpint(match->start, ==, 12);
+   g_assert_cmpint(match->end, ==, 23);
+   g_assert(seeqMatchIter(sq) == NULL);
+   // Both matches have relative distance 1 (the first is kept).
+   g_assert_cmpint(seeqStringMatch("ACGTTCGTACAATTATCCCGAGTAA", sq, SQ_BEST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].pattern, ==, 0);
+   g_assert_cmpint(seeqStringMatch("ACGTTCGTACAATTATCCCGAGTAAACGTACGTAC", sq, SQ_BEST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].pattern, ==, 0);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 0);
+   g_assert_cmpint(seeqStringMatch("AAAAAAAAAAAAAAAA", sq, SQ_FIRST), ==, 0);
+   // Patterns at the same position with the same relative distance.
+   g_assert_cmpint(seeqStringMatch("GGGCCCTTCAGT", sq, SQ_ALL), ==, 2);
+
+   // Same results as matching the patterns one by one, with and without
+   // memory limit.
+   const int nlines = 2000;
+   char * lines[nlines];
+   srand48(10);
+   for (int i = 0; i < nlines; i++) {
+      lines[i] = malloc(101);
+      for (int j = 0; j < 100; j++) lines[i][j] = "ACGTN"[lrand48() % 5];
+      if (i % 2 == 0) memcpy(lines[i] + lrand48() % 90, patterns[lrand48() % 2], 8);
+      lines[i][100] = 0;
+   }
+   seeq_t * single[4];
+   for (int k = 0; k < 4; k++) {
+      single[k] = seeqNew(patterns[k], tau[k], 0);
+      g_assert(single[k] != NULL);
+   }
+   for (int m = 0; m < 2; m++) {
+      if (m == 1) {
+         seeqFree(sq);
+         sq = seeqNewMulti(patterns, tau, 4, 4096);
+         g_assert(sq != NULL);
+      }
+      for (int i = 0; i < nlines; i++) {
+         int any = 0;
+         for (int k = 0; k < 4; k++) any |= seeqStringMatch(lines[i], single[k], SQ_FIRST) > 0;
+         g_assert_cmpint(seeqStringMatch(lines[i], sq, SQ_FIRST) > 0, ==, any);
+         // Each match is also found by its pattern alone.
+         long hits = seeqStringMatch(lines[i], sq, SQ_ALL);
+         g_assert_cmpint(hits, >=, 0);
+         for (long h = 0; h < hits; h++) {
+            match_t hit = sq->ctx.match[h];
+            seeq_t * sp = single[hit.pattern];
+            int found = 0;
+            g_assert_cmpint(seeqStringMatch(lines[i], sp, SQ_ALL), >=, 0);
+            for (size_t j = 0; j < sp->ctx.hits; j++) {
+               found |= sp->ctx.match[j].start == hit.start && sp->ctx.match[j].end == hit.end &&
+                        sp->ctx.match[j].dist == hit.dist;
+            }
+            g_assert(found);
+         }
+      }
+   }
+   for (int k = 0; k < 4; k++) seeqFree(single[k]);
+   seeqFree(sq);
+
+   for (int i = 0; i < nlines; i++) free(lines[i]);
+}
+
+void
+test_seeqHamming
+(void)
+{
+   // Counts from 0 to tau+1 in base-3 digits.
+   g_assert_cmpint(ham_width(0), ==, 1);
+   g_assert_cmpint(ham_width(1), ==, 1);
+   g_assert_cmpint(ham_width(2), ==, 2);
+   g_assert_cmpint(ham_width(7), ==, 2);
+   g_assert_cmpint(ham_width(8), ==, 3);
+
+   seeq_t * sq = seeqNewOpt("ACGTACGT", 2, 0, SQ_HAMMING);
+   g_assert(sq != NULL);
+   dfa_t * dfa = (dfa_t *) sq->dfa;
+   g_assert_cmpint(dfa->metric, ==, DFA_HAMMING);
+   g_assert_cmpint(dfa->trie->height, ==, 16);
+   g_assert_cmpint(get_match(state_match(dfa, DFA_ROOT_STATE)), ==, 3);
+   g_assert_cmpint(get_mintomatch(state_match(dfa, DFA_ROOT_STATE)), ==, 8);
+
+   // Substitutions only.
+   g_assert_cmpint(seeqStringMatch("TTACGTTCGTTT", sq, SQ_FIRST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 2);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 10);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 1);
+   g_assert_cmpint(seeqStringMatch("TTACCTACGATT", sq, SQ_FIRST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 2);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 10);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 2);
+   // One deletion is a shift of the last bases.
+   g_assert_cmpint(seeqStringMatch("TTACGACGTTT", sq, SQ_FIRST), ==, 0);
+   seeq_t * lev = seeqNew("ACGTACGT", 2, 0);
+   g_assert(lev != NULL);
+   g_assert_cmpint(seeqStringMatch("TTACGACGTTT", lev, SQ_FIRST), ==, 1);
+   seeqFree(lev);
+   // The start skips the ignored characters.
+   g_assert_cmpint(seeqStringMatch("ACG\nT-ACGTT", sq, SQ_IGNORE | SQ_STREAM), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 0);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 10);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 0);
+
+   // The distance of the matches is the number of mismatches.
+   srand48(11);
+   char line[101];
+   for (int i = 0; i < 500; i++) {
+      for (int j = 0; j < 100; j++) line[j] = "ACGT"[lrand48() % 4];
+      memcpy(line + lrand48() % 92, "ACGTACGT", 8);
+      line[lrand48() % 100] = 'A';
+      line[100] = 0;
+      long hits = seeqStringMatch(line, sq, SQ_ALL);
+      g_assert_cmpint(hits, >, 0);
+      for (long h = 0; h < hits; h++) {
+         g_assert_cmpint(sq->ctx.match[h].end - sq->ctx.match[h].start, ==, 8);
+         size_t d = 0;
+         for (int j = 0; j < 8; j++) d += line[sq->ctx.match[h].start + j] != "ACGTACGT"[j];
+         g_assert_cmpint(sq->ctx.match[h].dist, ==, d);
+      }
+   }
+
+   // The metric is saved with the DFA.
+   g_assert_cmpint(seeqSave(sq, "testhamming.dfa"), ==, 0);
    seeqFree(sq);
+   sq = seeqLoad("testhamming.dfa", 0);
+   g_assert(sq != NULL);
+   g_assert_cmpint(((dfa_t *) sq->dfa)->metric, ==, DFA_HAMMING);
+   g_assert_cmpint(seeqStringMatch("TTACGACGTTT", sq, SQ_FIRST), ==, 0);
+   g_assert_cmpint(seeqStringMatch("TTACGTTCGTTT", sq, SQ_FIRST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 2);
+   seeqFree(sq);
+   unlink("testhamming.dfa");
+}
+
+
+void
+test_seeqBothStrands
+(void)
+{
+   // Shared pattern sets are matched with contexts (see 'test_seeqCtx').
+   seeq_t * sq = seeqNewOpt("ACGTTCG", 1, 0, SQ_BOTHSTRANDS | SQ_SHARED);
+   g_assert(sq != NULL);
+   g_assert(seeqClone(sq) == NULL);
+   g_assert_cmpint(seeqerr, ==, 15);
+   seeqFree(sq);
+
+   sq = seeqNewOpt("AC[GT]TTCG", 1, 0, SQ_BOTHSTRANDS);
+   g_assert(sq != NULL);
+   g_assert_cmpint(sq->wlen, ==, 14);
+   patset_t * pats = (patset_t *) sq->pats;
+   g_assert_cmpint(pats->strands, ==, 1);
+   // Reverse complement CGAA[AC]GT.
+   const char rc[7] = {0x02, 0x04, 0x01, 0x01, 0x03, 0x04, 0x08};
+   for (int i = 0; i < 7; i++) g_assert_cmpint(sq->keys[7+i], ==, rc[i]);
+
+   g_assert_cmpint(seeqStringMatch("TTACGTTCGTTT", sq, SQ_FIRST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 2);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 9);
+   g_assert_cmpint(sq->ctx.match[0].strand, ==, 0);
+   g_assert_cmpint(sq->ctx.match[0].pattern, ==, 0);
+   g_assert_cmpint(seeqStringMatch("GGACGAACGTAA", sq, SQ_FIRST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 3);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 10);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 0);
+   g_assert_cmpint(sq->ctx.match[0].strand, ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].pattern, ==, 0);
+   g_assert_cmpint(seeqStringMatch("ACTTTCGNNNCGAAAGG", sq, SQ_ALL), ==, 2);
+   match_t * match = seeqMatchIter(sq);
+   g_assert_cmpint(match->strand, ==, 0);
+   g_assert_cmpint(match->dist, ==, 0);
+   match = seeqMatchIter(sq);
+   g_assert_cmpint(match->strand, ==, 1);
+   g_assert_cmpint(match->dist, ==, 1);
+   g_assert_cmpint(seeqStringMatch("CCCCCCCCCCCC", sq, SQ_FIRST), ==, 0);
+   seeqFree(sq);
+
+   // Hamming distance on both strands.
+   sq = seeqNewOpt("ACGTTCG", 1, 0, SQ_BOTHSTRANDS | SQ_HAMMING | SQ_PRECOMPILE);
+   g_assert(sq != NULL);
+   g_assert(((dfa_t *) sq->dfa)->complete);
+   g_assert_cmpint(seeqStringMatch("GGACGAACCTAA", sq, SQ_FIRST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 3);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 10);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].strand, ==, 1);
+   // One deletion.
+   g_assert_cmpint(seeqStringMatch("GGCGAAGTAA", sq, SQ_FIRST), ==, 0);
+   seeqFree(sq);
+}
+
+
+void
+test_seeqStride
+(void)
+{
+   seeq_t * sq  = seeqNewOpt("GATTACA", 1, 0, SQ_STRIDE2);
+   seeq_t * ref = seeqNew("GATTACA", 1, 0);
+   g_assert(sq != NULL);
+   g_assert(ref != NULL);
+   dfa_t * dfa = (dfa_t *) sq->dfa;
+   g_assert(dfa->pairs != NULL);
+   g_assert(((dfa_t *) sq->rdfa)->pairs == NULL);
+
+   // The first pass fills the 2-base transitions, the second one uses them.
+   const char * text[5] = {"CCCCGATTACACCCC", "CCCCCGATTACACCCC", "GATTACAGATTTACA",
+                           "CCCCCCCCCCCCGATACA", "CCTTCCAAGGNNCCGGAATTAC"};
+   for (int k = 0; k < 2; k++) {
+      for (int i = 0; i < 5; i++) {
+         g_assert_cmpint(seeqStringMatch(text[i], sq, SQ_ALL), ==, seeqStringMatch(text[i], ref, SQ_ALL));
+         match_t * a, * b;
+         while ((b = seeqMatchIter(ref)) != NULL) {
+            a = seeqMatchIter(sq);
+            g_assert(a != NULL);
+            g_assert_cmpint(a->start, ==, b->start);
+            g_assert_cmpint(a->end, ==, b->end);
+            g_assert_cmpint(a->dist, ==, b->dist);
+         }
+      }
+   }
+   size_t filled = 0;
+   for (size_t i = 0; i < dfa->pos * NBASES * NBASES; i++) filled += dfa->pairs[i] != 0;
+   g_assert_cmpint(filled, >, 0);
+   // No pair holds the state 0.
+   for (size_t i = 0; i < NBASES * NBASES; i++) g_assert(dfa->pairs[i] == 0);
+
+   g_assert_cmpint(seeqStringMatch("CCCCCCCCGATTACA", sq, SQ_FIRST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 8);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 15);
+   g_assert_cmpint(seeqStringMatch("CCCCCCCCGATTAC", sq, SQ_BEST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 1);
+   seeqFree(sq);
+   seeqFree(ref);
+
+   // The pairs are dropped when the states are evicted.
+   sq = seeqNewOpt("GATTACAGATTACA", 3, 2048, SQ_STRIDE2);
+   g_assert(sq != NULL);
+   dfa = (dfa_t *) sq->dfa;
+   srand(13);
+   char line[201];
+   for (int i = 0; i < 200; i++) {
+      for (int j = 0; j < 200; j++) line[j] = "ACGT"[rand()%4];
+      line[200] = 0;
+      g_assert_cmpint(seeqStringMatch(line, sq, SQ_ALL), >=, 0);
+   }
+   for (size_t i = dfa->pos; i < dfa->npairs && i < 1024; i++)
+      for (int j = 0; j < NBASES * NBASES; j++) g_assert(dfa->pairs[i*NBASES*NBASES + j] == 0);
+   g_assert_cmpint(seeqStringMatch("GATTACAGATTACA", sq, SQ_FIRST), ==, 1);
+   seeqFree(sq);
+}
+
+
+void
+test_seeqPackedMatch
+(void)
+{
+   seeq_t * sq  = seeqNew("GATTACA", 1, 0);
+   seeq_t * ref = seeqNew("GATTACA", 1, 0);
+   g_assert(sq != NULL);
+   g_assert(ref != NULL);
+
+   // Pack the text, 'N' in the mask (TCAG order, as in .2bit files).
+   const char * text = "CCGATTACAGGGATTTACANNNNNGATCACACCGANTACAT";
+   size_t n = strlen(text);
+   unsigned char packed[16] = {0}, nmask[8] = {0};
+   for (size_t i = 0; i < n; i++) {
+      const char * c = strchr("TCAG", text[i]);
+      if (c == NULL) nmask[i/8] |= (unsigned char) (1 << (i%8));
+      else packed[i/4] |= (unsigned char) ((c - "TCAG") << (6 - 2*(i%4)));
+   }
+   g_assert_cmpint(seeqPackedMatch(packed, n, nmask, sq, SQ_ALL | SQ_PACKED_TCAG), ==,
+                   seeqStringMatch(text, ref, SQ_ALL));
+   g_assert_cmpint(sq->ctx.hits, ==, 4);
+   match_t * a, * b;
+   while ((b = seeqMatchIter(ref)) != NULL) {
+      a = seeqMatchIter(sq);
+      g_assert(a != NULL);
+      g_assert_cmpint(a->start, ==, b->start);
+      g_assert_cmpint(a->end, ==, b->end);
+      g_assert_cmpint(a->dist, ==, b->dist);
+   }
+   g_assert_cmpint(seeqPackedMatch(packed, n, nmask, sq, SQ_FIRST | SQ_PACKED_TCAG), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 2);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 9);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 0);
+   g_assert_cmpint(seeqPackedMatch(packed, n, nmask, sq, SQ_BEST | SQ_PACKED_TCAG), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 0);
+   // Without the mask the N are T.
+   g_assert_cmpint(seeqPackedMatch(packed, 36, NULL, sq, SQ_ALL | SQ_PACKED_TCAG), ==, 3);
+   // Too short for a match.
+   g_assert_cmpint(seeqPackedMatch(packed, 5, nmask, sq, SQ_ALL | SQ_PACKED_TCAG), ==, 0);
+   g_assert_cmpint(seeqPackedMatch(packed, 0, NULL, sq, SQ_ALL), ==, 0);
+
+   // ACGT order.
+   memset(packed, 0, sizeof(packed));
+   const char * acgt = "TTTGATTACATTT";
+   for (size_t i = 0; i < 13; i++)
+      packed[i/4] |= (unsigned char) ((strchr("ACGT", acgt[i]) - "ACGT") << (6 - 2*(i%4)));
+   g_assert_cmpint(seeqPackedMatch(packed, 13, NULL, sq, SQ_FIRST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 3);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 10);
+   g_assert_cmpint(seeqPackedMatch(packed, (size_t) INT64_MAX, NULL, sq, SQ_FIRST), ==, -1);
+   g_assert_cmpint(seeqerr, ==, 16);
+
+   seeqFree(sq);
+   seeqFree(ref);
+}
+
+
+void
+test_seeqSeeds
+(void)
+{
+   // Two pieces of 7 bases, matches span 15 bases at most.
+   char keys[14];
+   g_assert_cmpint(parse("GATTACAGATTNCA", keys), ==, 14);
+   segment_t seg = {14, 1};
+   seed_t * seeds = seed_new(keys, &seg, 1);
+   g_assert(seeds != NULL);
+   g_assert(seeds->first == 0x81);
+   g_assert(seeds->last == 0x2040);
+   g_assert_cmpint(seeds->span, ==, 15);
+   g_assert(seeds->mask[0] == 0x2952);
+   g_assert(seeds->mask[4] == 0x800);
+   free(seeds);
+   // Pieces too short.
+   seg.tau = 3;
+   g_assert(seed_new(keys, &seg, 1) == NULL);
+
+   seeq_t * sq  = seeqNew("GATTACAGATTACAGATT", 2, 0);
+   seeq_t * ref = seeqNew("GATTACAGATTACAGATT", 2, 0);
+   g_assert(sq != NULL);
+   g_assert(ref != NULL);
+   g_assert(sq->seeds != NULL);
+   free(ref->seeds);
+   ref->seeds = NULL;
+
+   // Matches far apart, the DFA restarts between them.
+   g_assert_cmpint(seeqStringMatch("CCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCC", sq, SQ_ALL), ==, 0);
+   g_assert_cmpint(seeqStringMatch("CCCCCCCCCCCCCCCCCCCCCCCCGATTACAGATTTACAGATTCCCCCCCCCC"
+                                   "CCCCCCCCCCCCCCCCCCCCCCCCCCGATTCAGATTACAGATT", sq, SQ_ALL), ==, 2);
+   g_assert_cmpint(sq->ctx.match[1].start, ==, 24);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 79);
+   srand(16);
+   char line[301];
+   for (int i = 0; i < 500; i++) {
+      for (int j = 0; j < 300; j++) line[j] = "ACGTN"[rand()%5];
+      // Mutated copies of the pattern.
+      for (int k = rand()%3; k > 0; k--) {
+         int pos = rand()%280;
+         memcpy(line + pos, "GATTACAGATTACAGATT", 18);
+         line[pos + rand()%18] = "ACGT"[rand()%4];
+         line[pos + rand()%18] = "ACGT"[rand()%4];
+      }
+      line[300] = 0;
+      if (i % 50 == 0) line[rand()%300] = '\n';
+      for (int opt = 0; opt < 3; opt++) {
+         g_assert_cmpint(seeqStringMatch(line, sq, opt | SQ_STREAM*(i%2)), ==,
+                         seeqStringMatch(line, ref, opt | SQ_STREAM*(i%2)));
+         match_t * a, * b;
+         while ((b = seeqMatchIter(ref)) != NULL) {
+            a = seeqMatchIter(sq);
+            g_assert(a != NULL);
+            g_assert_cmpint(a->start, ==, b->start);
+            g_assert_cmpint(a->end, ==, b->end);
+            g_assert_cmpint(a->dist, ==, b->dist);
+         }
+      }
+   }
+   seeqFree(sq);
+   seeqFree(ref);
+}
+
+void
+test_seeqComposition
+(void)
+{
+   seeq_t * sq  = seeqNew("AAAAAAAAAAAAAAAAAAAN", 4, 0);
+   seeq_t * ref = seeqNew("AAAAAAAAAAAAAAAAAAAN", 4, 0);
+   g_assert(sq != NULL);
+   g_assert(ref != NULL);
+   // Pieces of 4 bases, no seeds.
+   g_assert(sq->seeds == NULL);
+
+   // The filter is created on first use.
+   g_assert(sq->ctx.comp == NULL);
+   g_assert_cmpint(seeqStringMatch("ACGTACGTACGTACGTACGTACGTACGT", sq, SQ_COMPOSITION), ==, 0);
+   comp_t * comp = (comp_t *) sq->ctx.comp;
+   g_assert(comp != NULL);
+   g_assert_cmpint(comp->npat, ==, 1);
+   g_assert_cmpint(comp->span, ==, 24);
+   g_assert_cmpint(comp->pat[0].need[0], ==, 19);
+   g_assert_cmpint(comp->pat[0].need[3], ==, 0);
+   g_assert_cmpint(sq->ctx.stats.texts, ==, 1);
+   g_assert_cmpint(sq->ctx.stats.rejected, ==, 1);
+   g_assert_cmpint(sq->ctx.stats.bases, ==, 28);
+   g_assert_cmpint(sq->ctx.stats.skipped, ==, 28);
+   g_assert_cmpint(sq->ctx.stats.checked, ==, 28);
+   g_assert_cmpint(sq->ctx.stats.excluded, ==, 28);
+
+   // Only the window around the poly-A is read.
+   const char * text = "CGTCGTCGTCGTCGTCGTCGTCGTCGTCGTCGTCGTAAAAAAAAAATAAAAAAAAAACGTCGTCGTCGT";
+   g_assert_cmpint(seeqStringMatch(text, sq, SQ_ALL | SQ_COMPOSITION), ==, 1);
+   g_assert_cmpint(seeqStringMatch(text, ref, SQ_ALL), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, ref->ctx.match[0].start);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 1);
+   g_assert_cmpint(sq->ctx.stats.rejected, ==, 1);
+   g_assert_cmpint(sq->ctx.stats.skipped, >, 28);
+
+   // Same matches as without the filter.
+   srand(17);
+   char line[201];
+   for (int i = 0; i < 500; i++) {
+      for (int j = 0; j < 200; j++) line[j] = "AAAAAACGTN"[rand()%10];
+      line[200] = 0;
+      for (int opt = 0; opt < 3; opt++) {
+         g_assert_cmpint(seeqStringMatch(line, sq, opt | SQ_COMPOSITION), ==, seeqStringMatch(line, ref, opt));
+         match_t * a, * b;
+         while ((b = seeqMatchIter(ref)) != NULL) {
+            a = seeqMatchIter(sq);
+            g_assert(a != NULL);
+            g_assert_cmpint(a->start, ==, b->start);
+            g_assert_cmpint(a->end, ==, b->end);
+            g_assert_cmpint(a->dist, ==, b->dist);
+         }
+      }
+   }
+   g_assert_cmpint(sq->ctx.stats.excluded, >, 0);
+   g_assert_cmpint(sq->ctx.stats.excluded, <, sq->ctx.stats.checked);
+   seeqFree(sq);
+   seeqFree(ref);
+}
+
+void
+test_seeqMatchN
+(void)
+{
+   seeq_t * sq = seeqNew("GATTACA", 1, 0);
+   g_assert(sq != NULL);
+
+   // A slice of a line, the positions are offsets from the slice.
+   const char * line = "CCGATTACACCCCGATTACACC";
+   g_assert_cmpint(seeqMatchN(line + 6, 14, sq, SQ_ALL), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 7);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 14);
+   // The match ends at the end of the slice.
+   g_assert_cmpint(seeqMatchN(line, 9, sq, SQ_FIRST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 2);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 9);
+   // The end of the slice cuts the match.
+   g_assert_cmpint(seeqMatchN(line, 7, sq, SQ_FIRST), ==, 0);
+   g_assert_cmpint(seeqMatchN(line, 0, sq, SQ_FIRST), ==, 0);
+   // Null characters and newlines still end the search.
+   g_assert_cmpint(seeqMatchN("CC\0GATTACA", 10, sq, SQ_FIRST), ==, 0);
+   g_assert_cmpint(seeqMatchN("CC\nGATTACA", 10, sq, SQ_FIRST), ==, 0);
+   g_assert_cmpint(seeqMatchN("CC\nGATTACA", 10, sq, SQ_STREAM), ==, 1);
+   g_assert_cmpint(seeqMatchN(line, (size_t) INT64_MAX, sq, SQ_FIRST), ==, -1);
+   g_assert_cmpint(seeqerr, ==, 16);
+   // The error is also kept in the context of 'sq'.
+   g_assert_cmpint(sq->ctx.err, ==, 16);
+   g_assert_cmpint(seeqMatchN("GATTACA", 7, sq, SQ_FIRST), ==, 1);
+   g_assert_cmpint(sq->ctx.err, ==, 0);
+
+   // No character after the text is read: it ends before a protected page.
+   long pagesz = sysconf(_SC_PAGESIZE);
+   char * map = mmap(NULL, 2 * (size_t) pagesz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   g_assert(map != MAP_FAILED);
+   g_assert_cmpint(mprotect(map + pagesz, (size_t) pagesz, PROT_NONE), ==, 0);
+   memset(map, 'C', (size_t) pagesz);
+   memcpy(map + pagesz - 7, "GATTACA", 7);
+   int opts[3] = {SQ_ALL, SQ_BEST | SQ_STREAM, SQ_FIRST | SQ_COMPOSITION};
+   for (int k = 0; k < 3; k++) {
+      for (size_t len = 1; len <= 40; len++) {
+         g_assert_cmpint(seeqMatchN(map + pagesz - len, len, sq, opts[k]), ==, len >= 6);
+         if (len >= 6) g_assert_cmpint(sq->ctx.match[0].end, ==, len);
+      }
+   }
+   // Same with the exact seeds of a longer pattern.
+   seeq_t * seeds = seeqNew("GATTACAGATTACAGATT", 1, 0);
+   g_assert(seeds != NULL);
+   g_assert(seeds->seeds != NULL);
+   memcpy(map + pagesz - 18, "GATTACAGATTACAGATT", 18);
+   g_assert_cmpint(seeqMatchN(map, (size_t) pagesz, seeds, SQ_FIRST), ==, 1);
+   g_assert_cmpint(seeds->ctx.match[0].end, ==, pagesz);
+   g_assert_cmpint(seeqMatchN(map, (size_t) pagesz - 2, seeds, SQ_FIRST), ==, 0);
+   munmap(map, 2 * (size_t) pagesz);
+
+   seeqFree(seeds);
+   seeqFree(sq);
+}
+
+void
+test_seeqFwdStart
+(void)
+{
+   g_assert_cmpint(start_width(0), ==, 1);
+   g_assert_cmpint(start_width(1), ==, 2);
+   g_assert_cmpint(start_width(2), ==, 3);
+   g_assert_cmpint(start_width(3), ==, 4);
+
+   // No reverse DFA, the rows hold the start cells.
+   seeq_t * sq  = seeqNewOpt("GATTACA", 1, 0, SQ_FWDSTART);
+   seeq_t * ref = seeqNew("GATTACA", 1, 0);
+   g_assert(sq != NULL);
+   g_assert(ref != NULL);
+   g_assert(sq->rdfa == NULL);
+   g_assert(sq->ctx.rcache == NULL);
+   g_assert_cmpint(((dfa_t *) sq->dfa)->metric, ==, DFA_STARTS);
+   g_assert_cmpint(((dfa_t *) sq->dfa)->trie->height, ==, 7 * start_width(1));
+
+   // Exact match and one insertion in the text.
+   g_assert_cmpint(seeqStringMatch("CCCGATTACACCC", sq, SQ_FIRST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 3);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 10);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 0);
+   g_assert_cmpint(seeqStringMatch("CCCGATTTACACCC", sq, SQ_BEST), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 3);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 11);
+   g_assert_cmpint(sq->ctx.match[0].dist, ==, 1);
+   // The ignored characters are not counted.
+   g_assert_cmpint(seeqStringMatch("CCC-GAT-TACACCC", sq, SQ_FIRST | SQ_IGNORE), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 4);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 12);
+   g_assert_cmpint(seeqStringMatch("CC\nCGAT\nTACACCC", sq, SQ_FIRST | SQ_STREAM), ==, 1);
+   g_assert_cmpint(sq->ctx.match[0].start, ==, 4);
+   g_assert_cmpint(sq->ctx.match[0].end, ==, 12);
+
+   // Same ends and distances as the reverse DFA, and the starts differ
+   // only when there is more than one span of the same distance.
+   srand(19);
+   char line[101];
+   for (int i = 0; i < 500; i++) {
+      for (int j = 0; j < 100; j++) line[j] = "ACGTN"[rand()%5];
+      line[100] = 0;
+      for (int opt = 0; opt < 3; opt++) {
+         g_assert_cmpint(seeqStringMatch(line, sq, opt), ==, seeqStringMatch(line, ref, opt));
+         match_t * a, * b;
+         while ((b = seeqMatchIter(ref)) != NULL) {
+            a = seeqMatchIter(sq);
+            g_assert(a != NULL);
+            g_assert_cmpint(a->end, ==, b->end);
+            g_assert_cmpint(a->dist, ==, b->dist);
+            g_assert_cmpint(a->start, <=, a->end);
+            g_assert_cmpint(a->end - a->start, >=, 7 - a->dist);
+            g_assert_cmpint(a->end - a->start, <=, 7 + a->dist);
+            if (a->start == b->start) continue;
+            seeq_t * span = seeqNew("GATTACA", a->dist, 0);
+            g_assert(span != NULL);
+            char sub[101];
+            memcpy(sub, line + a->start, a->end - a->start);
+            sub[a->end - a->start] = 0;
+            g_assert_cmpint(seeqStringMatch(sub, span, SQ_BEST), ==, 1);
+            g_assert_cmpint(span->ctx.match[0].dist, ==, a->dist);
+            seeqFree(span);
+         }
+      }
+   }
+
+   // Both strands, stride 2 and precompiled DFAs.
+   seeq_t * both = seeqNewOpt("GATTACA", 1, 0, SQ_FWDSTART | SQ_BOTHSTRANDS | SQ_STRIDE2);
+   g_assert(both != NULL);
+   g_assert(both->rdfa == NULL);
+   g_assert_cmpint(seeqStringMatch("CCCTGTAATCCC", both, SQ_ALL), ==, 1);
+   g_assert_cmpint(both->ctx.match[0].start, ==, 3);
+   g_assert_cmpint(both->ctx.match[0].end, ==, 10);
+   g_assert_cmpint(both->ctx.match[0].strand, ==, 1);
+   seeqFree(both);
+   seeq_t * pre = seeqNewOpt("GATTACA", 2, 0, SQ_FWDSTART | SQ_PRECOMPILE);
+   g_assert(pre != NULL);
+   g_assert_cmpint(seeqStringMatch("CCCGATTTACACCC", pre, SQ_BEST), ==, 1);
+   g_assert_cmpint(pre->ctx.match[0].start, ==, 3);
+   g_assert_cmpint(pre->ctx.match[0].end, ==, 11);
+   seeq_t * clone = seeqClone(pre);
+   g_assert(clone != NULL);
+   g_assert(clone->rdfa == NULL);
+   g_assert_cmpint(seeqStringMatch("CCCGATTTACACCC", clone, SQ_BEST), ==, 1);
+   g_assert_cmpint(clone->ctx.match[0].start, ==, 3);
+   seeqFree(clone);
+   seeqFree(pre);
+
+   // Saved with a single DFA section.
+   const char * fname = "testfwd.sqdfa";
+   g_assert_cmpint(seeqSave(sq, fname), ==, 0);
+   seeq_t * lsq = seeqLoad(fname, 0);
+   g_assert(lsq != NULL);
+   g_assert(lsq->rdfa == NULL);
+   g_assert_cmpint(((dfa_t *) lsq->dfa)->metric, ==, DFA_STARTS);
+   g_assert_cmpint(seeqStringMatch("CCCGATTTACACCC", lsq, SQ_BEST), ==, 1);
+   g_assert_cmpint(lsq->ctx.match[0].start, ==, 3);
+   g_assert_cmpint(lsq->ctx.match[0].end, ==, 11);
+   seeqFree(lsq);
+   unlink(fname);
+
+   // The Hamming DFAs do not need the reverse DFA either.
+   seeq_t * ham = seeqNewOpt("GATTACA", 1, 0, SQ_HAMMING);
+   g_assert(ham != NULL);
+   g_assert(ham->rdfa == NULL);
+   seeqFree(ham);
+
+   seeqFree(sq);
+   seeqFree(ref);
+}
+
+struct ctxarg_t {
+   const seeq_t * sq;
+   seeq_ctx_t   * ctx;
+   char        ** lines;
+   int            nlines;
+   long         * hits;
+};
+
+void *
+ctx_match
+(
+   void * data
+)
+{
+   struct ctxarg_t * arg = data;
+   for (int i = 0; i < arg->nlines; i++) {
+      arg->hits[i] = seeqCtxMatchN(arg->lines[i], strlen(arg->lines[i]), arg->sq, arg->ctx, SQ_ALL);
+      if (arg->hits[i] > 0) {
+         match_t * match = seeqCtxMatchIter(arg->ctx);
+         arg->hits[i] = arg->hits[i] * 10000 + (long) match->start * 100 + (long) match->end;
+      }
+   }
+   return NULL;
+}
+
+void
+test_seeqCtx
+(void)
+{
+   // Private DFAs have no contexts.
+   seeq_t * sq = seeqNew("ACGTACGTAC", 2, 0);
+   g_assert(sq != NULL);
+   g_assert(seeqCtxNew(sq) == NULL);
+   g_assert_cmpint(seeqerr, ==, 14);
+   seeqFree(sq);
+   sq = seeqNewOpt("ACGTACGTAC", 2, 0, SQ_BOTHSTRANDS);
+   g_assert(sq != NULL);
+   g_assert(seeqCtxNew(sq) == NULL);
+   g_assert_cmpint(seeqerr, ==, 14);
+   seeqFree(sq);
+   seeqCtxFree(NULL);
+
+   // Random lines.
+   const int nlines = 2000;
+   char * lines[nlines];
+   srand48(5);
+   for (int i = 0; i < nlines; i++) {
+      lines[i] = malloc(101);
+      for (int j = 0; j < 100; j++) lines[i][j] = "ACGTN"[lrand48() % 5];
+      if (i % 3 == 0) memcpy(lines[i] + lrand48() % 90, "ACGAACGTAC", 10);
+      lines[i][100] = 0;
+   }
+
+   // Reference results.
+   long ref[nlines];
+   sq = seeqNew("ACGTACGTAC", 2, 0);
+   g_assert(sq != NULL);
+   struct clonearg_t refarg = {sq, lines, nlines, ref};
+   clone_match(&refarg);
+   seeqFree(sq);
+
+   // Many threads on one seeq_t, with and without memory limit. The
+   // seeq_t is not modified.
+   const int nthreads = 8;
+   size_t memory[2] = {0, 4096};
+   for (int m = 0; m < 2; m++) {
+      sq = seeqNewOpt("ACGTACGTAC", 2, memory[m], SQ_SHARED);
+      g_assert(sq != NULL);
+      pthread_t thread[nthreads];
+      struct ctxarg_t arg[nthreads];
+      long hits[nthreads][nlines];
+      for (int t = 0; t < nthreads; t++) {
+         arg[t] = (struct ctxarg_t) {sq, seeqCtxNew(sq), lines, nlines, hits[t]};
+         g_assert(arg[t].ctx != NULL);
+         g_assert(arg[t].ctx->cache != NULL);
+      }
+      for (int t = 0; t < nthreads; t++)
+         g_assert_cmpint(pthread_create(thread + t, NULL, ctx_match, arg + t), ==, 0);
+      for (int t = 0; t < nthreads; t++) {
+         pthread_join(thread[t], NULL);
+         for (int i = 0; i < nlines; i++) g_assert_cmpint(hits[t][i], ==, ref[i]);
+         g_assert_cmpint(arg[t].ctx->stats.texts, ==, nlines);
+         g_assert_cmpint(arg[t].ctx->err, ==, 0);
+         seeqCtxFree(arg[t].ctx);
+      }
+      g_assert_cmpint(sq->ctx.hits, ==, 0);
+      g_assert(sq->ctx.codes == NULL);
+      g_assert_cmpint(sq->ctx.stats.texts, ==, 0);
+      seeqFree(sq);
+   }
+
+   // Pattern sets and both strands, also in cache mode. The rows of the
+   // states are in the contexts.
+   const char * patterns[3] = {"ACGTACGTAC", "GATTACA", "CCCTTTAG"};
+   const int    taus[3] = {2, 1, 1};
+   for (int v = 0; v < 4; v++) {
+      size_t mem = v < 2 ? 0 : 4096;
+      seeq_t * priv = v % 2 ? seeqNewOpt("ACGTACGTAC", 2, mem, SQ_BOTHSTRANDS) :
+         seeqNewMulti(patterns, taus, 3, mem);
+      sq = v % 2 ? seeqNewOpt("ACGTACGTAC", 2, mem, SQ_BOTHSTRANDS | SQ_SHARED) :
+         seeqNewMultiOpt(patterns, taus, 3, mem, SQ_SHARED);
+      g_assert(priv != NULL);
+      g_assert(sq != NULL);
+      long pref[nlines];
+      struct clonearg_t parg = {priv, lines, nlines, pref};
+      clone_match(&parg);
+      pthread_t thread[4];
+      struct ctxarg_t arg[4];
+      long hits[4][nlines];
+      for (int t = 0; t < 4; t++) {
+         arg[t] = (struct ctxarg_t) {sq, seeqCtxNew(sq), lines, nlines, hits[t]};
+         g_assert(arg[t].ctx != NULL);
+         g_assert(arg[t].ctx->rcache != NULL);
+      }
+      for (int t = 0; t < 4; t++)
+         g_assert_cmpint(pthread_create(thread + t, NULL, ctx_match, arg + t), ==, 0);
+      for (int t = 0; t < 4; t++) {
+         pthread_join(thread[t], NULL);
+         for (int i = 0; i < nlines; i++) g_assert_cmpint(hits[t][i], ==, pref[i]);
+         g_assert(arg[t].ctx->row != NULL);
+         seeqCtxFree(arg[t].ctx);
+      }
+      g_assert(sq->ctx.row == NULL);
+      seeqFree(sq);
+      seeqFree(priv);
+   }
+   g_assert(seeqNewMultiOpt(patterns, taus, 3, 0, SQ_BOTHSTRANDS) == NULL);
+
+   // Complete DFAs need no scratch.
+   sq = seeqNewOpt("ACGTACGTAC", 2, 0, SQ_PRECOMPILE);
+   g_assert(sq != NULL);
+   seeq_ctx_t * ctx = seeqCtxNew(sq);
+   g_assert(ctx != NULL);
+   g_assert(ctx->cache == NULL);
+   g_assert(ctx->rcache == NULL);
+   long hits[nlines];
+   struct ctxarg_t arg = {sq, ctx, lines, nlines, hits};
+   ctx_match(&arg);
+   for (int i = 0; i < nlines; i++) g_assert_cmpint(hits[i], ==, ref[i]);
+
+   // Errors are also stored in the context.
+   g_assert_cmpint(seeqCtxMatchN(lines[0], (size_t) INT64_MAX, sq, ctx, SQ_FIRST), ==, -1);
+   g_assert_cmpint(ctx->err, ==, 16);
+   g_assert_cmpint(seeqCtxMatchN("ACGTACGTAC", 10, sq, ctx, SQ_FIRST), ==, 1);
+   g_assert_cmpint(ctx->err, ==, 0);
+
+   // Packed sequences and composition filter.
+   const unsigned char packed[3] = {0x1B, 0x1B, 0x1B}; // ACGTACGTACGT
+   g_assert_cmpint(seeqCtxPackedMatch(packed, 12, NULL, sq, ctx, SQ_FIRST), ==, 1);
+   g_assert_cmpint(ctx->match[0].start, ==, 0);
+   g_assert_cmpint(ctx->match[0].end, ==, 10);
+   g_assert(ctx->comp == NULL);
+   g_assert_cmpint(seeqCtxMatchN("AAAAAAAAAAAAAAAAAAAA", 20, sq, ctx, SQ_COMPOSITION), ==, 0);
+   g_assert(ctx->comp != NULL);
+   g_assert(sq->ctx.comp == NULL);
+   seeqCtxFree(ctx);
+   seeqFree(sq);
+
+   for (int i = 0; i < nlines; i++) free(lines[i]);
+}
+
+void
+test_seeqBatchMatch
+(void)
+{
+   seeq_t * sq  = seeqNew("GATTACA", 1, 0);
+   seeq_t * ref = seeqNew("GATTACA", 1, 0);
+   g_assert(sq != NULL);
+   g_assert(ref != NULL);
+
+   const char * reads[4] = {"GATTACAGATTACA", "CCCCCC", "CCGATTTACA", "GATTACA"};
+   size_t text[8], start[8], end[8], dist[8];
+   seeqbatch_t batch = {8, 0, text, start, end, dist, NULL, NULL};
+   g_assert_cmpint(seeqBatchMatch(reads, NULL, 4, sq, &batch, SQ_ALL), ==, 4);
+   g_assert_cmpint(batch.hits, ==, 4);
+   size_t expect[4][4] = {{0, 0, 7, 0}, {0, 7, 14, 0}, {2, 2, 10, 1}, {3, 0, 7, 0}};
+   for (int i = 0; i < 4; i++) {
+      g_assert_cmpint(text[i], ==, expect[i][0]);
+      g_assert_cmpint(start[i], ==, expect[i][1]);
+      g_assert_cmpint(end[i], ==, expect[i][2]);
+      g_assert_cmpint(dist[i], ==, expect[i][3]);
+   }
+   g_assert_cmpint(sq->ctx.hits, ==, 0);
+   g_assert_cmpint(sq->ctx.stats.texts, ==, 4);
+
+   // Lengths of the texts.
+   size_t lens[4] = {7, 6, 10, 4};
+   g_assert_cmpint(seeqBatchMatch(reads, lens, 4, sq, &batch, SQ_ALL), ==, 4);
+   g_assert_cmpint(batch.hits, ==, 2);
+   g_assert_cmpint(text[1], ==, 2);
+
+   // Stops before the text that does not fit.
+   batch.size = 1;
+   g_assert_cmpint(seeqBatchMatch(reads, NULL, 4, sq, &batch, SQ_ALL), ==, 0);
+   g_assert_cmpint(batch.hits, ==, 0);
+   g_assert_cmpint(seeqBatchMatch(reads + 1, NULL, 3, sq, &batch, SQ_ALL), ==, 2);
+   g_assert_cmpint(batch.hits, ==, 1);
+   g_assert_cmpint(text[0], ==, 1);
+   g_assert_cmpint(start[0], ==, 2);
+
+   // Same matches as one text at a time.
+   const int nreads = 1000;
+   char * lines[nreads];
+   srand(21);
+   for (int i = 0; i < nreads; i++) {
+      lines[i] = malloc(151);
+      for (int j = 0; j < 150; j++) lines[i][j] = "ACGTN"[rand()%5];
+      lines[i][150] = 0;
+   }
+   size_t btext[256], bstart[256], bend[256], bdist[256];
+   batch = (seeqbatch_t) {256, 0, btext, bstart, bend, bdist, NULL, NULL};
+   int next = 0;
+   while (next < nreads) {
+      long done = seeqBatchMatch((const char **) lines + next, NULL, (size_t) (nreads - next), sq, &batch, SQ_ALL);
+      g_assert_cmpint(done, >, 0);
+      size_t h = 0;
+      for (int i = next; i < next + done; i++) {
+         seeqStringMatch(lines[i], ref, SQ_ALL);
+         match_t * m;
+         while ((m = seeqMatchIter(ref)) != NULL) {
+            g_assert_cmpint(h, <, batch.hits);
+            g_assert_cmpint(btext[h] + (size_t) next, ==, i);
+            g_assert_cmpint(bstart[h], ==, m->start);
+            g_assert_cmpint(bend[h], ==, m->end);
+            g_assert_cmpint(bdist[h], ==, m->dist);
+            h++;
+         }
+      }
+      g_assert_cmpint(h, ==, batch.hits);
+      next += (int) done;
+   }
+
+   // Interleaved scan: where the texts stop, the texts without match are
+   // read to their end.
+   seeq_t * pre = seeqNewOpt("GATTACA", 1, 0, SQ_PRECOMPILE);
+   g_assert(pre != NULL);
+   g_assert(pre->seeds == NULL);
+   const char * group[5] = {"CCCCCC", "CCGATTACACC", "CCC\nGATTACA", "CC-GATTACA", ""};
+   scan_t scan[5];
+   batch_scan(pre->dfa, 1, group, NULL, 5, SQ_FAIL, scan);
+   g_assert_cmpint(scan[0].state, ==, 0);
+   g_assert_cmpint(scan[0].pos, ==, 6);
+   g_assert_cmpint(scan[1].state, !=, 0);
+   g_assert_cmpint(scan[1].pos, ==, 7);
+   g_assert_cmpint(scan[2].state, ==, 0);
+   g_assert_cmpint(scan[2].pos, ==, 3);
+   g_assert_cmpint(scan[3].state, ==, 0);
+   g_assert_cmpint(scan[3].pos, ==, 2);
+   g_assert_cmpint(scan[4].state, ==, 0);
+   g_assert_cmpint(scan[4].pos, ==, 0);
+   batch_scan(pre->dfa, 1, group, NULL, 5, SQ_IGNORE | SQ_STREAM, scan);
+   g_assert_cmpint(scan[2].state, !=, 0);
+   g_assert_cmpint(scan[3].state, !=, 0);
+   size_t cut[5] = {6, 6, 11, 10, 0};
+   batch_scan(pre->dfa, 1, group, cut, 5, SQ_FAIL, scan);
+   g_assert_cmpint(scan[1].state, ==, 0);
+   g_assert_cmpint(scan[1].pos, ==, 6);
+
+   // The gather scan stops the texts at the same place as 'batch_scan', with
+   // narrow and wide vertices (it returns 1 without AVX2).
+   seeq_t * wide = seeqNewOpt("ACGTTGCAACGGTACCATGA", 5, 0, SQ_PRECOMPILE);
+   g_assert(wide != NULL);
+   g_assert_cmpint(((dfa_t *) wide->dfa)->state_size, ==, DFA_STATE_SIZE);
+   seeq_t * complete[2] = {pre, wide};
+   int gopts[3] = {SQ_FAIL, SQ_IGNORE | SQ_STREAM, SQ_CONVERT};
+   for (int v = 0; v < 2; v++) {
+      seeq_ctx_t * gctx = seeqCtxNew(complete[v]);
+      g_assert(gctx != NULL);
+      for (int o = 0; o < 3; o++) {
+         for (int k = 0; k < nreads; k += BATCH_GROUP) {
+            const char * const * gdata = (const char **) lines + k;
+            size_t m = nreads - k < BATCH_GROUP ? (size_t) (nreads - k) : BATCH_GROUP;
+            scan_t ref[BATCH_GROUP], vec[BATCH_GROUP];
+            batch_scan(complete[v]->dfa, complete[v]->tau, gdata, NULL, m, gopts[o], ref);
+            if (batch_gather(complete[v]->dfa, complete[v]->tau, gdata, NULL, m, gopts[o], gctx, vec))
+               continue;
+            for (size_t g = 0; g < m; g++) {
+               g_assert_cmpint(vec[g].state, ==, ref[g].state);
+               g_assert_cmpint(vec[g].pos, ==, ref[g].pos);
+            }
+         }
+         scan_t ref[5], vec[5];
+         batch_scan(complete[v]->dfa, complete[v]->tau, group, cut, 5, gopts[o], ref);
+         if (batch_gather(complete[v]->dfa, complete[v]->tau, group, cut, 5, gopts[o], gctx, vec))
+            continue;
+         for (int g = 0; g < 5; g++) {
+            g_assert_cmpint(vec[g].state, ==, ref[g].state);
+            g_assert_cmpint(vec[g].pos, ==, ref[g].pos);
+         }
+      }
+      seeqCtxFree(gctx);
+   }
+   seeqFree(wide);
+   seeqFree(pre);
+
+   // Same matches with the states computed on the way, and without the
+   // interleaved scan when the states are evicted.
+   seeq_t * one = seeqNew("ACGTTGCAAGGCTTACGA", 4, 0);
+   g_assert(one != NULL);
+   size_t memory[2] = {0, 3000};
+   for (int m = 0; m < 2; m++) {
+      seeq_t * lazy = seeqNewOpt("ACGTTGCAAGGCTTACGA", 4, memory[m], SQ_LAZY);
+      g_assert(lazy != NULL);
+      g_assert(lazy->seeds == NULL);
+      batch = (seeqbatch_t) {256, 0, btext, bstart, bend, bdist, NULL, NULL};
+      g_assert_cmpint(seeqBatchMatch((const char **) lines, NULL, 100, lazy, &batch, SQ_ALL), ==, 100);
+      size_t h = 0;
+      for (int i = 0; i < 100; i++) {
+         g_assert_cmpint(seeqStringMatch(lines[i], one, SQ_ALL), >=, 0);
+         match_t * mt;
+         while ((mt = seeqMatchIter(one)) != NULL) {
+            g_assert_cmpint(btext[h], ==, i);
+            g_assert_cmpint(bstart[h], ==, mt->start);
+            g_assert_cmpint(bend[h], ==, mt->end);
+            g_assert_cmpint(bdist[h], ==, mt->dist);
+            h++;
+         }
+      }
+      g_assert_cmpint(h, ==, batch.hits);
+      g_assert_cmpint(lazy->ctx.stats.texts, ==, 100);
+      g_assert_cmpint(lazy->ctx.stats.bases, ==, 15000);
+      seeqFree(lazy);
+   }
+   seeqFree(one);
+
+   // Pattern sets tag the strand.
+   seeq_t * both = seeqNewOpt("GATTACA", 0, 0, SQ_BOTHSTRANDS);
+   g_assert(both != NULL);
+   size_t pattern[8], strand[8];
+   batch = (seeqbatch_t) {8, 0, text, start, end, dist, pattern, strand};
+   const char * strands[2] = {"TGTAATC", "CCGATTACA"};
+   g_assert_cmpint(seeqBatchMatch(strands, NULL, 2, both, &batch, SQ_ALL), ==, 2);
+   g_assert_cmpint(batch.hits, ==, 2);
+   g_assert_cmpint(strand[0], ==, 1);
+   g_assert_cmpint(strand[1], ==, 0);
+   g_assert_cmpint(start[1], ==, 2);
+   g_assert_cmpint(pattern[0], ==, 0);
+   seeqFree(both);
+
+   // Threads share the seeq_t with their contexts.
+   seeq_t * shared = seeqNewOpt("GATTACA", 1, 0, SQ_SHARED);
+   g_assert(shared != NULL);
+   seeq_ctx_t * ctx = seeqCtxNew(shared);
+   g_assert(ctx != NULL);
+   batch = (seeqbatch_t) {8, 0, text, start, end, dist, NULL, NULL};
+   g_assert_cmpint(seeqCtxBatchMatch(reads, NULL, 4, shared, ctx, &batch, SQ_ALL), ==, 4);
+   g_assert_cmpint(batch.hits, ==, 4);
+   g_assert_cmpint(ctx->stats.texts, ==, 4);
+   g_assert_cmpint(ctx->err, ==, 0);
+   seeqCtxFree(ctx);
+   seeqFree(shared);
+
+   for (int i = 0; i < nreads; i++) free(lines[i]);
+   seeqFree(sq);
+   seeqFree(ref);
+}
+
+void
+test_seeqPerf
+(void)
+{
+   // Timing of the matching loop, only with '-m=perf' (see 'make testperf').
+   if (!g_test_perf()) return;
+
+   // Random reads, a tenth of them with a match.
+   const int nlines = 20000;
+   char * lines[nlines];
+   srand48(12);
+   for (int i = 0; i < nlines; i++) {
+      lines[i] = malloc(151);
+      g_assert(lines[i] != NULL);
+      for (int j = 0; j < 150; j++) lines[i][j] = "ACGT"[lrand48() % 4];
+      if (i % 10 == 0) memcpy(lines[i] + lrand48() % 136, "GATTACAGATTACA", 14);
+      lines[i][150] = 0;
+   }
+
+   // Default options, memory limit, precompiled and shared DFAs.
+   struct { const char * name; size_t memory; int opt; } mode[4] = {
+      {"default", 0, 0}, {"1 MB", 1 << 20, 0},
+      {"precompiled", 64 << 20, SQ_PRECOMPILE}, {"shared", 0, SQ_SHARED}
+   };
+   long ref = -1;
+   for (int m = 0; m < 4; m++) {
+      seeq_t * sq = seeqNewOpt("GATTACAGATTACA", 2, mode[m].memory, mode[m].opt);
+      g_assert(sq != NULL);
+      long hits = 0;
+      g_test_timer_start();
+      for (int r = 0; r < 10; r++) {
+         for (int i = 0; i < nlines; i++) hits += seeqStringMatch(lines[i], sq, SQ_FIRST) > 0;
+      }
+      double elapsed = g_test_timer_elapsed();
+      g_test_minimized_result(elapsed, "seeqStringMatch (%s): %.3f s", mode[m].name, elapsed);
+      if (ref < 0) ref = hits;
+      g_assert_cmpint(hits, ==, ref);
+      seeqFree(sq);
+   }
+   g_assert_cmpint(ref, >=, nlines);
+
+   // The same reads in a batch (see 'seeqBatchMatch').
+   size_t * arrays = malloc(4 * nlines * sizeof(size_t));
+   g_assert(arrays != NULL);
+   seeq_t * sq = seeqNew("GATTACAGATTACA", 2, 0);
+   g_assert(sq != NULL);
+   long hits = 0;
+   g_test_timer_start();
+   for (int r = 0; r < 10; r++) {
+      seeqbatch_t batch = {nlines, 0, arrays, arrays + nlines, arrays + 2*nlines, arrays + 3*nlines, NULL, NULL};
+      g_assert_cmpint(seeqBatchMatch((const char * const *) lines, NULL, nlines, sq, &batch, SQ_FIRST), ==, nlines);
+      hits += batch.hits;
+   }
+   double elapsed = g_test_timer_elapsed();
+   g_test_minimized_result(elapsed, "seeqBatchMatch: %.3f s", elapsed);
+   g_assert_cmpint(hits, ==, ref);
+   seeqFree(sq);
+   free(arrays);
+
+   for (int i = 0; i < nlines; i++) free(lines[i]);
 }
 
 void
@@ -1207,6 +2773,55 @@ test_seeq
    g_assert_cmpstr(OUTPUT_BUFFER+offset, ==, answer);
    offset = strlen(OUTPUT_BUFFER);
 
+   // Test 13: threads, same output as one thread.
+   args.threads = 3;
+   answer = "1 CACAGAT\n3 CACAGAT\n3 CACAGAT\n3 CACAGRAT\n";
+   seeq(pattern, input, args);
+   g_assert_cmpstr(OUTPUT_BUFFER+offset, ==, answer);
+   offset = strlen(OUTPUT_BUFFER);
+
+   args.all = args.matchonly = args.non_dna = 0;
+   args.dist = 3;
+   args.compact = 1;
+   answer = "1:8-14:0\n2:8-11:3\n";
+   seeq(pattern, input, args);
+   g_assert_cmpstr(OUTPUT_BUFFER+offset, ==, answer);
+   offset = strlen(OUTPUT_BUFFER);
+
+   args.compact = args.dist = 0;
+   args.invert = args.printline = 1;
+   answer = "2 TCTATCATCCGTACTCTGATCTCAT\n3 RCACAGATCACAGATCACAGRATCAC\n";
+   seeq(pattern, input, args);
+   g_assert_cmpstr(OUTPUT_BUFFER+offset, ==, answer);
+   offset = strlen(OUTPUT_BUFFER);
+
+   args.invert = args.showline = 0;
+   args.count = args.unordered = 1;
+   answer = "1\n";
+   seeq(pattern, input, args);
+   g_assert_cmpstr(OUTPUT_BUFFER+offset, ==, answer);
+   offset = strlen(OUTPUT_BUFFER);
+   args.count = args.unordered = 0;
+
+   // Threads on a FASTA file, with a header in the middle and no
+   // newline after the last line.
+   FILE * f = fopen("testthreads.fa", "w");
+   g_assert(f != NULL);
+   fprintf(f, ">seq1\nGTATGTACCACAGATGTCGATCGAC\n>seq2\n"
+         "TCTATCATCCGTACTCTGATCTCAT\nACACAGATC");
+   fclose(f);
+   args.showline = 1;
+   answer = "1 GTATGTACCACAGATGTCGATCGAC\n3 ACACAGATC\n";
+   seeq(pattern, "testthreads.fa", args);
+   g_assert_cmpstr(OUTPUT_BUFFER+offset, ==, answer);
+   offset = strlen(OUTPUT_BUFFER);
+   args.threads = 0;
+   seeq(pattern, "testthreads.fa", args);
+   g_assert_cmpstr(OUTPUT_BUFFER+offset, ==, answer);
+   offset = strlen(OUTPUT_BUFFER);
+   args.showline = 0;
+   unlink("testthreads.fa");
+
    // Test 10: incorrect pattern.
    g_assert(seeq("CACAG[AT", input, args) == EXIT_FAILURE);
    g_assert_cmpint(seeqerr, ==, 5);
@@ -1239,6 +2854,9 @@ test_seeq
    // Exhaustive alloc test.
    set_alloc_failure_rate_to(0.05);
    for (int i = 0; i < 10000; i++) seeq(pattern, input, args);
+   args.threads = 2;
+   for (int i = 0; i < 1000; i++) seeq(pattern, input, args);
+   args.threads = 0;
    reset_alloc();
 
    unredirect_sderr();
@@ -1264,11 +2882,28 @@ main(
    g_test_add_func("/libseeq/core/trie_search", test_trie_search);
    g_test_add_func("/libseeq/core/dfa_new", test_dfa_new);
    g_test_add_func("/libseeq/core/dfa_newvertex", test_dfa_newvertex);
+   g_test_add_func("/libseeq/core/dfa_widen", test_dfa_widen);
    g_test_add_func("/libseeq/core/dfa_newstate", test_dfa_newstate);
    g_test_add_func("/libseeq/core/dfa_step", test_dfa_step);
+   g_test_add_func("/libseeq/core/dfa_evict", test_dfa_evict);
    g_test_add_func("/libseeq/core/parse", test_parse);
+   g_test_add_func("/libseeq/core/text_translate", test_text_translate);
    g_test_add_func("/libseeq/lib/seeqNew", test_seeqNew);
    g_test_add_func("/libseeq/lib/seeqFileMatch", test_seeqFileMatch);
+   g_test_add_func("/libseeq/lib/seeqLoad", test_seeqLoad);
+   g_test_add_func("/libseeq/lib/seeqClone", test_seeqClone);
+   g_test_add_func("/libseeq/lib/seeqNewMulti", test_seeqNewMulti);
+   g_test_add_func("/libseeq/lib/seeqHamming", test_seeqHamming);
+   g_test_add_func("/libseeq/lib/seeqBothStrands", test_seeqBothStrands);
+   g_test_add_func("/libseeq/lib/seeqStride", test_seeqStride);
+   g_test_add_func("/libseeq/lib/seeqPackedMatch", test_seeqPackedMatch);
+   g_test_add_func("/libseeq/lib/seeqSeeds", test_seeqSeeds);
+   g_test_add_func("/libseeq/lib/seeqComposition", test_seeqComposition);
+   g_test_add_func("/libseeq/lib/seeqMatchN", test_seeqMatchN);
+   g_test_add_func("/libseeq/lib/seeqFwdStart", test_seeqFwdStart);
+   g_test_add_func("/libseeq/lib/seeqCtx", test_seeqCtx);
+   g_test_add_func("/libseeq/lib/seeqBatchMatch", test_seeqBatchMatch);
+   g_test_add_func("/libseeq/lib/seeqPerf", test_seeqPerf);
    g_test_add_func("/libseeq/lib/seeqClose", test_seeqClose);
    g_test_add_func("/seeq", test_seeq);
 